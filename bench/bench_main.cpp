@@ -0,0 +1,249 @@
+// 基准测试：启动进程内模拟AI服务，用批量模式回放语料，输出各阶段 p50/p95/p99；
+// 可注入延迟抖动、错误与限流压测路由层，或单独作为模拟服务运行（--serve）
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <batch_runner.h>
+#include <mock_server.h>
+#include <memory>
+#include <trace.h>
+
+namespace {
+
+void print_usage(const char* prog) {
+    std::cout << "用法：" << prog << " [选项]\n"
+              << "  --corpus <文件>       语料JSONL（默认bench/corpus.jsonl）\n"
+              << "  -j, --concurrency <N> 并发数（默认4）\n"
+              << "  --repeat <N>          语料重复次数（默认8）\n"
+              << "  --latency-ms <N>      模拟AI首字延迟（默认300）\n"
+              << "  --chunk-ms <N>        模拟AI流式分片间隔（默认20）\n"
+              << "  --jitter-ms <N>       首字延迟额外随机增加 0~N ms\n"
+              << "  --error-rate <比例>   模拟服务返回HTTP 500的比例（0~1）\n"
+              << "  --rate-limit <比例>   模拟服务返回HTTP 429的比例（0~1）\n"
+              << "  --retry-after <秒>    429响应的Retry-After（默认1）\n"
+              << "  --seed <N>            故障注入的随机种子（默认1，同一种子可复现）\n"
+              << "  --models <N>          启动N个模拟服务作为N个模型，测试路由切换与对冲（默认1）\n"
+              << "  --no-hedge            多个模型时不发出对冲请求\n"
+              << "  --model-id <ID>       请求中的模型ID（默认mock，回放真实录制时填录制时的模型ID）\n"
+              << "  --record <文件>       录制本次所有AI请求的结果\n"
+              << "  --replay <文件>       客户端回放录制（不发网络请求）\n"
+              << "  --mock-replay <文件>  模拟服务按请求回放录制（经HTTP，含录制的耗时与失败）\n"
+              << "  --replay-fast         回放时不等待录制的耗时\n"
+              << "  --serve               只运行模拟服务（配合 --port），标准输入关闭（Ctrl+D）时退出\n"
+              << "  --port <N>            --serve 时的监听端口（默认0，由系统分配）\n"
+              << "  -o, --output <文件>   批量结果输出（默认bench_results.jsonl）\n"
+              << "  --report-dir <目录>   每条另写一份报告（计入report阶段）\n"
+              << "  --format <格式>       报告格式：md / html / json / text（默认md）\n"
+              << "  --trace <文件>        写出各阶段统计与事件（JSON）\n"
+              << "  --chrome-trace <文件> 写出Chrome trace\n";
+}
+
+// 按重复次数展开语料，id追加 #轮次
+bool expand_corpus(const std::string& corpus, size_t repeat, const std::string& out_path, size_t& lines) {
+    std::ifstream fin(corpus.c_str());
+    if (!fin.is_open()) return false;
+    std::vector<std::string> rows;
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) rows.push_back(line);
+    }
+    std::ofstream fout(out_path.c_str(), std::ios::out | std::ios::trunc);
+    if (!fout.is_open()) return false;
+    for (size_t r = 0; r < repeat; ++r) {
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::string row = rows[i];
+            size_t id = row.find("\"id\"");
+            size_t q1 = id == std::string::npos ? id : row.find('"', row.find(':', id));
+            size_t q2 = q1 == std::string::npos ? q1 : row.find('"', q1 + 1);
+            if (q2 != std::string::npos) row.insert(q2, "#" + std::to_string(r));
+            fout << row << "\n";
+        }
+    }
+    lines = rows.size() * repeat;
+    return static_cast<bool>(fout);
+}
+
+// --serve：只运行模拟服务，供主程序用配置文件指向它做离线调试
+int run_serve(const MockServerOptions& mock) {
+    MockServer server(mock);
+    if (!server.start() || !server.replay_ok()) {
+        std::cerr << "[模拟服务] 启动失败（端口 " << mock.port << "）" << std::endl;
+        return 1;
+    }
+    std::cout << "[模拟服务] " << server.url() << "（标准输入关闭时退出）" << std::endl;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+    }
+    server.stop();
+    std::cout << "[模拟服务] 共处理 " << server.requests() << " 个请求（注入错误 " << server.injected_errors()
+              << " 次、限流 " << server.throttled() << " 次）" << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string corpus = "bench/corpus.jsonl";
+    std::string output = "bench_results.jsonl";
+    std::string trace_path, chrome_trace_path;
+    size_t concurrency = 4, repeat = 8;
+    MockServerOptions mock;
+    std::string report_dir;
+    ReportFormat report_format = ReportFormat::Markdown;
+    size_t model_count = 1;
+    bool hedge = true, serve = false;
+    std::string model_id = "mock";
+    std::string record_path, replay_path;
+    bool replay_timing = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--corpus" && has_value) {
+            corpus = argv[++i];
+        } else if ((arg == "-j" || arg == "--concurrency") && has_value) {
+            concurrency = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--repeat" && has_value) {
+            repeat = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--latency-ms" && has_value) {
+            mock.latency_ms = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--chunk-ms" && has_value) {
+            mock.chunk_interval_ms = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--jitter-ms" && has_value) {
+            mock.latency_jitter_ms = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--error-rate" && has_value) {
+            mock.error_rate = std::atof(argv[++i]);
+        } else if (arg == "--rate-limit" && has_value) {
+            mock.rate_limit_rate = std::atof(argv[++i]);
+        } else if (arg == "--retry-after" && has_value) {
+            mock.retry_after_s = std::max(0L, std::atol(argv[++i]));
+        } else if (arg == "--seed" && has_value) {
+            mock.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--models" && has_value) {
+            model_count = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--no-hedge") {
+            hedge = false;
+        } else if (arg == "--model-id" && has_value) {
+            model_id = argv[++i];
+        } else if (arg == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            replay_path = argv[++i];
+        } else if (arg == "--mock-replay" && has_value) {
+            mock.replay_path = argv[++i];
+        } else if (arg == "--replay-fast") {
+            replay_timing = false;
+        } else if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--port" && has_value) {
+            mock.port = std::atoi(argv[++i]);
+        } else if ((arg == "-o" || arg == "--output") && has_value) {
+            output = argv[++i];
+        } else if (arg == "--report-dir" && has_value) {
+            report_dir = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            if (!parse_report_format(argv[++i], report_format)) {
+                std::cerr << "未知报告格式：" << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace" && has_value) {
+            trace_path = argv[++i];
+        } else if (arg == "--chrome-trace" && has_value) {
+            chrome_trace_path = argv[++i];
+        } else {
+            std::cerr << "未知参数：" << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    mock.replay_timing = replay_timing;
+    if (serve) return run_serve(mock);
+
+    // 每个模型一个模拟服务，种子错开使各自的故障互不相关
+    std::vector<std::unique_ptr<MockServer> > servers;
+    for (size_t m = 0; m < model_count; ++m) {
+        MockServerOptions o = mock;
+        o.port = 0;
+        o.seed = mock.seed + static_cast<unsigned>(m) * 7919u;
+        servers.push_back(std::unique_ptr<MockServer>(new MockServer(o)));
+        if (!servers.back()->start() || !servers.back()->replay_ok()) {
+            std::cerr << "[基准测试] 模拟AI服务启动失败" << std::endl;
+            return 1;
+        }
+    }
+    std::string input = output + ".input";
+    size_t jobs = 0;
+    if (!expand_corpus(corpus, repeat, input, jobs)) {
+        std::cerr << "[基准测试] 无法读取语料或写入临时文件：" << corpus << std::endl;
+        return 1;
+    }
+
+    // 每条都走完整链路：不读缓存、不复用同形态回复，本地规则命中时仍调用AI；单模型时不对冲
+    Trace trace;
+    BatchOptions options;
+    options.input_path = input;
+    options.output_path = output;
+    options.concurrency = concurrency;
+    options.use_cache = false;
+    options.hedge = hedge && model_count > 1;
+    options.force_ai = true;
+    options.dedup = false;
+    for (size_t m = 0; m < servers.size(); ++m) {
+        AIModelConfig model;
+        model.name = model_count > 1 ? "mock-" + std::to_string(m + 1) : "mock";
+        model.url = servers[m]->url();
+        model.api_key = "bench";
+        model.model_id = model_id;
+        model.http2 = false;
+        options.models.push_back(model);
+    }
+    options.record_path = record_path;
+    options.replay_path = replay_path;
+    options.replay_timing = replay_timing;
+    options.trace = &trace;
+    options.report_dir = report_dir;
+    options.report_format = report_format;
+
+    std::cout << "[基准测试] 语料 " << corpus << "，共 " << jobs << " 条，并发 " << concurrency << "，模拟AI延迟 "
+              << mock.latency_ms << " ms";
+    if (mock.latency_jitter_ms > 0) std::cout << " + 0~" << mock.latency_jitter_ms << " ms";
+    std::cout << "，" << model_count << " 个模型（" << servers[0]->url() << (model_count > 1 ? " 等" : "") << "）";
+    if (mock.error_rate > 0 || mock.rate_limit_rate > 0) {
+        std::cout << "，注入错误 " << mock.error_rate << "、限流 " << mock.rate_limit_rate << "（seed " << mock.seed << "）";
+    }
+    if (!replay_path.empty()) std::cout << "，客户端回放 " << replay_path;
+    if (!mock.replay_path.empty()) std::cout << "，服务端回放 " << mock.replay_path;
+    std::cout << std::endl;
+    BatchSummary summary;
+    int rc = run_batch(options, &summary);
+    size_t requests = 0, injected = 0, throttled = 0;
+    for (size_t m = 0; m < servers.size(); ++m) {
+        servers[m]->stop();
+        requests += servers[m]->requests();
+        injected += servers[m]->injected_errors();
+        throttled += servers[m]->throttled();
+    }
+    std::remove(input.c_str());
+
+    std::cout << "\n吞吐：" << (summary.wall_ms > 0 ? summary.total * 1000.0 / summary.wall_ms : 0) << " 条/秒，"
+              << "AI请求 " << requests << " 次（注入错误 " << injected << " 次、限流 " << throttled << " 次），失败 "
+              << summary.errors << " 条\n\n"
+              << trace.summary() << std::endl;
+    if (!trace_path.empty() && !trace.write_json(trace_path)) {
+        std::cerr << "[基准测试] 无法写入：" << trace_path << std::endl;
+    }
+    if (!chrome_trace_path.empty() && !trace.write_chrome_json(chrome_trace_path)) {
+        std::cerr << "[基准测试] 无法写入：" << chrome_trace_path << std::endl;
+    }
+    // 注入故障时允许部分失败，只检查流程本身是否出错
+    bool injecting = mock.error_rate > 0 || mock.rate_limit_rate > 0;
+    return rc == 1 || (!injecting && summary.errors > 0) ? 1 : 0;
+}
@@ -84,7 +84,7 @@ set "target_name=%~1"
 
 call :print_info "编译动态链接版本（推荐）..."
 
-%CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread
+%CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp src\knowledge\knowledge_base.cpp src\server\analysis_server.cpp src\ai_engine\ai_recorder.cpp src\agent5_interactive\catalog_snapshot.cpp src\utils\sql_normalize.cpp src\agent2_diagnose\plan_diff.cpp src\utils\trace.cpp src\ai_engine\model_router.cpp src\ai_engine\conversation.cpp src\ai_engine\response_cache.cpp src\batch\batch_runner.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread -lws2_32
 
 if %errorlevel% equ 0 (
     call :print_success "动态链接编译成功！"
@@ -99,7 +99,7 @@ set "target_name=%~1"
 
 call :print_info "尝试静态链接编译（仅基本功能）..."
 
-%CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -static -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread
+%CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -static -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp src\knowledge\knowledge_base.cpp src\server\analysis_server.cpp src\ai_engine\ai_recorder.cpp src\agent5_interactive\catalog_snapshot.cpp src\utils\sql_normalize.cpp src\agent2_diagnose\plan_diff.cpp src\utils\trace.cpp src\ai_engine\model_router.cpp src\ai_engine\conversation.cpp src\ai_engine\response_cache.cpp src\batch\batch_runner.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread -lws2_32
 
 if %errorlevel% equ 0 (
     call :print_success "静态链接编译成功！"
@@ -86,6 +86,17 @@ compile_dynamic() {
         src/agent5_interactive/agent5_interactive.cpp \
         src/ai_engine/ai_engine.cpp \
         src/utils/utils.cpp \
+        src/knowledge/knowledge_base.cpp \
+        src/server/analysis_server.cpp \
+        src/ai_engine/ai_recorder.cpp \
+        src/agent5_interactive/catalog_snapshot.cpp \
+        src/utils/sql_normalize.cpp \
+        src/agent2_diagnose/plan_diff.cpp \
+        src/utils/trace.cpp \
+        src/ai_engine/model_router.cpp \
+        src/ai_engine/conversation.cpp \
+        src/ai_engine/response_cache.cpp \
+        src/batch/batch_runner.cpp \
         -lcurl -lssl -lcrypto -lz -ldl -lpthread
     
     if [[ $? -eq 0 ]]; then
@@ -113,6 +124,17 @@ compile_static_basic() {
         src/agent5_interactive/agent5_interactive.cpp \
         src/ai_engine/ai_engine.cpp \
         src/utils/utils.cpp \
+        src/knowledge/knowledge_base.cpp \
+        src/server/analysis_server.cpp \
+        src/ai_engine/ai_recorder.cpp \
+        src/agent5_interactive/catalog_snapshot.cpp \
+        src/utils/sql_normalize.cpp \
+        src/agent2_diagnose/plan_diff.cpp \
+        src/utils/trace.cpp \
+        src/ai_engine/model_router.cpp \
+        src/ai_engine/conversation.cpp \
+        src/ai_engine/response_cache.cpp \
+        src/batch/batch_runner.cpp \
         -lcurl -lssl -lcrypto -lz -ldl -lpthread 2>/dev/null
     
     if [[ $? -eq 0 ]]; then
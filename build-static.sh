@@ -113,6 +113,17 @@ compile_simple_static() {
         src/agent5_interactive/agent5_interactive.cpp \
         src/ai_engine/ai_engine.cpp \
         src/utils/utils.cpp \
+        src/knowledge/knowledge_base.cpp \
+        src/server/analysis_server.cpp \
+        src/ai_engine/ai_recorder.cpp \
+        src/agent5_interactive/catalog_snapshot.cpp \
+        src/utils/sql_normalize.cpp \
+        src/agent2_diagnose/plan_diff.cpp \
+        src/utils/trace.cpp \
+        src/ai_engine/model_router.cpp \
+        src/ai_engine/conversation.cpp \
+        src/ai_engine/response_cache.cpp \
+        src/batch/batch_runner.cpp \
         -lcurl -lssl -lcrypto -lz -ldl -lpthread -lresolv -lnsl -lrt 2>/dev/null
     
     if [[ $? -eq 0 ]]; then
@@ -139,6 +150,17 @@ compile_full_static() {
         src/agent5_interactive/agent5_interactive.cpp \
         src/ai_engine/ai_engine.cpp \
         src/utils/utils.cpp \
+        src/knowledge/knowledge_base.cpp \
+        src/server/analysis_server.cpp \
+        src/ai_engine/ai_recorder.cpp \
+        src/agent5_interactive/catalog_snapshot.cpp \
+        src/utils/sql_normalize.cpp \
+        src/agent2_diagnose/plan_diff.cpp \
+        src/utils/trace.cpp \
+        src/ai_engine/model_router.cpp \
+        src/ai_engine/conversation.cpp \
+        src/ai_engine/response_cache.cpp \
+        src/batch/batch_runner.cpp \
         -lcurl -lssl -lcrypto -lz -ldl -lpthread \
         -lgssapi_krb5 -lkrb5 -lk5crypto -lcom_err \
         -lpsl -lidn2 -lssh2 -lzstd -lbrotlidec -lbrotlicommon \
@@ -169,6 +191,17 @@ compile_dynamic() {
         src/agent5_interactive/agent5_interactive.cpp \
         src/ai_engine/ai_engine.cpp \
         src/utils/utils.cpp \
+        src/knowledge/knowledge_base.cpp \
+        src/server/analysis_server.cpp \
+        src/ai_engine/ai_recorder.cpp \
+        src/agent5_interactive/catalog_snapshot.cpp \
+        src/utils/sql_normalize.cpp \
+        src/agent2_diagnose/plan_diff.cpp \
+        src/utils/trace.cpp \
+        src/ai_engine/model_router.cpp \
+        src/ai_engine/conversation.cpp \
+        src/ai_engine/response_cache.cpp \
+        src/batch/batch_runner.cpp \
         -lcurl -lssl -lcrypto -lz -ldl -lpthread
     
     if [[ $? -eq 0 ]]; then
@@ -86,11 +86,11 @@ set "target_name=%~2"
 call :print_info "开始编译 %build_type% 版本..."
 
 if "%build_type%"=="dynamic" (
-    %CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread
+    %CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp src\knowledge\knowledge_base.cpp src\server\analysis_server.cpp src\ai_engine\ai_recorder.cpp src\agent5_interactive\catalog_snapshot.cpp src\utils\sql_normalize.cpp src\agent2_diagnose\plan_diff.cpp src\utils\trace.cpp src\ai_engine\model_router.cpp src\ai_engine\conversation.cpp src\ai_engine\response_cache.cpp src\batch\batch_runner.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread -lws2_32
 ) else if "%build_type%"=="static" (
-    %CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -static -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread
+    %CXX% -std=c++11 -Wall -Wextra -O2 -DNDEBUG -static -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp src\knowledge\knowledge_base.cpp src\server\analysis_server.cpp src\ai_engine\ai_recorder.cpp src\agent5_interactive\catalog_snapshot.cpp src\utils\sql_normalize.cpp src\agent2_diagnose\plan_diff.cpp src\utils\trace.cpp src\ai_engine\model_router.cpp src\ai_engine\conversation.cpp src\ai_engine\response_cache.cpp src\batch\batch_runner.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread -lws2_32
 ) else if "%build_type%"=="debug" (
-    %CXX% -std=c++11 -Wall -Wextra -g -DDEBUG -O0 -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread
+    %CXX% -std=c++11 -Wall -Wextra -g -DDEBUG -O0 -Iinclude -Ithird_party -o "%target_name%.exe" main.cpp src\agent1_input\agent1_input.cpp src\agent2_diagnose\agent2_diagnose.cpp src\agent3_strategy\agent3_strategy.cpp src\agent4_report\agent4_report.cpp src\agent5_interactive\agent5_interactive.cpp src\ai_engine\ai_engine.cpp src\utils\utils.cpp src\knowledge\knowledge_base.cpp src\server\analysis_server.cpp src\ai_engine\ai_recorder.cpp src\agent5_interactive\catalog_snapshot.cpp src\utils\sql_normalize.cpp src\agent2_diagnose\plan_diff.cpp src\utils\trace.cpp src\ai_engine\model_router.cpp src\ai_engine\conversation.cpp src\ai_engine\response_cache.cpp src\batch\batch_runner.cpp -lcurl -lssl -lcrypto -lz -ldl -lpthread -lws2_32
 ) else (
     call :print_error "未知的编译类型: %build_type%"
     exit /b 1
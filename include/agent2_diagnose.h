@@ -2,6 +2,76 @@
 #include <string>
 #include <vector>
 #include "agent1_input.h"
+#include "utils.h"
+
+// 算子类型（由operation文本归类，便于规则快速匹配）
+enum class OperatorKind {
+    Unknown,
+    SeqScan,        // Seq Scan / CStore Scan / Vector Seq Scan
+    IndexScan,      // Index Scan / Index Only Scan
+    BitmapScan,     // Bitmap Heap Scan / Bitmap Index Scan
+    HashJoin,
+    NestLoop,
+    MergeJoin,
+    Sort,
+    HashAgg,
+    SortAgg,        // Sort Aggregate / GroupAggregate
+    Agg,            // 普通Aggregate
+    Streaming,
+    Materialize,
+    Limit,
+    Append,
+    Other
+};
+
+// Streaming算子的数据流转类型
+enum class StreamKind {
+    None,
+    Gather,
+    Redistribute,
+    Broadcast,
+    LocalGather,
+    LocalRedistribute,
+    LocalBroadcast
+};
+
+// 执行计划节点（扁平存储，父子关系用下标表示）
+// operation/relation 为指向 InputData::explain_result 的视图，须保证原文本生命周期
+struct PlanNode {
+    int id;                     // 计划节点编号（GaussDB id列；PG格式按出现顺序编号）
+    int parent;                 // 父节点下标，根节点为-1
+    int first_child;            // 第一个子节点下标，无则为-1
+    int next_sibling;           // 下一个兄弟节点下标，无则为-1
+    int depth;                  // 缩进层级
+    Utils::StrRef operation;    // 算子描述，如 "Vector Hash Join (5,6)"
+    Utils::StrRef relation;     // 扫描的表名（如有）
+    OperatorKind kind;
+    StreamKind stream;
+    double a_time_ms;           // 实际耗时（多DN取最大值），-1表示未知
+    double a_time_min_ms;       // 多DN中的最小耗时，用于判断倾斜，-1表示未知
+    double self_time_ms;        // 自身耗时（扣除子节点），-1表示未知
+    double a_rows;              // 实际行数，-1表示未知
+    double e_rows;              // 估算行数，-1表示未知
+    int width;                  // 行宽（E-width，缺失时取A-width）
+    double peak_memory_kb;      // 峰值内存（KB，多DN取最大值）
+    int dop;                    // 并行度
+    bool spilled;               // 是否下盘
+    bool has_filter;            // 是否带过滤条件
+    Utils::StrRef filter;       // 过滤条件文本（Filter: 之后的首行）
+    double rows_removed;        // Rows Removed by Filter
+};
+
+// 解析后的执行计划树
+struct PlanTree {
+    std::vector<PlanNode> nodes;   // 按先序（出现顺序）存储，nodes[0]为根
+    double total_runtime_ms;       // Total runtime / Execution Time，未知为-1
+    bool analyzed;                 // 是否包含实际执行信息（A-time/A-rows）
+
+    PlanTree() : total_runtime_ms(-1), analyzed(false) {}
+
+    // 按计划id查找节点下标，未找到返回-1
+    int find(int id) const;
+};
 
 // 诊断报告结构体
 struct DiagnosticReport {
@@ -10,7 +80,22 @@ struct DiagnosticReport {
     std::vector<std::string> suggestions;  // 初步建议
     double performance_score;               // 性能评分 (0-100)
     std::string bottleneck_analysis;       // 瓶颈分析
+    PlanTree plan;                          // 解析后的执行计划
+    int hottest_node;                       // 自身耗时最高的节点下标，无则为-1
 };
 
-// 分析执行计划，生成诊断报告
+// 解析EXPLAIN(ANALYZE)/EXPLAIN PERFORMANCE文本（支持GaussDB表格格式与PG缩进格式）
+PlanTree parse_plan(const std::string& explain);
+
+// 计划形状指纹：只取算子类型、表名、数据流转类型与树结构，不含耗时/行数等数值
+uint64_t plan_fingerprint(const PlanTree& plan);
+
+// 压缩执行计划：只保留耗时热点、估算偏差、下盘与大广播节点及其祖先和直接子节点，
+// 其余子树折叠为"省略"行；用于超出token预算的大计划，max_nodes为保留节点数上限
+std::string compact_plan(const PlanTree& plan, size_t max_nodes);
+
+// 诊断已解析的执行计划（plan移入报告），便于分阶段计时
+DiagnosticReport diagnose_plan(PlanTree plan, const InputData& input);
+
+// 分析执行计划，生成诊断报告（parse_plan + diagnose_plan）
 DiagnosticReport analyze_plan(const InputData& input);
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <functional>
 #include "agent5_interactive.h"
 
 // 优化策略结构体
@@ -11,7 +12,36 @@ struct OptimizationStrategy {
     std::vector<std::string> param_hints;  // 参数调优建议
     double expected_improvement;           // 预期性能提升百分比
     std::string risk_assessment;           // 风险评估
+    bool from_rules;                       // 是否由本地规则得出（为true时可跳过AI调用）
 };
 
+// 规则命中结果
+struct RuleFinding {
+    std::string rule;                      // 规则名
+    int node;                              // 命中的计划节点下标，-1表示整体
+    std::string message;                   // 问题描述与处理建议
+    std::vector<std::string> index_hints;  // 索引建议
+    std::vector<std::string> param_hints;  // 参数/统计信息建议
+    double saved_ms;                       // 预计可节省的耗时（ms）
+};
+
+// 诊断规则：检查执行计划，把命中结果追加到findings
+typedef std::function<void(const PlanTree&, std::vector<RuleFinding>&)> PlanRule;
+
+// 注册自定义规则（内置规则已默认注册），应在启动阶段调用
+void register_rule(const std::string& name, const PlanRule& rule);
+
+// 依次执行所有已注册规则
+std::vector<RuleFinding> run_rules(const PlanTree& plan);
+
 // 根据增强的诊断报告生成优化策略
 OptimizationStrategy generate_strategy(const EnrichedDiagnosticReport& enriched);
+
+// 提示词模板版本（参与缓存key），修改build_ai_prompt模板时递增以使旧缓存失效
+const int kPromptTemplateVersion = 4;
+
+// 构造发给AI的分析提示词（含SQL、执行计划与本地预诊断结果）
+// plan_token_budget非0且原始计划估算token数超出时，改为发送 compact_plan 压缩后的计划
+// context非空时附加统计信息快照中的已知事实、知识库中的相似案例、用户补充信息与仍未掌握的信息
+std::string build_ai_prompt(const InputData& input, const DiagnosticReport& diag, size_t plan_token_budget = 0,
+                            const EnrichedDiagnosticReport* context = nullptr);
@@ -1,8 +1,88 @@
 #pragma once
 #include <string>
+#include <cstddef>
 #include "agent3_strategy.h"
 
-// 输出优化报告
+// 报告格式
+enum class ReportFormat {
+    Text,       // 终端纯文本
+    Markdown,
+    Html,       // 自包含HTML（内联样式，无外部资源）
+    Json
+};
+
+// 由名称解析格式：text / md / markdown / html / json，未识别返回false
+bool parse_report_format(const std::string& name, ReportFormat& format);
+
+// 格式对应的文件扩展名（不含点），如 "md"
+const char* report_extension(ReportFormat format);
+
+// 报告内容：strategy必填，其余可为nullptr（缺少diag时不输出执行计划树）
+// diag.plan 中的视图指向 input->explain_result，渲染期间须保证其有效
+struct ReportContent {
+    const OptimizationStrategy* strategy;
+    const DiagnosticReport* diag;
+    const InputData* input;
+    const std::string* ai_result;   // AI分析原文
+    std::string title;              // 报告标题，空则使用默认标题
+
+    ReportContent() : strategy(nullptr), diag(nullptr), input(nullptr), ai_result(nullptr) {}
+};
+
+// 报告输出：写入调用方预分配的缓冲区，写满时刷到文件描述符；不构造中间字符串
+// fd < 0 时缓冲区写满后截断（truncated()为true）；也可直接追加到std::string
+class ReportWriter {
+public:
+    ReportWriter(char* buffer, size_t capacity, int fd = -1);
+    explicit ReportWriter(std::string* out);
+    ~ReportWriter();
+
+    void write(const char* data, size_t n);
+    void write(const char* s);
+    void write(const std::string& s) { write(s.data(), s.size()); }
+    void write(Utils::StrRef s) { write(s.data, s.size); }
+    void put(char c);
+    void write_int(long long v);
+    void write_fixed(double v, int precision);
+
+    // 按格式转义后写入：Html转义 &<>"，Json转义引号/反斜杠/控制字符，Markdown转义表格分隔符与换行
+    void write_escaped(const char* data, size_t n, ReportFormat format);
+    void write_escaped(const std::string& s, ReportFormat format) { write_escaped(s.data(), s.size(), format); }
+    void write_escaped(Utils::StrRef s, ReportFormat format) { write_escaped(s.data, s.size, format); }
+
+    // 把缓冲区内容写到fd，失败返回false
+    bool flush();
+
+    // 已写入的总字节数（含已刷出的部分）
+    size_t bytes() const { return total_; }
+    bool truncated() const { return truncated_; }
+    bool failed() const { return failed_; }
+
+    // 缓冲区中尚未刷出的内容（fd < 0 时即完整报告）
+    const char* data() const { return buffer_; }
+    size_t size() const { return used_; }
+
+private:
+    ReportWriter(const ReportWriter&);
+    ReportWriter& operator=(const ReportWriter&);
+
+    char* buffer_;
+    size_t capacity_;
+    size_t used_;
+    int fd_;
+    std::string* out_;
+    size_t total_;
+    bool truncated_;
+    bool failed_;
+};
+
+// 渲染报告：策略、带标注的执行计划树（耗时热点高亮、估算偏差热力）、优化后SQL
+void render_report(const ReportContent& content, ReportFormat format, ReportWriter& writer);
+
+// 渲染并写入文件（每线程复用一块缓冲区），失败返回false
+bool write_report_file(const std::string& path, const ReportContent& content, ReportFormat format);
+
+// 输出优化报告（纯文本，标准输出）
 void output_report(const OptimizationStrategy& strategy);
 
 // 生成HTML格式的报告
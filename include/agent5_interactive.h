@@ -1,7 +1,10 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
 #include "agent2_diagnose.h"
+#include "catalog_snapshot.h"
+#include "sql_normalize.h"
 
 // 增强的诊断报告（包含用户交互信息）
 struct EnrichedDiagnosticReport {
@@ -10,13 +13,29 @@ struct EnrichedDiagnosticReport {
     std::vector<std::string> questions;    // 向用户提出的问题
     std::vector<std::string> answers;      // 用户的回答
     bool needs_more_info;                  // 是否需要更多信息
+    std::vector<std::string> known_facts;       // 从统计信息快照与执行计划中已掌握的事实（写入提示词，无需再问）
+    std::vector<IndexInfo> existing_indexes;    // SQL引用的表上已有的索引（来自快照）
+    std::vector<std::string> similar_cases;     // 知识库中相似的已解决案例（精简文本，作为few-shot上下文）
+
+    EnrichedDiagnosticReport() : needs_more_info(false) {}
 };
 
-// 判断是否需要用户交互
-bool need_user_interaction(const DiagnosticReport& report);
+// 用SQL引用的表、列与谓词关联统计信息快照，预先补全表行数、列统计、索引与相关GUC；
+// 只把快照和执行计划都回答不了、且与诊断出的问题相关的事实列为问题。catalog可为nullptr
+EnrichedDiagnosticReport collect_context(const DiagnosticReport& report, const Utils::SqlShape& shape,
+                                         const CatalogSnapshot* catalog);
+
+// 判断是否需要用户交互（仍有未知事实）
+bool need_user_interaction(const EnrichedDiagnosticReport& enriched);
 
-// 根据诊断报告生成问题
-std::string generate_question(const DiagnosticReport& report);
+// 把待确认的事实整理为提问文本，无问题时返回空串
+std::string generate_question(const EnrichedDiagnosticReport& enriched);
 
 // 用用户回答丰富诊断报告
 EnrichedDiagnosticReport enrich_report(const DiagnosticReport& report, const std::string& user_answer);
+
+// 记录用户对问题的回答，并清除待确认状态
+void add_user_answer(EnrichedDiagnosticReport& enriched, const std::string& answer);
+
+// 补充上下文（已知事实、相似案例与用户回答）的指纹，以计划指纹为seed串联，作为缓存key的一部分
+uint64_t context_fingerprint(const EnrichedDiagnosticReport& enriched, uint64_t seed);
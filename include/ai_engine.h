@@ -1,6 +1,12 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+
+class ResponseCache;
+class AIRecorder;
 
 // AI模型配置结构体
 struct AIModelConfig {
@@ -8,10 +14,106 @@ struct AIModelConfig {
     std::string url;       // API端点URL
     std::string api_key;   // API密钥
     std::string model_id;  // 模型ID
+
+    // 连接参数（可选，见 config/ai_models.json）
+    long timeout_ms;          // 单次请求超时，0为不限
+    long connect_timeout_ms;  // 建连超时
+    long dns_cache_seconds;   // DNS缓存时间
+    bool keep_alive;          // 启用TCP keep-alive并复用连接
+    bool http2;               // 服务端支持时使用HTTP/2
+
+    // 上下文预算（可选，单位为估算token）
+    size_t context_tokens;    // 模型上下文窗口，执行计划最多占用一半，超出时压缩
+    size_t history_tokens;    // 多轮对话历史预算，超出后较早的轮次合并为摘要
+
+    AIModelConfig() : timeout_ms(0), connect_timeout_ms(10000), dns_cache_seconds(300),
+                      keep_alive(true), http2(true), context_tokens(32000), history_tokens(8000) {}
+};
+
+// 对话消息（OpenAI messages格式）
+struct ChatMessage {
+    std::string role;      // system / user / assistant
+    std::string content;
+
+    ChatMessage() {}
+    ChatMessage(const std::string& r, const std::string& c) : role(r), content(c) {}
+};
+
+// 默认的系统提示词
+extern const char* const kAISystemPrompt;
+
+// 流式输出回调：每收到一段增量文本调用一次（在curl回调线程中同步执行）
+typedef std::function<void(const std::string& delta)> TokenSink;
+
+// 单次AI调用的耗时统计
+struct AICallStats {
+    double first_token_ms;   // 首个token到达耗时（TTFT），未收到为-1
+    double total_ms;         // 总耗时
+    size_t chunks;           // 收到的增量片段数
+    double connect_ms;       // TCP建连耗时（复用连接时为0）
+    double tls_ms;           // TLS握手耗时（复用连接或http时为0）
+    bool reused_connection;  // 是否复用了已有连接
+    bool cache_hit;          // 是否命中回复缓存
+    long http_status;        // HTTP状态码，未收到响应为0
+    long retry_after_s;      // 服务端Retry-After（秒），无则为0
+
+    AICallStats() : first_token_ms(-1), total_ms(0), chunks(0), connect_ms(0), tls_ms(0),
+                    reused_connection(false), cache_hit(false), http_status(0), retry_after_s(0) {}
 };
 
+// AI客户端：按端点复用curl句柄与连接，共享DNS缓存与TLS会话
+// 非线程安全，多线程时每个线程使用独立的AIClient
+class AIClient {
+public:
+    AIClient();
+    ~AIClient();
+
+    // 设置回复缓存（不转移所有权），为nullptr时关闭缓存
+    void set_cache(ResponseCache* cache);
+
+    // 设置取消标志（不转移所有权）：请求进行中标志被置位时尽快中止，用于对冲请求
+    void set_cancel_flag(const std::atomic<bool>* cancel);
+
+    // 设置录制/回放（不转移所有权）：录制模式记录每次请求的结果，回放模式不访问网络，为nullptr时关闭
+    void set_recorder(AIRecorder* recorder);
+
+    // 非流式调用；cache_key非0时先查缓存，成功的回复写回缓存（见 make_cache_key）
+    std::string call(const std::string& prompt, const AIModelConfig& model, AICallStats* stats = nullptr,
+                     uint64_t cache_key = 0);
+    std::string call(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                     AICallStats* stats = nullptr, uint64_t cache_key = 0);
+
+    // 流式调用（SSE），增量文本推送给sink，返回完整回复；命中缓存时整段推送一次
+    std::string call_stream(const std::string& prompt, const AIModelConfig& model,
+                            const TokenSink& sink, AICallStats* stats = nullptr, uint64_t cache_key = 0);
+    std::string call_stream(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                            const TokenSink& sink, AICallStats* stats = nullptr, uint64_t cache_key = 0);
+
+private:
+    AIClient(const AIClient&);
+    AIClient& operator=(const AIClient&);
+
+    // 实际发出网络请求（不经缓存与录制）
+    std::string fetch(const std::vector<ChatMessage>& messages, const AIModelConfig& model, AICallStats* stats);
+    std::string fetch_stream(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                             const TokenSink& sink, AICallStats* stats);
+
+    struct Impl;
+    Impl* impl_;
+    ResponseCache* cache_;
+    const std::atomic<bool>* cancel_;
+    AIRecorder* recorder_;
+};
+
+// 是否为失败的回复（调用失败、HTTP错误或解析失败时返回以"[AI"开头的错误信息）
+bool ai_reply_failed(const std::string& reply);
+
 // 加载AI配置文件
 bool load_ai_config(const std::string& path, std::vector<AIModelConfig>& models);
 
-// 调用AI接口
+// 调用AI接口（使用当前线程的默认AIClient，连接在多次调用间复用）
 std::string call_ai(const std::string& prompt, const AIModelConfig& model);
+
+// 流式调用AI接口（SSE）：边接收边解析 data: 片段并推送给sink，返回完整回复
+std::string call_ai_stream(const std::string& prompt, const AIModelConfig& model,
+                           const TokenSink& sink, AICallStats* stats = nullptr);
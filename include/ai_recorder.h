@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "ai_engine.h"
+
+// 录制/回放模式
+enum class RecordMode {
+    Record,     // 真实调用AI，并把请求与回复追加写入录制文件
+    Replay      // 不访问网络，按请求从录制文件中取回复
+};
+
+// 一次录制的AI回复
+struct RecordedReply {
+    std::string reply;          // 回复文本（失败时为"[AI"开头的错误信息）
+    long http_status;           // HTTP状态码，未收到响应为0
+    long retry_after_s;         // 服务端Retry-After（秒）
+    double first_token_ms;      // 首字耗时，非流式或未收到为-1
+    double total_ms;            // 总耗时
+    size_t chunks;              // 流式增量片段数，非流式为0
+
+    RecordedReply() : http_status(0), retry_after_s(0), first_token_ms(-1), total_ms(0), chunks(0) {}
+};
+
+// AI调用录制与回放：录制文件为定长头 + 回复文本并按8字节对齐，追加写入
+// 回放时同一请求的多条录制按录制顺序依次返回（取完后从头循环），可按录制的耗时等待以复现延迟
+// 线程安全，可在路由器的多个请求线程间共享
+class AIRecorder {
+public:
+    // Replay模式在构造时读入整个录制文件；replay_timing为false时回放不等待
+    AIRecorder(const std::string& path, RecordMode mode, bool replay_timing = true);
+    ~AIRecorder();
+
+    // 录制文件是否可用（Record模式能否写入，Replay模式能否读取）
+    bool ok() const;
+    RecordMode mode() const;
+    bool replay_timing() const;
+
+    // 追加一条录制（Record模式）
+    void record(uint64_t key, const RecordedReply& reply);
+
+    // 取一条录制（Replay模式），没有该请求的录制时返回false
+    bool replay(uint64_t key, RecordedReply& reply);
+
+    // 录制文件中的记录数（Record模式为本次写入数）
+    size_t size() const;
+    // 回放时未找到录制的请求数
+    size_t misses() const;
+
+    // 统计信息的单行文本
+    std::string stats_line() const;
+
+private:
+    AIRecorder(const AIRecorder&);
+    AIRecorder& operator=(const AIRecorder&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 录制key：模型ID + 全部消息（不含URL、API密钥与是否流式，流式与非流式请求可互相回放）
+uint64_t make_record_key(const std::string& model_id, const std::vector<ChatMessage>& messages);
+
+// 把回复切成n段用于流式推送，不切断UTF-8多字节字符
+std::vector<std::string> split_reply_chunks(const std::string& reply, size_t n);
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+class AnalysisEngine;
+
+// 服务模式参数
+struct ServerOptions {
+    std::string socket_path;   // Unix域套接字路径，为空时不监听（Windows不支持）
+    int port;                  // 127.0.0.1上的TCP端口，-1为不监听，0由系统分配
+    size_t workers;            // 工作线程数
+    size_t queue_capacity;     // 等待队列容量，满时NDJSON连接阻塞读取、HTTP请求返回503
+
+    ServerOptions() : port(-1), workers(4), queue_capacity(64) {}
+};
+
+// 服务运行统计
+struct ServerStats {
+    size_t accepted;     // 入队的任务数
+    size_t completed;    // 完成的任务数
+    size_t failed;       // 其中失败的任务数
+    size_t rejected;     // 队列满被拒绝的HTTP请求数
+    size_t dropped;      // 客户端已断开而跳过的任务数
+    size_t queued;       // 当前排队数
+    size_t running;      // 当前执行数
+    size_t connections;  // 当前连接数
+
+    ServerStats() : accepted(0), completed(0), failed(0), rejected(0), dropped(0), queued(0), running(0), connections(0) {}
+};
+
+// 常驻分析服务：在Unix套接字和/或TCP端口上接收JSON任务，进入有界队列由工作线程池处理，
+// 进度与结果按行推回客户端。同一连接上的两种协议按首行区分：
+//   NDJSON：每行一个任务 {"id","sql","explain","options":{"stream","use_ai","force_ai"}}，
+//           事件 queued/started/stage/token/result 每行一个，按id区分；{"cmd":"stats"} 查询统计
+//   HTTP：POST /analyze（请求体为一个任务）以分块传输逐行返回事件；GET /health 返回统计
+// 所有连接共享同一个AnalysisEngine，连接、缓存与模型统计在请求间保持
+class AnalysisServer {
+public:
+    AnalysisServer(AnalysisEngine& engine, const ServerOptions& options);
+    ~AnalysisServer();
+
+    // 开始监听并启动工作线程，失败时写入error
+    bool start(std::string* error = nullptr);
+    // 停止接收新连接，处理完已入队的任务后返回
+    void stop();
+
+    // 实际监听的TCP端口，未监听为-1
+    int port() const;
+    ServerStats stats() const;
+    // 统计信息的单行文本
+    std::string stats_line() const;
+
+private:
+    AnalysisServer(const AnalysisServer&);
+    AnalysisServer& operator=(const AnalysisServer&);
+
+    struct Impl;
+    Impl* impl_;
+};
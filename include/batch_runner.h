@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "response_cache.h"
+#include "ai_engine.h"
+#include "agent4_report.h"
+
+class Trace;
+class CatalogSnapshot;
+class KnowledgeBase;
+
+// 批量（无交互）分析选项
+struct BatchOptions {
+    std::string input_path;    // JSONL文件，或包含 xxx.sql + xxx.explain 成对文件的目录
+    std::string output_path;   // 结果JSONL路径，为空时写到标准输出
+    std::string config_path;   // AI模型配置文件
+    size_t concurrency;        // 并发工作线程数
+    bool use_ai;               // 本地规则无可执行建议时是否调用AI
+    bool use_cache;            // 是否启用AI回复缓存
+    CacheOptions cache;        // 缓存配置
+    bool hedge;                // 配置多个模型时是否发出对冲请求
+    std::vector<AIModelConfig> models;  // 非空时直接使用，不读取config_path（基准测试用）
+    bool force_ai;             // 本地规则已给出建议时仍调用AI（基准测试用）
+    bool dedup;                // 同形态SQL（规范化后相同）且计划相同的任务只调用一次AI
+    Trace* trace;              // 非空时记录各阶段耗时（不转移所有权）
+    std::string report_dir;    // 非空时每条输入另写一份报告到该目录（文件名为id）
+    ReportFormat report_format;
+    const CatalogSnapshot* catalog;  // 统计信息快照（可为空，不转移所有权），用于补全表/列统计、索引与GUC
+    std::string record_path;   // 非空时把每次AI请求的结果录制到该文件
+    std::string replay_path;   // 非空时不访问网络，从该录制文件回放AI回复（优先于record_path）
+    bool replay_timing;        // 回放时按录制的耗时等待
+    KnowledgeBase* knowledge;  // 历史优化知识库（可为空，不转移所有权）：查相似案例，实测有效的方案写回
+
+    BatchOptions() : config_path("config/ai_models.json"), concurrency(4), use_ai(true), use_cache(true),
+                     hedge(true), force_ai(false), dedup(true), trace(nullptr),
+                     report_format(ReportFormat::Markdown), catalog(nullptr), replay_timing(true),
+                     knowledge(nullptr) {}
+};
+
+// 批量分析汇总
+struct BatchSummary {
+    size_t total;        // 输入条数
+    size_t local_only;   // 本地规则直接给出建议的条数
+    size_t knowledge_hits;  // 沿用知识库中同形态查询已验证方案的条数
+    size_t ai_calls;     // 调用AI的条数（含命中缓存）
+    size_t cache_hits;   // 命中缓存的条数
+    size_t deduplicated; // 复用同形态查询AI回复的条数
+    size_t shapes;       // 不同SQL形态（指纹）数
+    size_t errors;       // 失败条数
+    double wall_ms;      // 总耗时
+
+    BatchSummary() : total(0), local_only(0), knowledge_hits(0), ai_calls(0), cache_hits(0), deduplicated(0), shapes(0), errors(0), wall_ms(0) {}
+};
+
+// 单条分析任务（批量输入的一行/一对文件，或服务模式收到的一个请求）
+struct BatchJob {
+    size_t index;          // 输入序号（从0开始）
+    std::string id;        // 输入中的id，缺省为序号
+    InputData input;
+    std::string explain_after;  // 优化后的执行计划（可选），有则附加计划对比
+    std::string applied_strategy;  // 实际采用的优化方案（可选），与explain_after一起才写入知识库
+    std::string applied_sql;       // 实际执行的优化后SQL（可选）
+    std::string error;     // 读取阶段的错误（如JSON格式错误）
+    bool use_ai;           // 请求中的 options.use_ai，为false时只用本地规则
+    bool force_ai;         // 请求中的 options.force_ai，本地规则已给出建议时仍调用AI
+
+    BatchJob() : index(0), use_ai(true), force_ai(false) {}
+};
+
+// 单条任务的处理结果统计
+struct JobOutcome {
+    bool used_ai;
+    bool cache_hit;
+    bool deduplicated;     // 复用了同形态查询的AI回复
+    bool from_knowledge;   // 沿用了知识库中的已验证方案
+    bool failed;
+    uint64_t fingerprint;  // SQL形态指纹，输入无效时为0
+
+    JobOutcome() : used_ai(false), cache_hit(false), deduplicated(false), from_knowledge(false), failed(false),
+                   fingerprint(0) {}
+};
+
+// 单条任务的进度回调（在工作线程中同步调用）
+struct JobProgress {
+    std::function<void(const std::string& stage)> stage;   // 进入阶段时调用：plan_parse/diagnose/rules/ai/report
+    TokenSink tokens;      // 非空时AI以流式调用，增量文本推送给它
+};
+
+// 分析引擎：持有模型路由器、AI回复缓存、录制/回放与同形态去重，批量模式与服务模式共用。
+// 连接、缓存与模型统计在多次analyze间保持；线程安全
+class AnalysisEngine {
+public:
+    explicit AnalysisEngine(const BatchOptions& options);
+    ~AnalysisEngine();
+
+    // 创建路由器、缓存与录制；录制文件不可用时返回false。AI配置加载失败不算错误，has_ai()为false
+    bool init(std::string* error = nullptr);
+    bool has_ai() const;
+
+    // 分析一条任务，返回单行结果JSON；progress可为nullptr
+    std::string analyze(const BatchJob& job, JobOutcome& outcome, const JobProgress* progress = nullptr);
+
+    // 模型、录制与缓存统计，每项一行并加上前缀
+    std::string stats_lines(const std::string& prefix) const;
+
+private:
+    AnalysisEngine(const AnalysisEngine&);
+    AnalysisEngine& operator=(const AnalysisEngine&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 解析一条JSON任务：{"id", "sql", "explain", "explain_after", "strategy", "applied_sql",
+//                    "options": {"use_ai", "force_ai"}}
+BatchJob parse_batch_job(const std::string& line, size_t index);
+
+// 运行批量分析：每条输入输出一行JSON结果（按完成顺序，含输入序号index），成功返回0
+int run_batch(const BatchOptions& options, BatchSummary* summary = nullptr);
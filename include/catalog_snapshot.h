@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// 列统计信息（对应pg_stats一行）
+struct ColumnStats {
+    std::string name;
+    double null_frac;       // 空值比例，未知为-1
+    double n_distinct;      // 不同值个数；负数表示占行数的比例；0表示未知（与pg_stats一致）
+    int avg_width;          // 平均宽度（字节），未知为-1
+    double correlation;     // 物理顺序相关性（-1~1），未知为-2
+    double top_freq;        // 最高频值的占比（most_common_freqs首项），未知为-1
+
+    ColumnStats() : null_frac(-1), n_distinct(0), avg_width(-1), correlation(-2), top_freq(-1) {}
+};
+
+// 索引定义（由pg_indexes.indexdef解析）
+struct IndexInfo {
+    std::string name;
+    std::string table;                  // 表名（小写，可能带schema）
+    std::vector<std::string> columns;   // 索引列；表达式列保留原文，如 "lower(name)"
+    bool unique;
+    std::string definition;             // 原始DDL
+
+    IndexInfo() : unique(false) {}
+};
+
+// 表统计信息（pg_class / pg_stat_user_tables / pg_stats / pg_indexes 按表汇总）
+struct TableStats {
+    std::string name;                   // schema.table 或 table（小写）
+    double reltuples;                   // 行数估算，未知为-1
+    double relpages;                    // 页数，未知为-1
+    std::string last_analyze;           // 最近一次ANALYZE时间（手动与自动取较晚者），未知为空
+    bool analyze_known;                 // 快照中包含ANALYZE时间列（为true且last_analyze为空表示从未ANALYZE）
+    std::vector<ColumnStats> columns;
+    std::vector<IndexInfo> indexes;
+    bool indexes_known;                 // 快照中包含索引定义（为true且indexes为空表示无索引）
+
+    TableStats() : reltuples(-1), relpages(-1), analyze_known(false), indexes_known(false) {}
+
+    // 按列名查找（大小写不敏感），未找到返回nullptr
+    const ColumnStats* find_column(const std::string& column) const;
+};
+
+// 统计信息快照：离线导出的系统表内容，加载后按表名索引在内存中
+// 支持JSON（任意键下的对象数组，按字段识别是哪张系统表；或 {"gucs": {"work_mem": "64MB"}}）
+// 与带表头的CSV（每个文件一张系统表），可多次load合并多个文件
+class CatalogSnapshot {
+public:
+    CatalogSnapshot();
+    ~CatalogSnapshot();
+
+    // 加载一个JSON/CSV文件（按首个非空白字符判断格式），失败时error中给出原因
+    bool load(const std::string& path, std::string* error = nullptr);
+
+    // 从文本加载，format_hint为"json"或"csv"，为空时按内容判断
+    bool load_text(const std::string& text, const std::string& format_hint = "", std::string* error = nullptr);
+
+    // 按表名查找（大小写不敏感）；未带schema时匹配任意schema下唯一的同名表，未找到返回nullptr
+    const TableStats* find_table(const std::string& name) const;
+
+    // 查找GUC参数值（如 work_mem、query_dop），未找到返回false
+    bool find_guc(const std::string& name, std::string& value) const;
+
+    size_t table_count() const;
+    size_t guc_count() const;
+    bool empty() const { return table_count() == 0 && guc_count() == 0; }
+
+private:
+    CatalogSnapshot(const CatalogSnapshot&);
+    CatalogSnapshot& operator=(const CatalogSnapshot&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 解析 CREATE [UNIQUE] INDEX 语句（pg_indexes.indexdef 或本地规则生成的索引建议），失败返回false
+bool parse_index_definition(const std::string& ddl, IndexInfo& out);
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include "ai_engine.h"
+
+// 历史摘要函数：把较早的若干条消息压缩为一段摘要文本
+typedef std::function<std::string(const std::vector<ChatMessage>& turns)> TurnSummarizer;
+
+// 默认摘要：保留用户问题的开头与AI回复的标题/要点行（本地抽取，不调用AI）
+std::string summarize_turns(const std::vector<ChatMessage>& turns);
+
+// 多轮会诊上下文：系统提示 + 固定的首条用户消息（SQL、计划与预诊断）+ 最近的问答
+// 历史（不含首条消息）超过预算时，把最早的一问一答合并进摘要，摘要附在首条消息之后
+class Conversation {
+public:
+    Conversation(const std::string& system_prompt, size_t history_budget_tokens);
+
+    // 设置首条用户消息，始终完整发送
+    void set_context(const std::string& content);
+
+    void add_user(const std::string& content);
+    void add_assistant(const std::string& content);
+
+    // 替换默认摘要函数
+    void set_summarizer(const TurnSummarizer& summarizer);
+
+    // 本轮要发送的消息数组
+    std::vector<ChatMessage> messages() const;
+
+    // 当前消息的估算token数
+    size_t estimated_tokens() const;
+
+    // 已合并进摘要的消息条数
+    size_t summarized_messages() const { return summarized_; }
+
+private:
+    void compact();
+
+    std::string system_prompt_;
+    std::string context_;
+    std::string summary_;
+    std::vector<ChatMessage> history_;   // 首条消息之后的问答，assistant/user交替
+    size_t budget_;
+    size_t summarized_;
+    TurnSummarizer summarizer_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "agent2_diagnose.h"
+#include "sql_normalize.h"
+
+// MinHash签名长度（分为kLshBands段做LSH分桶，每段kMinHashSize/kLshBands个值）
+const size_t kMinHashSize = 32;
+const size_t kLshBands = 8;
+
+// 实测加速比达到该值才算"已解决"的案例，才会写入知识库
+const double kMinCaseSpeedup = 1.2;
+
+// 案例特征：SQL形态指纹、计划形状签名与MinHash（计划算子n-gram + 引用的表）
+struct CaseFeatures {
+    uint64_t sql_fingerprint;
+    uint64_t plan_signature;
+    uint32_t minhash[kMinHashSize];
+
+    CaseFeatures();
+};
+
+// 从执行计划与SQL形态提取特征：算子（含数据流转类型）的父子一元/二元/三元组、算子+表名、引用的表
+CaseFeatures make_case_features(const PlanTree& plan, const Utils::SqlShape& shape);
+
+// 两个签名的Jaccard相似度估计（相同的MinHash值占比）
+double estimate_similarity(const CaseFeatures& a, const CaseFeatures& b);
+
+// 一条已解决的优化案例
+struct KnowledgeCase {
+    CaseFeatures features;
+    double speedup;                     // 实测加速比（优化前/优化后耗时）
+    int64_t created;                    // 记录时间（Unix秒）
+    std::vector<std::string> tables;
+    std::vector<std::string> issues;    // 诊断出的问题
+    std::string strategy;               // 采用的优化方案（AI回复或本地规则建议）
+    std::string optimized_sql;
+    std::string sql;                    // 规范化后的SQL
+
+    KnowledgeCase() : speedup(0), created(0) {}
+};
+
+// 由一次会诊的结果组装案例
+KnowledgeCase make_knowledge_case(const CaseFeatures& features, const Utils::SqlShape& shape,
+                                  const DiagnosticReport& diag, const std::string& strategy,
+                                  const std::string& optimized_sql, double speedup);
+
+// 相似案例查询结果
+struct SimilarCase {
+    KnowledgeCase record;
+    double similarity;          // MinHash估计的Jaccard相似度（0~1）
+    bool same_query;            // SQL形态指纹相同（同一查询换参数）
+
+    SimilarCase() : similarity(0), same_query(false) {}
+};
+
+// 历史优化知识库：追加写入的案例文件，打开时内存映射并建立LSH分桶索引；
+// 查询只比对与输入在任一分段上相同的候选，同一SQL形态的案例总会参与比较。线程安全
+class KnowledgeBase {
+public:
+    // 文件不存在时为空库，首次add时创建（含目录）
+    explicit KnowledgeBase(const std::string& path);
+    ~KnowledgeBase();
+
+    // 文件存在但无法映射时为false
+    bool ok() const;
+    const std::string& path() const;
+
+    // 追加一条案例，写入失败返回false
+    bool add(const KnowledgeCase& record);
+
+    // 按相似度降序返回最多k条（相似度低于min_similarity且不是同一查询的不返回）；
+    // 同一查询+计划形状的多条记录只保留加速比最高的一条
+    std::vector<SimilarCase> find_similar(const CaseFeatures& features, size_t k, double min_similarity = 0.3) const;
+
+    size_t size() const;
+    // 统计信息的单行文本
+    std::string stats_line() const;
+
+private:
+    KnowledgeBase(const KnowledgeBase&);
+    KnowledgeBase& operator=(const KnowledgeBase&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 相似案例可直接作为本地答案：同一SQL形态、计划高度相似且实测有效
+bool can_answer_locally(const SimilarCase& c);
+
+// 精简为一段few-shot文本（问题、方案摘要与实测效果），方案超过max_chars时截断
+std::string format_case_brief(const SimilarCase& c, size_t max_chars);
+
+// 作为本地答案输出的完整文本
+std::string format_case_answer(const SimilarCase& c);
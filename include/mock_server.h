@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// 本地模拟的OpenAI兼容接口（/v1/chat/completions），用于基准测试与离线调试
+struct MockServerOptions {
+    int port;                  // 监听端口，0表示由系统分配
+    int latency_ms;            // 收到请求到返回第一个字节的延迟（流式即首字延迟）
+    int chunk_interval_ms;     // 流式回复相邻两个分片的间隔
+    size_t chunks;             // 流式回复的分片数
+    std::string reply;         // 回复内容（流式时按分片数切开）
+
+    // 故障注入：按请求序号与seed确定，同一seed下可复现
+    int latency_jitter_ms;     // 首字延迟额外增加 [0, jitter) 的随机值
+    double error_rate;         // 返回HTTP 500的比例（0~1）
+    double rate_limit_rate;    // 返回HTTP 429的比例（0~1）
+    long retry_after_s;        // 429响应的Retry-After（秒）
+    unsigned seed;
+
+    // 非空时按请求（模型ID + 消息）回放录制文件中的回复与耗时，未录制的请求返回404
+    std::string replay_path;
+    bool replay_timing;        // 回放时按录制的耗时发送
+
+    MockServerOptions() : port(0), latency_ms(300), chunk_interval_ms(20), chunks(8),
+                          reply("【模拟回复】建议先更新统计信息，再检查关联条件上的索引。"),
+                          latency_jitter_ms(0), error_rate(0), rate_limit_rate(0), retry_after_s(1), seed(1),
+                          replay_timing(true) {}
+};
+
+// 只监听127.0.0.1；每个连接一个线程，支持HTTP/1.1长连接、流式（SSE）与非流式回复，
+// 可注入延迟抖动、HTTP 500与429限流，或回放 --record 录制的真实回复
+class MockServer {
+public:
+    explicit MockServer(const MockServerOptions& options = MockServerOptions());
+    ~MockServer();
+
+    // 开始监听，失败返回false
+    bool start();
+    // 关闭监听并等待所有连接线程退出
+    void stop();
+
+    int port() const;
+    // 完整接口地址，如 http://127.0.0.1:12345/v1/chat/completions
+    std::string url() const;
+    // 已处理的请求数
+    size_t requests() const;
+    // 注入的HTTP 500数与429数
+    size_t injected_errors() const;
+    size_t throttled() const;
+    // 回放文件是否可读（未设置replay_path时为true）
+    bool replay_ok() const;
+
+private:
+    MockServer(const MockServer&);
+    MockServer& operator=(const MockServer&);
+
+    struct Impl;
+    Impl* impl_;
+};
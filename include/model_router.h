@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ai_engine.h"
+
+// 路由参数（可在 config/ai_models.json 的 "routing" 中配置）
+struct RouterOptions {
+    bool hedge;                 // 主模型迟迟未响应时，是否向下一个模型发出对冲请求
+    double hedge_default_ms;    // 样本不足时的对冲等待时间
+    double hedge_min_ms;        // 对冲等待时间下限
+    double hedge_max_ms;        // 对冲等待时间上限
+    int max_attempts;           // 出错/限流时最多尝试的请求数（含对冲）
+    double backoff_base_ms;     // 限流退避的基准时间，逐次翻倍
+    double backoff_max_ms;      // 单次退避上限
+    double ewma_alpha;          // 延迟/错误率EWMA的平滑系数
+
+    RouterOptions() : hedge(true), hedge_default_ms(4000), hedge_min_ms(500), hedge_max_ms(20000),
+                      max_attempts(3), backoff_base_ms(500), backoff_max_ms(8000), ewma_alpha(0.2) {}
+};
+
+// 单个模型的健康度
+struct ModelHealth {
+    std::string name;
+    double latency_ewma_ms;     // 响应延迟EWMA（流式为首字延迟），无样本为-1
+    double error_ewma;          // 错误率EWMA（0~1）
+    double p95_ms;              // 最近样本的p95延迟，样本不足为-1
+    size_t calls;               // 完成的请求数（不含被取消的对冲请求）
+    size_t errors;              // 失败数
+    size_t throttled;           // 被限流（HTTP 429）次数
+    size_t hedge_wins;          // 作为对冲请求胜出的次数
+    bool cooling;               // 是否处于限流退避期
+};
+
+// 单次路由结果
+struct RouteInfo {
+    std::string model;          // 最终给出回复的模型名
+    int attempts;               // 发出的请求数
+    bool hedged;                // 是否发出了对冲请求
+    bool failed_over;           // 是否因出错/限流切换过模型
+
+    RouteInfo() : attempts(0), hedged(false), failed_over(false) {}
+};
+
+// 多模型路由：按延迟与错误率EWMA选主模型；主模型超过其p95延迟仍未响应时向下一个模型
+// 发出对冲请求，取先完成者（流式取先出首字者）并取消另一个；出错或429时退避并切换模型。
+// 线程安全，批量模式的多个工作线程可共享一个路由器
+class ModelRouter {
+public:
+    explicit ModelRouter(const std::vector<AIModelConfig>& models, const RouterOptions& options = RouterOptions());
+    ~ModelRouter();
+
+    // 设置回复缓存（不转移所有权），在路由层统一查找与写入
+    void set_cache(ResponseCache* cache);
+
+    // 设置录制/回放（不转移所有权），对每个模型的请求生效；回放时限流与失败按录制复现
+    void set_recorder(AIRecorder* recorder);
+
+    std::string call(const std::vector<ChatMessage>& messages, AICallStats* stats = nullptr,
+                     uint64_t cache_key = 0, RouteInfo* route = nullptr);
+
+    // 流式调用：只有胜出的请求会推送给sink
+    std::string call_stream(const std::vector<ChatMessage>& messages, const TokenSink& sink,
+                            AICallStats* stats = nullptr, uint64_t cache_key = 0, RouteInfo* route = nullptr);
+
+    // 上下文/历史预算：取所有模型中的最小值，保证任一模型都能容纳
+    size_t context_tokens() const;
+    size_t history_tokens() const;
+
+    // 缓存key使用的模型标识（所有模型ID，逗号分隔）
+    std::string cache_scope() const;
+
+    std::vector<ModelHealth> health() const;
+
+    // 健康度的单行文本，用于会话/批量结束时输出
+    std::string health_line() const;
+
+private:
+    ModelRouter(const ModelRouter&);
+    ModelRouter& operator=(const ModelRouter&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 读取配置文件中的 "routing" 段（可选），缺省项保持默认值
+void load_router_options(const std::string& path, RouterOptions& options);
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "agent2_diagnose.h"
+
+// 节点对齐结果
+enum class DiffStatus {
+    Same,       // 两侧算子相同
+    Changed,    // 位置对应但算子不同（如Seq Scan改为Index Scan）
+    Removed,    // 仅存在于优化前
+    Added       // 仅存在于优化后
+};
+
+// 一对对齐的节点（下标指向各自PlanTree::nodes，缺失一侧为-1）
+struct NodeDiff {
+    int before;
+    int after;
+    DiffStatus status;
+};
+
+// 两个执行计划的对比结果
+struct PlanDiff {
+    std::vector<NodeDiff> nodes;   // 按优化后计划先序排列，仅存在于优化前的节点附在末尾
+    double before_ms;              // 优化前总耗时，未知为-1
+    double after_ms;               // 优化后总耗时，未知为-1
+    double speedup;                // before_ms / after_ms，未知为0
+    double improvement_pct;        // 耗时降低百分比（负数表示变慢），未知为0
+    size_t same;
+    size_t changed;
+    size_t added;
+    size_t removed;
+
+    PlanDiff() : before_ms(-1), after_ms(-1), speedup(0), improvement_pct(0), same(0), changed(0), added(0),
+                 removed(0) {}
+
+    bool has_timing() const { return before_ms > 0 && after_ms > 0; }
+};
+
+// 对齐两棵算子树：根节点直接对应，子节点序列按（算子类型、表名、数据流转类型）求最长公共子序列，
+// 剩余同位置且数量相等的子节点视为算子变化；最后按表名补配扫描节点（连接顺序调整等）
+PlanDiff diff_plans(const PlanTree& before, const PlanTree& after);
+
+// 实际提升与预期提升（OptimizationStrategy::expected_improvement，百分比）的对照结论
+// 达到预期的80%即视为达到；met可为nullptr
+std::string check_improvement(const PlanDiff& diff, double expected_pct, bool* met = nullptr);
+
+// 对比结果的文本（总耗时/加速比 + 逐节点A-time、A-rows、内存变化），用于终端输出与AI提示词
+// max_nodes非0时只列出耗时变化最大的若干节点
+std::string format_plan_diff(const PlanDiff& diff, const PlanTree& before, const PlanTree& after,
+                             size_t max_nodes = 0);
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// 缓存命中统计
+struct CacheStats {
+    uint64_t hits;          // 命中（内存+磁盘）
+    uint64_t disk_hits;     // 其中来自磁盘的命中
+    uint64_t misses;        // 未命中
+    uint64_t expired;       // 因TTL过期未命中
+    uint64_t stores;        // 写入次数
+    uint64_t compactions;   // 磁盘文件压缩次数
+
+    CacheStats() : hits(0), disk_hits(0), misses(0), expired(0), stores(0), compactions(0) {}
+};
+
+// 缓存配置
+struct CacheOptions {
+    std::string dir;            // 磁盘缓存目录，为空时仅使用内存
+    size_t memory_entries;      // 内存LRU容量（条）
+    uint64_t max_disk_bytes;    // 磁盘文件上限，超出后压缩
+    long ttl_seconds;           // 有效期，<=0 表示不过期
+
+    CacheOptions() : dir(".aiagent_cache"), memory_entries(1024), max_disk_bytes(256ULL << 20),
+                     ttl_seconds(7 * 24 * 3600) {}
+};
+
+// AI会诊回复缓存：内存LRU + 磁盘追加日志（responses.dat）
+// 磁盘记录为定长头 + 内容并按8字节对齐，可直接mmap扫描；后写入的同key记录覆盖先前记录
+// 线程安全，可在批量模式的多个工作线程间共享
+class ResponseCache {
+public:
+    explicit ResponseCache(const CacheOptions& options);
+    ~ResponseCache();
+
+    // 查找缓存，命中返回true
+    bool get(uint64_t key, std::string& value);
+
+    // 写入缓存（同时写入内存与磁盘）
+    void put(uint64_t key, const std::string& value);
+
+    CacheStats stats() const;
+
+    // 统计信息的单行文本，如 "命中 3 / 未命中 5（命中率 37.5%）"
+    std::string stats_line() const;
+
+private:
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+
+    struct Impl;
+    Impl* impl_;
+};
+
+// 规范化SQL（即 Utils::normalize_sql）：去注释、字面量替换为?、IN列表折叠、合并空白、关键字与标识符转小写
+std::string normalize_sql_for_cache(const std::string& sql);
+
+// 会诊缓存key：规范化SQL + 计划形状指纹 + 模型ID + 提示词模板版本
+uint64_t make_cache_key(const std::string& sql, uint64_t plan_fingerprint,
+                        const std::string& model_id, int prompt_version);
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+
+namespace Utils {
+
+    // SQL词法单元类型
+    enum class SqlTokenKind {
+        Word,           // 关键字或未加引号的标识符
+        QuotedIdent,    // "带引号的标识符"
+        String,         // '字符串'、E'..'、B'..'、X'..'、$tag$..$tag$
+        Number,
+        Param,          // $1、?、:name
+        Operator,       // = <> <= :: || 等
+        Punct           // ( ) , ; . [ ]
+    };
+
+    // 词法单元（text为指向原SQL的视图）
+    struct SqlToken {
+        SqlTokenKind kind;
+        StrRef text;
+    };
+
+    // 比较谓词，如 orders.o_orderdate < ?
+    struct SqlPredicate {
+        std::string column;     // 列（能解析别名时为 表.列）
+        std::string op;         // = <> < <= > >= like in between is null 等（小写）
+        std::string value;      // "?"（常量/参数）、"(?)"（IN列表）、"(subquery)"，或另一侧的列
+        bool join;              // 两侧均为列（连接条件）
+    };
+
+    // SQL形态：规范化文本、指纹与引用的对象
+    struct SqlShape {
+        std::string normalized;                 // 去注释、字面量替换为?、IN列表折叠、关键字与标识符小写、空白归一
+        uint64_t fingerprint;                   // normalized 的64位FNV-1a哈希
+        std::vector<std::string> tables;        // 引用的表（不含CTE名），按出现顺序去重
+        std::vector<std::string> columns;       // 引用的列（表.列 或 列），按出现顺序去重
+        std::vector<SqlPredicate> predicates;   // WHERE/ON/HAVING 中的比较谓词
+
+        SqlShape() : fingerprint(0) {}
+    };
+
+    // 词法分析：跳过空白与注释（支持嵌套块注释），线性时间
+    std::vector<SqlToken> tokenize_sql(const std::string& sql);
+
+    // 规范化SQL文本（相同查询形态得到相同结果）
+    std::string normalize_sql(const std::string& sql);
+
+    // 查询形态指纹（normalize_sql 的哈希）
+    uint64_t sql_fingerprint(const std::string& sql);
+
+    // 一次扫描得到规范化文本、指纹、表、列与谓词；不做完整语法分析，无法识别的结构会被跳过
+    SqlShape analyze_sql(const std::string& sql);
+
+    // 指纹的16位十六进制表示
+    std::string fingerprint_hex(uint64_t fingerprint);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+
+struct AICallStats;
+
+// 一条埋点事件（时间相对会话开始）
+struct TraceEvent {
+    std::string name;       // 阶段名，如 plan_parse、ai.ttft
+    std::string category;   // 分类：stage / ai / job
+    double start_us;
+    double dur_us;
+    unsigned tid;           // 线程序号（从1开始）
+    std::string detail;     // 附加信息，如批量任务id
+};
+
+// 按阶段聚合的耗时统计
+struct StageStats {
+    std::string name;
+    size_t count;
+    double total_ms;
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+};
+
+// 会话级性能埋点：线程安全，导出为JSON或Chrome trace（chrome://tracing、Perfetto可直接打开）
+class Trace {
+public:
+    Trace();
+
+    const std::string& session_id() const { return session_id_; }
+
+    // 相对会话开始的微秒数
+    double now_us() const;
+
+    void record(const std::string& name, const std::string& category, double start_us, double dur_us,
+                const std::string& detail = "");
+
+    std::vector<TraceEvent> events() const;
+
+    // 按阶段统计，顺序为阶段首次出现的顺序
+    std::vector<StageStats> stage_stats() const;
+
+    // 机器可读格式：{"session_id", "stages":[...], "events":[...]}
+    std::string to_json() const;
+
+    // Chrome trace格式：{"traceEvents":[{"ph":"X",...}]}
+    std::string to_chrome_json() const;
+
+    bool write_json(const std::string& path) const;
+    bool write_chrome_json(const std::string& path) const;
+
+    // 各阶段统计的文本表格
+    std::string summary() const;
+
+private:
+    Trace(const Trace&);
+    Trace& operator=(const Trace&);
+
+    std::string session_id_;
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<TraceEvent> events_;
+};
+
+// 作用域埋点：析构（或调用end）时记录一条事件；trace为nullptr时不做任何事
+class TraceSpan {
+public:
+    TraceSpan(Trace* trace, const char* name, const char* category = "stage", const std::string& detail = "");
+    ~TraceSpan();
+
+    void end();
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    Trace* trace_;
+    const char* name_;
+    const char* category_;
+    std::string detail_;
+    double start_us_;
+};
+
+// 把一次AI调用拆成 ai.connect / ai.tls / ai.ttft / ai.total 事件（start_us为调用开始时刻）
+void trace_ai_call(Trace* trace, double start_us, const AICallStats& stats, const std::string& detail = "");
@@ -2,9 +2,68 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
 
 // 字符串工具函数
 namespace Utils {
+    // 只读字符串视图（C++11下的轻量string_view），不拥有内存，
+    // 使用方需保证底层字符串的生命周期长于视图
+    struct StrRef {
+        const char* data;
+        size_t size;
+
+        StrRef() : data(""), size(0) {}
+        StrRef(const char* d, size_t n) : data(d), size(n) {}
+        StrRef(const std::string& s) : data(s.data()), size(s.size()) {}
+
+        bool empty() const { return size == 0; }
+        char operator[](size_t i) const { return data[i]; }
+        std::string str() const { return std::string(data, size); }
+
+        // 查找子串，未找到返回 std::string::npos
+        size_t find(const char* needle, size_t from = 0) const {
+            size_t n = std::strlen(needle);
+            if (n == 0) return from <= size ? from : std::string::npos;
+            for (size_t i = from; i + n <= size; ++i) {
+                if (data[i] == needle[0] && std::memcmp(data + i, needle, n) == 0) return i;
+            }
+            return std::string::npos;
+        }
+        bool contains(const char* needle) const { return find(needle) != std::string::npos; }
+        bool starts_with(const char* prefix) const {
+            size_t n = std::strlen(prefix);
+            return n <= size && std::memcmp(data, prefix, n) == 0;
+        }
+        StrRef substr(size_t pos, size_t n = std::string::npos) const {
+            if (pos > size) pos = size;
+            if (n > size - pos) n = size - pos;
+            return StrRef(data + pos, n);
+        }
+        // 去除首尾空白后的视图
+        StrRef trimmed() const {
+            size_t b = 0, e = size;
+            while (b < e && (data[b] == ' ' || data[b] == '\t' || data[b] == '\r')) ++b;
+            while (e > b && (data[e - 1] == ' ' || data[e - 1] == '\t' || data[e - 1] == '\r')) --e;
+            return StrRef(data + b, e - b);
+        }
+    };
+
+    // FNV-1a 64位哈希，可用seed串联多段数据
+    inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // 估算文本的token数（ASCII约3.5字符/token，CJK等多字节字符约1.5 token/字，偏保守）
+    size_t estimate_tokens(const std::string& text);
+
     // 字符串分割
     std::vector<std::string> split(const std::string& str, char delimiter);
     
@@ -14,12 +73,15 @@ namespace Utils {
     // 字符串转小写
     std::string to_lower(const std::string& str);
     
+    // 非法的UTF-8字节替换为U+FFFD，保证文本可以写入JSON
+    std::string sanitize_utf8(const std::string& str);
+
     // 检查字符串是否包含子串
     bool contains(const std::string& str, const std::string& substr);
     
-    // 格式化时间
+    // 格式化时间（自动选择单位），如 "850 us"、"12.3 ms"、"2.50 s"、"3m05s"
     std::string format_time(double seconds);
     
-    // 生成唯一ID
+    // 生成唯一ID（随机UUID v4）
     std::string generate_uuid();
 }
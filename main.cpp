@@ -9,6 +9,31 @@
 #include <agent4_report.h>
 #include <agent5_interactive.h>
 #include <ai_engine.h>
+#include <batch_runner.h>
+#include <response_cache.h>
+#include <conversation.h>
+#include <model_router.h>
+#include <ai_recorder.h>
+#include <analysis_server.h>
+#include <trace.h>
+#include <plan_diff.h>
+#include <catalog_snapshot.h>
+#include <sql_normalize.h>
+#include <knowledge_base.h>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+
+// 多轮问答中粘贴新计划时，发给AI的对比结果最多列出的节点数
+const size_t kDiffPromptNodes = 20;
+// 交互模式中作为few-shot上下文的相似案例数与每条方案摘要的最大字节数
+const size_t kFewShotCases = 3;
+const size_t kCaseBriefChars = 600;
 
 // 辅助函数：多行输入，END/#END/两次空行结束
 std::string multiline_input(const std::string& prompt, bool allow_exit = false) {
@@ -17,8 +42,7 @@ std::string multiline_input(const std::string& prompt, bool allow_exit = false)
     int empty_count = 0;
     while (true) {
         std::getline(std::cin, line);
-        std::string lower_line = line;
-        std::transform(lower_line.begin(), lower_line.end(), lower_line.begin(), ::tolower);
+        std::string lower_line = Utils::to_lower(Utils::trim(line));
         if (allow_exit && (lower_line == "exit" || lower_line == "quit")) {
             return "__USER_EXIT__";
         }
@@ -35,7 +59,257 @@ std::string multiline_input(const std::string& prompt, bool allow_exit = false)
     return result;
 }
 
-int main() {
+// 服务模式收到SIGINT/SIGTERM时置位
+volatile std::sig_atomic_t g_stop_requested = 0;
+
+void request_stop(int) {
+    g_stop_requested = 1;
+}
+
+// --serve 模式：预热引擎后常驻，直到收到SIGINT/SIGTERM，处理完已入队的任务再退出
+int run_server(const BatchOptions& batch, const ServerOptions& server_options) {
+    AnalysisEngine engine(batch);
+    std::string error;
+    if (!engine.init(&error)) {
+        std::cerr << "[服务模式] " << error << std::endl;
+        return 1;
+    }
+    if (batch.use_ai && !engine.has_ai()) {
+        std::cerr << "[服务模式] AI模型配置加载失败，仅使用本地规则分析" << std::endl;
+    }
+    AnalysisServer server(engine, server_options);
+    if (!server.start(&error)) {
+        std::cerr << "[服务模式] " << error << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    std::cerr << "[服务模式] 已启动：";
+    if (!server_options.socket_path.empty()) std::cerr << "unix:" << server_options.socket_path;
+    if (!server_options.socket_path.empty() && server.port() >= 0) std::cerr << "、";
+    if (server.port() >= 0) std::cerr << "127.0.0.1:" << server.port();
+    std::cerr << "，" << server_options.workers << " 个工作线程，队列容量 " << server_options.queue_capacity << std::endl;
+    while (!g_stop_requested) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::cerr << "[服务模式] 正在停止，等待已入队的任务完成……" << std::endl;
+    server.stop();
+    std::cerr << "[服务模式] " << server.stats_line() << "\n" << engine.stats_lines("[服务模式] ") << std::flush;
+    return 0;
+}
+
+void print_usage(const char* prog) {
+    std::cout << "用法：" << prog << "                     交互式会诊（默认）\n"
+              << "      " << prog << " --batch <输入> [选项]  批量分析\n"
+              << "      " << prog << " --serve (--socket <路径> | --port <端口>) [选项]  常驻服务模式\n"
+              << "      " << prog << " --diff <优化前计划> <优化后计划> [--expected <预期提升%>]  对比两个执行计划\n"
+              << "\n批量模式选项：\n"
+              << "  --batch <路径>        JSONL文件（每行 {\"id\",\"sql\",\"explain\"}），或含 xxx.sql/xxx.explain 的目录\n"
+              << "  -o, --output <文件>   结果JSONL输出路径（默认标准输出）\n"
+              << "  -j, --concurrency <N> 并发数（默认4）\n"
+              << "  --no-ai               只用本地规则分析，不调用AI\n"
+              << "  --config <文件>       AI模型配置（默认config/ai_models.json）\n"
+              << "                        JSONL中可带 \"explain_after\"（目录中为 xxx.after.explain），结果附计划对比\n"
+              << "                        带 \"strategy\" / \"applied_sql\"（实际采用的方案）且实测有效时写入知识库\n"
+              << "  --report-dir <目录>   每条输入另写一份报告（文件名为id，格式见--format）\n"
+              << "\n服务模式选项：\n"
+              << "  --serve               常驻运行，接收JSON任务（每行一个，或HTTP POST /analyze），进度逐行推回\n"
+              << "  --socket <路径>       监听Unix套接字\n"
+              << "  --port <端口>         监听127.0.0.1上的TCP端口（同时支持NDJSON与HTTP）\n"
+              << "  -j, --concurrency <N> 工作线程数（默认4）\n"
+              << "  --queue <N>           等待队列容量（默认64），满时NDJSON连接暂停读取、HTTP返回503\n"
+              << "\n通用选项：\n"
+              << "  --catalog <文件>      统计信息快照（pg_class/pg_stats/pg_indexes/pg_settings 导出的JSON或CSV，可重复）\n"
+              << "  --no-cache            不使用AI回复缓存\n"
+              << "  --cache-dir <目录>    缓存目录（默认.aiagent_cache）\n"
+              << "  --cache-ttl <秒>      缓存有效期（默认7天，0为不过期）\n"
+              << "  --no-hedge            配置多个模型时不发出对冲请求（仍会在出错/限流时切换模型）\n"
+              << "  --record <文件>       把每次AI请求的结果（含耗时与失败）录制到文件\n"
+              << "  --replay <文件>       不访问网络，从录制文件回放AI回复（按录制耗时复现延迟）\n"
+              << "  --replay-fast         回放时不等待录制的耗时\n"
+              << "  --kb <文件>           历史优化知识库（默认<缓存目录>/knowledge.dat）：实测有效的方案写入，\n"
+              << "                        同一查询直接沿用已验证方案，相似查询作为参考案例附在提示词中\n"
+              << "  --no-kb               不使用知识库\n"
+              << "  --report <文件>       交互模式退出时写出报告（格式按扩展名或--format）\n"
+              << "  --format <格式>       报告格式：md / html / json / text（默认md）\n"
+              << "  --trace <文件>        记录各阶段耗时，退出时写出JSON（含p50/p95/p99）\n"
+              << "  --chrome-trace <文件> 同上，写出Chrome trace格式（chrome://tracing 或 Perfetto 打开）\n";
+}
+
+bool read_text_file(const std::string& path, std::string& out) {
+    std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+    if (!fin.is_open()) return false;
+    std::ostringstream oss;
+    oss << fin.rdbuf();
+    out = oss.str();
+    return true;
+}
+
+// --diff 模式：对比两个计划文件，输出逐节点变化与加速比
+int run_plan_diff(const std::string& before_path, const std::string& after_path, double expected_pct) {
+    std::string before_text, after_text;
+    if (!read_text_file(before_path, before_text) || !read_text_file(after_path, after_text)) {
+        std::cerr << "无法读取执行计划文件：" << before_path << " / " << after_path << std::endl;
+        return 1;
+    }
+    PlanTree before = parse_plan(before_text);
+    PlanTree after = parse_plan(after_text);
+    if (before.nodes.empty() || after.nodes.empty()) {
+        std::cerr << "未能从执行计划中识别出算子" << std::endl;
+        return 1;
+    }
+    PlanDiff diff = diff_plans(before, after);
+    std::cout << format_plan_diff(diff, before, after);
+    std::cout << check_improvement(diff, expected_pct) << std::endl;
+    return 0;
+}
+
+// 写出埋点文件并在标准错误输出各阶段统计
+void finish_trace(const Trace& trace, const std::string& json_path, const std::string& chrome_path) {
+    if (!json_path.empty() && !trace.write_json(json_path)) {
+        std::cerr << "[性能埋点] 无法写入：" << json_path << std::endl;
+    }
+    if (!chrome_path.empty() && !trace.write_chrome_json(chrome_path)) {
+        std::cerr << "[性能埋点] 无法写入：" << chrome_path << std::endl;
+    }
+    std::cerr << "\n[性能埋点] 会话 " << trace.session_id() << "\n" << trace.summary();
+}
+
+int main(int argc, char* argv[]) {
+    // 命令行参数：带 --batch 时进入批量（无交互）模式
+    BatchOptions batch;
+    bool batch_mode = false;
+    std::string trace_path, chrome_trace_path;
+    std::string report_path;
+    std::string diff_before, diff_after;
+    double expected_pct = 0;
+    bool format_given = false;
+    std::vector<std::string> catalog_paths;
+    bool serve_mode = false;
+    ServerOptions server_options;
+    std::string kb_path;
+    bool use_kb = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--batch" && has_value) {
+            batch_mode = true;
+            batch.input_path = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && has_value) {
+            batch.output_path = argv[++i];
+        } else if ((arg == "-j" || arg == "--concurrency") && has_value) {
+            batch.concurrency = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--no-ai") {
+            batch.use_ai = false;
+        } else if (arg == "--config" && has_value) {
+            batch.config_path = argv[++i];
+        } else if (arg == "--no-cache") {
+            batch.use_cache = false;
+        } else if (arg == "--cache-dir" && has_value) {
+            batch.cache.dir = argv[++i];
+        } else if (arg == "--cache-ttl" && has_value) {
+            batch.cache.ttl_seconds = std::atol(argv[++i]);
+        } else if (arg == "--no-hedge") {
+            batch.hedge = false;
+        } else if (arg == "--record" && has_value) {
+            batch.record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            batch.replay_path = argv[++i];
+        } else if (arg == "--replay-fast") {
+            batch.replay_timing = false;
+        } else if (arg == "--kb" && has_value) {
+            kb_path = argv[++i];
+        } else if (arg == "--no-kb") {
+            use_kb = false;
+        } else if (arg == "--serve") {
+            serve_mode = true;
+        } else if (arg == "--socket" && has_value) {
+            server_options.socket_path = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            server_options.port = std::atoi(argv[++i]);
+        } else if (arg == "--queue" && has_value) {
+            server_options.queue_capacity = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--diff" && i + 2 < argc) {
+            diff_before = argv[++i];
+            diff_after = argv[++i];
+        } else if (arg == "--expected" && has_value) {
+            expected_pct = std::atof(argv[++i]);
+        } else if (arg == "--report" && has_value) {
+            report_path = argv[++i];
+        } else if (arg == "--report-dir" && has_value) {
+            batch.report_dir = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            if (!parse_report_format(argv[++i], batch.report_format)) {
+                std::cerr << "未知报告格式：" << argv[i] << std::endl;
+                return 1;
+            }
+            format_given = true;
+        } else if (arg == "--catalog" && has_value) {
+            catalog_paths.push_back(argv[++i]);
+        } else if (arg == "--trace" && has_value) {
+            trace_path = argv[++i];
+        } else if (arg == "--chrome-trace" && has_value) {
+            chrome_trace_path = argv[++i];
+        } else {
+            std::cerr << "未知参数：" << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!diff_before.empty()) {
+        return run_plan_diff(diff_before, diff_after, expected_pct);
+    }
+    // 未指定--format时按报告文件扩展名推断
+    if (!format_given && !report_path.empty()) {
+        size_t dot = report_path.rfind('.');
+        if (dot != std::string::npos) parse_report_format(report_path.substr(dot + 1), batch.report_format);
+    }
+    // 统计信息快照：加载后按表名索引，分析时与SQL引用的表、列自动关联
+    CatalogSnapshot catalog_store;
+    const CatalogSnapshot* catalog = nullptr;
+    for (size_t i = 0; i < catalog_paths.size(); ++i) {
+        std::string error;
+        if (!catalog_store.load(catalog_paths[i], &error)) {
+            std::cerr << "统计信息快照加载失败：" << error << std::endl;
+            return 1;
+        }
+        catalog = &catalog_store;
+    }
+    if (catalog) {
+        std::cerr << "[统计信息] 已加载 " << catalog->table_count() << " 张表、" << catalog->guc_count() << " 个参数"
+                  << std::endl;
+    }
+    batch.catalog = catalog;
+    // 历史优化知识库：打开时建立相似度索引，批量/服务/交互模式共用
+    std::unique_ptr<KnowledgeBase> knowledge;
+    if (use_kb) {
+        if (kb_path.empty()) kb_path = batch.cache.dir + "/knowledge.dat";
+        knowledge.reset(new KnowledgeBase(kb_path));
+        if (!knowledge->ok()) {
+            std::cerr << "[知识库] 无法打开：" << kb_path << "，本次不使用知识库" << std::endl;
+            knowledge.reset();
+        } else if (knowledge->size() > 0) {
+            std::cerr << "[知识库] " << knowledge->stats_line() << std::endl;
+        }
+    }
+    batch.knowledge = knowledge.get();
+    Trace trace_store;
+    Trace* trace = (trace_path.empty() && chrome_trace_path.empty()) ? nullptr : &trace_store;
+    if (serve_mode) {
+        batch.trace = trace;
+        server_options.workers = batch.concurrency;
+        int rc = run_server(batch, server_options);
+        if (trace) finish_trace(*trace, trace_path, chrome_trace_path);
+        return rc;
+    }
+    if (batch_mode) {
+        batch.trace = trace;
+        int rc = run_batch(batch);
+        if (trace) finish_trace(*trace, trace_path, chrome_trace_path);
+        return rc;
+    }
+
     std::cout << "================ Copilot SQL 优化助手 ================\n";
     std::cout << "本工具可帮助你分析GaussDB SQL及其执行计划，自动生成优化建议和优化后SQL。" << std::endl;
     std::cout << "\n【使用说明】" << std::endl;
@@ -56,60 +330,157 @@ int main() {
     std::cout << "\n已收到查询计划分析，内容如下：\n" << explain << std::endl;
 
     InputData input{sql, explain};
-    if (!validate_input(input)) {
+    TraceSpan input_span(trace, "input");
+    bool input_ok = validate_input(input);
+    input_span.end();
+    if (!input_ok) {
         std::cerr << "输入格式错误！请确保SQL和执行计划均已输入。" << std::endl;
         return 1;
     }
 
+    // 本地预诊断：解析执行计划，提取行数偏差、耗时热点、下盘、广播等问题
+    TraceSpan parse_span(trace, "plan_parse");
+    PlanTree plan = parse_plan(input.explain_result);
+    parse_span.end();
+    TraceSpan diagnose_span(trace, "diagnose");
+    DiagnosticReport diag = diagnose_plan(std::move(plan), input);
+    diagnose_span.end();
+    std::cout << "\n【本地预诊断】" << diag.summary << std::endl;
+    if (!diag.bottleneck_analysis.empty()) std::cout << diag.bottleneck_analysis << std::endl;
+    for (size_t i = 0; i < diag.issues.size(); ++i) {
+        std::cout << "  - " << diag.issues[i] << std::endl;
+    }
+    // 关联统计信息快照：已知的表行数、列统计、索引与参数直接写入提示词，只就仍未知的事实向用户提问
+    TraceSpan context_span(trace, "context");
+    Utils::SqlShape shape = Utils::analyze_sql(input.sql);
+    EnrichedDiagnosticReport context = collect_context(diag, shape, catalog);
+    context_span.end();
+    if (!context.known_facts.empty()) {
+        std::cout << "\n【统计信息】已从快照补全" << context.known_facts.size() << "项：" << std::endl;
+        for (size_t i = 0; i < context.known_facts.size(); ++i) std::cout << "  - " << context.known_facts[i] << std::endl;
+    }
+    if (need_user_interaction(context)) {
+        std::cout << "\n【补充信息】" << generate_question(context) << std::endl;
+        std::string answer = multiline_input("请回答（可只答部分，END/#END/两次空行结束；直接输入END跳过）：");
+        if (!Utils::trim(answer).empty()) add_user_answer(context, Utils::trim(answer));
+    }
+    // 本地规则引擎：命中可直接执行的建议时，首轮跳过AI调用
+    TraceSpan rules_span(trace, "rules");
+    OptimizationStrategy local_strategy = generate_strategy(context);
+    rules_span.end();
+    // 知识库：同一查询已有实测有效的方案时首轮直接沿用，相似案例作为参考附在提示词中
+    CaseFeatures features;
+    std::vector<SimilarCase> similar;
+    if (knowledge) {
+        TraceSpan kb_span(trace, "knowledge");
+        features = make_case_features(diag.plan, shape);
+        similar = knowledge->find_similar(features, kFewShotCases);
+        for (size_t i = 0; i < similar.size(); ++i) {
+            context.similar_cases.push_back(format_case_brief(similar[i], kCaseBriefChars));
+        }
+        if (!similar.empty()) {
+            std::cout << "\n【历史案例】知识库中找到" << similar.size() << "个相似的已解决案例（最高相似度 "
+                      << static_cast<int>(similar[0].similarity * 100 + 0.5) << "%）" << std::endl;
+        }
+    }
+
     // 3. 加载AI模型配置
     std::cout << "\n【步骤3】正在加载AI模型配置……" << std::endl;
     std::vector<AIModelConfig> models;
-    if (!load_ai_config("config/ai_models.json", models) || models.empty()) {
+    if (!load_ai_config(batch.config_path, models) || models.empty()) {
         std::cerr << "AI模型配置加载失败！请检查config/ai_models.json。" << std::endl;
         return 1;
     }
-    std::cout << "已加载AI模型：" << models[0].name << "（如需切换请编辑config/ai_models.json）" << std::endl;
-    AIModelConfig model = models[0];
-
-    // 4. 构造AI提示词（专业增强版）
-    std::ostringstream prompt;
-    prompt << "你是GaussDB/TPCH数据库SQL优化专家，精通大规模数据分析、执行计划解读与GUC参数调优。请严格按照如下要求分析和优化：\n";
-    prompt << "【输入SQL】\n" << sql << "\n";
-    prompt << "【执行计划/分析结果】\n" << explain << "\n";
-    prompt << "【分析要求】\n";
-    prompt << "1. 详细解读执行计划中的每个关键节点（如Hash Join、Sort、Scan、Aggregate、Streaming等），指出耗时/高消耗/行数偏差的环节，并用表格或分点方式展示。\n";
-    prompt << "2. 结合A-time、A-rows、E-rows等指标，分析瓶颈和优化空间，尤其关注：\n";
-    prompt << "   - 行数估算严重偏差\n";
-    prompt << "   - 连接顺序与Join类型是否合理\n";
-    prompt << "   - 是否有不合理的全表扫描、数据倾斜、重复数据流转\n";
-    prompt << "   - GUC参数（如query_dop、work_mem、统计信息采样率等）对执行计划的影响\n";
-    prompt << "3. 给出专业的优化建议，包括但不限于：\n";
-    prompt << "   - SQL重写（如加hint、CTE、子查询、聚合下推、消除冗余等）\n";
-    prompt << "   - 建议的索引（普通索引、函数索引、分区、统计信息收集等）\n";
-    prompt << "   - GUC参数设置建议（如并行度、内存、采样率等）\n";
-    prompt << "   - 统计信息收集与分析（如analyze、default_statistics_target等）\n";
-    prompt << "   - 业务约束下的特殊优化（如必须保留模糊匹配、不能建索引等场景的权衡）\n";
-    prompt << "4. 输出优化后SQL（如需加hint、索引、参数等请直接体现在SQL中），并说明每一处优化的理由。\n";
-    prompt << "5. 如需用户补充信息（如表行数、索引、数据分布、业务约束、参数配置等），请明确提出具体问题，并说明补充这些信息的意义。\n";
-    prompt << "6. 输出结构建议：\n";
-    prompt << "   - # SQL优化分析报告\n";
-    prompt << "   - ## 1. 优化建议（分点详细说明）\n";
-    prompt << "   - ## 2. 优化后SQL（含注释）\n";
-    prompt << "   - ## 3. 需要用户补充的信息（如有，分点列出）\n";
-    prompt << "   - ## 4. 预期优化效果（如有数据可估算）\n";
-    prompt << "请用专业、简明、结构化的方式输出，避免泛泛而谈。";
-
-    // 5. 无限多轮AI问答主循环
-    std::ostringstream full_prompt;
-    full_prompt << prompt.str();
+    std::cout << "已加载AI模型：";
+    for (size_t i = 0; i < models.size(); ++i) std::cout << (i > 0 ? "、" : "") << models[i].name;
+    std::cout << "（多个模型时按延迟与错误率自动选择，出错或限流时切换）" << std::endl;
+    // 会话内复用同一路由器：多轮问答共享连接、DNS缓存与TLS会话，并累积各模型的延迟统计
+    RouterOptions routing;
+    load_router_options(batch.config_path, routing);
+    if (!batch.hedge) routing.hedge = false;
+    ModelRouter router(models, routing);
+    ResponseCache cache(batch.cache);
+    if (batch.use_cache) router.set_cache(&cache);
+    std::unique_ptr<AIRecorder> recorder;
+    if (!batch.record_path.empty() || !batch.replay_path.empty()) {
+        bool replay = !batch.replay_path.empty();
+        const std::string& path = replay ? batch.replay_path : batch.record_path;
+        recorder.reset(new AIRecorder(path, replay ? RecordMode::Replay : RecordMode::Record, batch.replay_timing));
+        if (!recorder->ok()) {
+            std::cerr << "无法" << (replay ? "读取" : "写入") << "录制文件：" << path << std::endl;
+            return 1;
+        }
+        router.set_recorder(recorder.get());
+        std::cout << (replay ? "[回放] " : "[录制] ") << recorder->stats_line() << std::endl;
+    }
+    // 首轮会诊可命中缓存；后续轮次包含用户补充信息，不走缓存
+    uint64_t cache_key = make_cache_key(input.sql, context_fingerprint(context, plan_fingerprint(diag.plan)),
+                                        router.cache_scope(), kPromptTemplateVersion);
+
+    // 4. 构造AI提示词（专业增强版）；执行计划超过上下文一半时发送压缩后的计划
+    TraceSpan prompt_span(trace, "prompt");
+    std::string prompt = build_ai_prompt(input, diag, router.context_tokens() / 2, &context);
+    prompt_span.end();
+
+    // 5. 无限多轮AI问答主循环：首条消息固定，历史超出预算后较早轮次合并为摘要
+    Conversation conversation(kAISystemPrompt, router.history_tokens());
+    conversation.set_context(prompt);
     std::string ai_result;
+    // 上一版执行计划：用户粘贴新计划时与之对比
+    std::string baseline_explain;
+    PlanTree baseline = diag.plan;
     bool user_exit = false;
-    std::string user_info_summary;
+    bool use_local = local_strategy.from_rules;
+    bool use_knowledge = !use_local && !similar.empty() && can_answer_locally(similar[0]);
+    // 当前建议来自知识库：记录案例时存原方案，不套用展示文本
+    bool answer_from_kb = false;
     while (true) {
-        std::cout << "\n【步骤5】正在调用AI进行智能分析，请稍候……" << std::endl;
-        ai_result = call_ai(full_prompt.str(), model);
-        std::cout << "\nAI分析完成，正在输出建议……\n" << std::endl;
-        std::cout << "\n===== Copilot智能分析与建议 =====\n" << ai_result << std::endl;
+        if (use_local) {
+            std::cout << "\n【步骤5】本地规则已命中明确问题，直接输出建议（如需AI深入分析请继续补充信息或提问）" << std::endl;
+            TraceSpan render_span(trace, "render");
+            output_report(local_strategy);
+            render_span.end();
+            conversation.add_assistant("本地规则建议：\n" + local_strategy.suggestion);
+            // 后续轮次包含用户补充信息，不走缓存
+            cache_key = 0;
+            use_local = false;
+        } else if (use_knowledge) {
+            std::cout << "\n【步骤5】知识库中有同一查询的已验证方案，直接沿用（如需AI重新分析请继续补充信息或提问）" << std::endl;
+            ai_result = format_case_answer(similar[0]);
+            std::cout << "\n===== 历史已验证方案 =====\n" << ai_result << std::endl;
+            conversation.add_assistant(ai_result);
+            // 后续轮次包含用户补充信息，不走缓存
+            cache_key = 0;
+            use_knowledge = false;
+            answer_from_kb = true;
+        } else {
+            std::cout << "\n【步骤5】正在调用AI进行智能分析，请稍候……" << std::endl;
+            std::cout << "\n===== Copilot智能分析与建议 =====\n" << std::flush;
+            // 流式输出：边生成边打印
+            AICallStats stats;
+            RouteInfo route;
+            bool streamed = false;
+            double ai_start = trace ? trace->now_us() : 0;
+            ai_result = router.call_stream(conversation.messages(), [&streamed](const std::string& delta) {
+                streamed = true;
+                std::cout << delta << std::flush;
+            }, &stats, cache_key, &route);
+            trace_ai_call(trace, ai_start, stats, route.model);
+            cache_key = 0;
+            answer_from_kb = false;
+            if (!streamed) std::cout << ai_result;
+            std::cout << std::endl;
+            if (!ai_reply_failed(ai_result)) conversation.add_assistant(ai_result);
+            if (stats.cache_hit) {
+                std::cout << "\n[AI耗时] 命中本地缓存（" << cache.stats_line() << "）" << std::endl;
+            } else if (stats.first_token_ms >= 0) {
+                std::cout << "\n[AI耗时] " << route.model << " 首字 " << static_cast<long>(stats.first_token_ms)
+                          << " ms，总计 " << static_cast<long>(stats.total_ms) << " ms";
+                if (route.hedged) std::cout << "（已发出对冲请求）";
+                if (route.failed_over) std::cout << "（已切换模型）";
+                std::cout << std::endl;
+            }
+        }
 
         // 检查AI是否需要补充信息
         bool need_more = (ai_result.find("需要补充的信息") != std::string::npos) ||
@@ -119,11 +490,54 @@ int main() {
         std::string user_answer = multiline_input("请输入你的补充信息或问题（多行，END/#END/两次空行结束，或输入exit/quit退出）：", true);
         if (user_answer == "__USER_EXIT__") {
             std::cout << "\n【用户已选择退出小助手，感谢使用SQL优化助手！】\n" << std::endl;
+            if (models.size() > 1) std::cout << "[模型统计] " << router.health_line() << std::endl;
+            if (recorder) std::cout << "[录制/回放] " << recorder->stats_line() << std::endl;
+            if (!report_path.empty()) {
+                ReportContent content;
+                content.strategy = &local_strategy;
+                content.diag = &diag;
+                content.input = &input;
+                content.ai_result = &ai_result;
+                TraceSpan report_span(trace, "report");
+                bool written = write_report_file(report_path, content, batch.report_format);
+                report_span.end();
+                if (written) std::cout << "[报告] 已写入 " << report_path << std::endl;
+                else std::cerr << "[报告] 无法写入：" << report_path << std::endl;
+            }
+            if (trace) finish_trace(*trace, trace_path, chrome_trace_path);
             break;
         }
-        // 汇总所有用户补充信息，便于AI多轮上下文
-        user_info_summary += "\n用户补充信息或提问：" + user_answer;
-        full_prompt << "\n用户补充信息或提问：" << user_answer << "\n请结合所有补充信息和问题，重新输出优化建议和优化后SQL。如有新问题请继续提问。";
+        // 用户粘贴了优化后的执行计划：与上一版对比，用对比结果代替原始计划发给AI
+        PlanTree pasted = parse_plan(user_answer);
+        if (pasted.analyzed && !pasted.nodes.empty()) {
+            PlanDiff diff = diff_plans(baseline, pasted);
+            std::string diff_text = format_plan_diff(diff, baseline, pasted, kDiffPromptNodes) +
+                                    check_improvement(diff, local_strategy.expected_improvement);
+            std::cout << "\n" << diff_text << std::endl;
+            // 实测有效：把本次采用的方案（AI回复，无则本地规则建议）记入知识库
+            if (knowledge && diff.speedup >= kMinCaseSpeedup) {
+                bool ai_ok = !ai_result.empty() && !ai_reply_failed(ai_result);
+                std::string applied = answer_from_kb ? similar[0].record.strategy :
+                                      (ai_ok ? ai_result : local_strategy.suggestion);
+                std::string applied_sql = answer_from_kb ? similar[0].record.optimized_sql :
+                                          (local_strategy.from_rules ? local_strategy.optimized_sql : "");
+                if (knowledge->add(make_knowledge_case(features, shape, diag, applied, applied_sql, diff.speedup))) {
+                    std::cout << "[知识库] 已记录本次优化案例（加速 " << std::fixed << std::setprecision(2) << diff.speedup
+                              << std::defaultfloat << " 倍），同一查询下次可直接沿用" << std::endl;
+                }
+            }
+            conversation.add_user("用户执行优化后的SQL得到了新的执行计划，与上一版计划的对比如下（代替原始计划）：\n" +
+                                  diff_text + "\n请据此判断改写是否有效，分析剩余瓶颈并给出下一步优化建议和优化后SQL。");
+            baseline_explain = user_answer;
+            baseline = parse_plan(baseline_explain);
+        } else {
+            conversation.add_user("用户补充信息或提问：" + user_answer +
+                                  "\n请结合所有补充信息和问题，重新输出优化建议和优化后SQL。如有新问题请继续提问。");
+        }
+        if (conversation.summarized_messages() > 0) {
+            std::cout << "[上下文] 较早的" << conversation.summarized_messages() << "条对话已合并为摘要，本轮约"
+                      << conversation.estimated_tokens() << " tokens" << std::endl;
+        }
     }
     return 0;
 }
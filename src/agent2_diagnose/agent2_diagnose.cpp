@@ -1,7 +1,693 @@
 #include "agent2_diagnose.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+using Utils::StrRef;
+
+namespace {
+
+// 诊断阈值
+const double kSkewRatio = 10.0;            // E-rows与A-rows偏差倍数
+const double kSkewMinRows = 1000.0;        // 行数过小时不计偏差
+const double kBroadcastRows = 100000.0;    // 广播行数超过该值视为问题
+const double kHotspotShare = 0.3;          // 单算子自身耗时占比超过该值视为热点
+const size_t kMaxReportedSkews = 5;        // 偏差问题最多列出的条数
+const double kCompactMinShare = 0.01;      // 压缩计划时，自身耗时占比低于该值的节点不单独保留
+
+enum class Section { None, Table, Predicate, Memory, Detail, Summary };
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// 从pos开始解析一个非负数，成功时pos移到数字末尾
+bool parse_number(StrRef s, size_t& pos, double& out) {
+    while (pos < s.size && !is_digit(s[pos])) ++pos;
+    if (pos >= s.size) return false;
+    double v = 0;
+    while (pos < s.size && is_digit(s[pos])) v = v * 10 + (s[pos++] - '0');
+    if (pos < s.size && s[pos] == '.' && pos + 1 < s.size && is_digit(s[pos + 1])) {
+        ++pos;
+        double scale = 0.1;
+        while (pos < s.size && is_digit(s[pos])) {
+            v += (s[pos++] - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if (pos < s.size && (s[pos] == 'e' || s[pos] == 'E') && pos + 1 < s.size &&
+        (is_digit(s[pos + 1]) || s[pos + 1] == '+')) {
+        size_t p = pos + 1;
+        if (s[p] == '+') ++p;
+        int exp = 0;
+        while (p < s.size && is_digit(s[p])) exp = exp * 10 + (s[p++] - '0');
+        while (exp-- > 0) v *= 10;
+        pos = p;
+    }
+    out = v;
+    return true;
+}
+
+// 取单元格中的第一个数字，无数字返回-1
+double first_number(StrRef s) {
+    size_t pos = 0;
+    double v;
+    return parse_number(s, pos, v) ? v : -1;
+}
+
+// 取单元格中所有数字的最大值（适用于 "[1.2, 345.6]" 这类多DN区间），无数字返回-1
+double max_number(StrRef s) {
+    size_t pos = 0;
+    double v, best = -1;
+    while (parse_number(s, pos, v)) best = std::max(best, v);
+    return best;
+}
+
+// 取单元格中所有数字的最小值，无数字返回-1
+double min_number(StrRef s) {
+    size_t pos = 0;
+    double v, best = -1;
+    while (parse_number(s, pos, v)) best = best < 0 ? v : std::min(best, v);
+    return best;
+}
+
+// 解析内存值并换算为KB，如 "86KB"、"[200KB, 2MB]"，取最大值
+double max_memory_kb(StrRef s) {
+    size_t pos = 0;
+    double v, best = -1;
+    while (parse_number(s, pos, v)) {
+        size_t u = pos;
+        while (u < s.size && is_space(s[u])) ++u;
+        double kb = v;
+        if (u < s.size) {
+            char c = s[u];
+            if (c == 'M' || c == 'm') kb = v * 1024;
+            else if (c == 'G' || c == 'g') kb = v * 1024 * 1024;
+            else if (c == 'B' || c == 'b') kb = v / 1024;
+        }
+        best = std::max(best, kb);
+    }
+    return best;
+}
+
+// 解析 "key" 之后的数字，如 find_value(line, "rows=")
+double value_after(StrRef s, const char* key) {
+    size_t at = s.find(key);
+    if (at == std::string::npos) return -1;
+    size_t pos = at + std::strlen(key);
+    double v;
+    if (pos < s.size && !is_digit(s[pos]) && s[pos] != '[') return -1;
+    return parse_number(s, pos, v) ? v : -1;
+}
+
+size_t leading_spaces(StrRef s) {
+    size_t n = 0;
+    while (n < s.size && is_space(s[n])) ++n;
+    return n;
+}
+
+OperatorKind classify(StrRef op, StreamKind& stream) {
+    stream = StreamKind::None;
+    if (op.contains("Streaming")) {
+        bool local = op.contains("LOCAL");
+        if (op.contains("BROADCAST")) stream = local ? StreamKind::LocalBroadcast : StreamKind::Broadcast;
+        else if (op.contains("REDISTRIBUTE")) stream = local ? StreamKind::LocalRedistribute : StreamKind::Redistribute;
+        else stream = local ? StreamKind::LocalGather : StreamKind::Gather;
+        return OperatorKind::Streaming;
+    }
+    if (op.contains("Join") || op.contains("Nested Loop") || op.contains("Nest Loop")) {
+        if (op.contains("Nest")) return OperatorKind::NestLoop;
+        if (op.contains("Merge")) return OperatorKind::MergeJoin;
+        return OperatorKind::HashJoin;
+    }
+    if (op.contains("Index Scan") || op.contains("Index Only Scan")) {
+        return op.contains("Bitmap") ? OperatorKind::BitmapScan : OperatorKind::IndexScan;
+    }
+    if (op.contains("Bitmap")) return OperatorKind::BitmapScan;
+    if (op.contains("Seq Scan") || op.contains("CStore Scan") || op.contains("Cstore Scan")) return OperatorKind::SeqScan;
+    if (op.contains("Sort Aggregate") || op.contains("GroupAggregate") || op.contains("Sort Agg")) return OperatorKind::SortAgg;
+    if (op.contains("Hash Aggregate") || op.contains("HashAggregate") || op.contains("Hash Agg")) return OperatorKind::HashAgg;
+    if (op.contains("Aggregate")) return OperatorKind::Agg;
+    if (op.contains("Sort")) return OperatorKind::Sort;
+    if (op.contains("Materialize")) return OperatorKind::Materialize;
+    if (op.contains("Limit")) return OperatorKind::Limit;
+    if (op.contains("Append")) return OperatorKind::Append;
+    return OperatorKind::Other;
+}
+
+// 取 " on " 之后的表名，如 "Seq Scan on public.lineitem l" -> "public.lineitem"
+StrRef relation_of(StrRef op) {
+    size_t at = op.find(" on ");
+    if (at == std::string::npos) return StrRef();
+    size_t b = at + 4, e = b;
+    while (e < op.size && !is_space(op[e]) && op[e] != '(') ++e;
+    return op.substr(b, e - b);
+}
+
+// 解析 "dop: a/b"，a为本算子并行度，b为下层并行度
+bool parse_dop(StrRef op, int& self_dop, int& child_dop) {
+    size_t at = op.find("dop: ");
+    if (at == std::string::npos) return false;
+    size_t pos = at + 5;
+    double a, b;
+    if (!parse_number(op, pos, a)) return false;
+    self_dop = child_dop = static_cast<int>(a);
+    if (pos < op.size && op[pos] == '/' && parse_number(op, pos, b)) child_dop = static_cast<int>(b);
+    return true;
+}
+
+// 逐行解析的状态
+struct ParseState {
+    struct Frame { int index; int child_dop; };
+    std::vector<Frame> stack;
+    int col_id, col_op, col_atime, col_arows, col_erows, col_mem, col_awidth, col_ewidth;
+    Section section;
+    int detail_node;   // 当前明细所属节点下标
+
+    ParseState() : col_id(-1), col_op(-1), col_atime(-1), col_arows(-1), col_erows(-1),
+                   col_mem(-1), col_awidth(-1), col_ewidth(-1), section(Section::None), detail_node(-1) {
+        stack.reserve(64);
+    }
+};
+
+// 把新节点挂到树上，depth决定父节点
+PlanNode& push_node(PlanTree& tree, ParseState& st, int depth, StrRef op) {
+    int parent_dop = 1;
+    int last_popped = -1;
+    while (!st.stack.empty() && tree.nodes[st.stack.back().index].depth >= depth) {
+        last_popped = st.stack.back().index;
+        st.stack.pop_back();
+    }
+    int parent = st.stack.empty() ? -1 : st.stack.back().index;
+    if (parent >= 0) parent_dop = st.stack.back().child_dop;
+
+    int index = static_cast<int>(tree.nodes.size());
+    tree.nodes.push_back(PlanNode());
+    PlanNode& n = tree.nodes.back();
+    n.id = index + 1;
+    n.parent = parent;
+    n.first_child = -1;
+    n.next_sibling = -1;
+    n.depth = depth;
+    n.operation = op;
+    n.relation = relation_of(op);
+    n.kind = classify(op, n.stream);
+    n.a_time_ms = n.a_time_min_ms = n.self_time_ms = n.a_rows = n.e_rows = -1;
+    n.width = -1;
+    n.peak_memory_kb = -1;
+    n.spilled = false;
+    n.has_filter = false;
+    n.rows_removed = -1;
+
+    int child_dop = parent_dop;
+    n.dop = parent_dop;
+    parse_dop(op, n.dop, child_dop);
+
+    if (last_popped >= 0 && tree.nodes[last_popped].parent == parent) {
+        tree.nodes[last_popped].next_sibling = index;
+    } else if (parent >= 0) {
+        tree.nodes[parent].first_child = index;
+    }
+    ParseState::Frame f = { index, child_dop };
+    st.stack.push_back(f);
+    return n;
+}
+
+// 按 '|' 切分表格行，最多max_cells列
+size_t split_cells(StrRef line, StrRef* cells, size_t max_cells) {
+    size_t n = 0, b = 0;
+    for (size_t i = 0; i <= line.size && n < max_cells; ++i) {
+        if (i == line.size || line[i] == '|') {
+            cells[n++] = line.substr(b, i - b);
+            b = i + 1;
+        }
+    }
+    return n;
+}
+
+void parse_table_header(StrRef line, ParseState& st) {
+    StrRef cells[24];
+    size_t n = split_cells(line, cells, 24);
+    for (size_t i = 0; i < n; ++i) {
+        StrRef c = cells[i].trimmed();
+        int col = static_cast<int>(i);
+        if (c.starts_with("id")) st.col_id = col;
+        else if (c.starts_with("operation")) st.col_op = col;
+        else if (c.starts_with("A-time")) st.col_atime = col;
+        else if (c.starts_with("A-rows")) st.col_arows = col;
+        else if (c.starts_with("E-rows")) st.col_erows = col;
+        else if (c.starts_with("Peak Memory")) st.col_mem = col;
+        else if (c.starts_with("A-width")) st.col_awidth = col;
+        else if (c.starts_with("E-width")) st.col_ewidth = col;
+    }
+}
+
+StrRef cell_at(const StrRef* cells, size_t n, int col) {
+    return (col >= 0 && static_cast<size_t>(col) < n) ? cells[col] : StrRef();
+}
+
+// GaussDB EXPLAIN PERFORMANCE 表格行
+void parse_table_row(StrRef line, PlanTree& tree, ParseState& st) {
+    StrRef cells[24];
+    size_t n = split_cells(line, cells, 24);
+    double id = first_number(cell_at(cells, n, st.col_id));
+    StrRef op_cell = cell_at(cells, n, st.col_op);
+    if (id < 0 || op_cell.empty()) return;
+
+    size_t arrow = op_cell.find("->");
+    int depth = static_cast<int>(arrow != std::string::npos ? arrow : leading_spaces(op_cell));
+    StrRef op = (arrow != std::string::npos ? op_cell.substr(arrow + 2) : op_cell).trimmed();
+
+    PlanNode& node = push_node(tree, st, depth, op);
+    node.id = static_cast<int>(id);
+    node.a_time_ms = max_number(cell_at(cells, n, st.col_atime));
+    node.a_time_min_ms = min_number(cell_at(cells, n, st.col_atime));
+    node.a_rows = first_number(cell_at(cells, n, st.col_arows));
+    node.e_rows = first_number(cell_at(cells, n, st.col_erows));
+    node.peak_memory_kb = max_memory_kb(cell_at(cells, n, st.col_mem));
+    double w = first_number(cell_at(cells, n, st.col_ewidth));
+    if (w < 0) w = first_number(cell_at(cells, n, st.col_awidth));
+    node.width = static_cast<int>(w);
+}
+
+// 解析 "actual time=a..b" 中的结束时间，兼容 GaussDB 的 "[x,y]..[x,y]" 形式
+StrRef actual_end_time(StrRef line) {
+    size_t at = line.find("actual time=");
+    if (at == std::string::npos) return StrRef();
+    size_t pos = at + 12;
+    int bracket = 0;
+    for (; pos + 1 < line.size; ++pos) {
+        char c = line[pos];
+        if (c == '[') ++bracket;
+        else if (c == ']') --bracket;
+        else if (bracket == 0 && c == '.' && line[pos + 1] == '.') break;
+        else if (c == ' ' || c == ')') return StrRef();
+    }
+    pos += 2;
+    size_t e = pos;
+    bracket = 0;
+    while (e < line.size) {
+        char c = line[e];
+        if (c == '[') ++bracket;
+        else if (c == ']') { if (--bracket <= 0) { ++e; break; } }
+        else if (bracket == 0 && (c == ' ' || c == ',' || c == ')')) break;
+        ++e;
+    }
+    return line.substr(pos, e - pos);
+}
+
+// PG/GaussDB EXPLAIN ANALYZE 缩进格式的节点行
+void parse_text_node(StrRef line, PlanTree& tree, ParseState& st) {
+    size_t indent = leading_spaces(line);
+    StrRef body = line.substr(indent);
+    int depth = static_cast<int>(indent);
+    if (body.starts_with("->")) body = body.substr(2);
+    body = body.trimmed();
+    size_t cut = body.find("  (");
+    if (cut == std::string::npos) cut = body.find(" (cost=");
+    if (cut == std::string::npos) cut = body.find(" (actual");
+    StrRef op = body.substr(0, cut).trimmed();
+
+    PlanNode& node = push_node(tree, st, depth, op);
+    size_t cost = body.find("(cost=");
+    if (cost != std::string::npos) {
+        StrRef est = body.substr(cost);
+        size_t close = est.find(")");
+        est = est.substr(0, close);
+        node.e_rows = value_after(est, "rows=");
+        node.width = static_cast<int>(value_after(est, "width="));
+    }
+    size_t actual = body.find("(actual");
+    if (actual != std::string::npos) {
+        StrRef act = body.substr(actual);
+        double loops = value_after(act, "loops=");
+        if (loops < 1) loops = 1;
+        StrRef end_time = actual_end_time(act);
+        if (!end_time.empty()) {
+            node.a_time_ms = max_number(end_time) * loops;
+            node.a_time_min_ms = min_number(end_time) * loops;
+        }
+        size_t rows_at = act.find("rows=");
+        if (rows_at != std::string::npos) node.a_rows = value_after(act.substr(rows_at), "rows=");
+    } else if (body.contains("never executed")) {
+        node.a_time_ms = node.a_time_min_ms = 0;
+        node.a_rows = 0;
+    }
+    st.detail_node = static_cast<int>(tree.nodes.size()) - 1;
+}
+
+// 下盘信息只出现在排序/哈希/缓冲的统计行里；谓词行中的字面量（如 channel = 'external'）不算
+bool spill_line(StrRef line) {
+    if (line.contains("Filter:") || line.contains("Cond:")) return false;
+    if (line.contains("Sort Method:") && line.contains("external")) return true;
+    if (line.contains("Disk:") || line.contains("temp file") || line.contains("written disk") ||
+        line.contains("file number") || line.contains("spill") || line.contains("Spill")) {
+        return true;
+    }
+    return value_after(line, "Batches: ") > 1;
+}
+
+// 明细行（谓词/内存/下盘信息），归属于st.detail_node
+void parse_detail(StrRef line, PlanTree& tree, const ParseState& st) {
+    if (st.detail_node < 0) return;
+    PlanNode& node = tree.nodes[st.detail_node];
+    size_t filter = line.find("Filter:");
+    if (filter != std::string::npos && !line.contains("Rows Removed")) {
+        node.has_filter = true;
+        if (node.filter.empty()) node.filter = line.substr(filter + 7).trimmed();
+    }
+    double removed = value_after(line, "Rows Removed by Filter: ");
+    if (removed >= 0) node.rows_removed = std::max(node.rows_removed, 0.0) + removed;
+    if (spill_line(line)) node.spilled = true;
+    size_t mem = line.find("Peak Memory:");
+    if (mem == std::string::npos) mem = line.find("Memory Usage:");
+    if (mem == std::string::npos) mem = line.find("Memory:");
+    if (mem != std::string::npos) {
+        StrRef rest = line.substr(mem);
+        size_t comma = rest.find(",");
+        double kb = max_memory_kb(rest.substr(0, comma));
+        node.peak_memory_kb = std::max(node.peak_memory_kb, kb);
+    }
+}
+
+// 明细段落的节点标题行，如 "   4 --Vector Hash Join (5,6)"
+bool detail_header(StrRef trimmed, const PlanTree& tree, int& index) {
+    size_t pos = 0;
+    while (pos < trimmed.size && is_digit(trimmed[pos])) ++pos;
+    if (pos == 0 || trimmed.substr(pos).trimmed().starts_with("--") == false) return false;
+    double id = first_number(trimmed.substr(0, pos));
+    index = tree.find(static_cast<int>(id));
+    return true;
+}
+
+void finish_tree(PlanTree& tree) {
+    for (size_t i = 0; i < tree.nodes.size(); ++i) {
+        PlanNode& n = tree.nodes[i];
+        if (n.a_time_ms >= 0 || n.a_rows >= 0) tree.analyzed = true;
+        if (n.a_time_ms < 0) continue;
+        double children = 0;
+        for (int c = n.first_child; c >= 0; c = tree.nodes[c].next_sibling) {
+            if (tree.nodes[c].a_time_ms > 0) children += tree.nodes[c].a_time_ms;
+        }
+        n.self_time_ms = std::max(0.0, n.a_time_ms - children);
+    }
+    if (tree.total_runtime_ms < 0 && !tree.nodes.empty() && tree.nodes[0].a_time_ms >= 0) {
+        tree.total_runtime_ms = tree.nodes[0].a_time_ms;
+    }
+}
+
+std::string fmt_num(double v, int precision = 2) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(precision) << v;
+    return oss.str();
+}
+
+std::string node_label(const PlanNode& n) {
+    return "节点" + std::to_string(n.id) + " " + n.operation.str();
+}
+
+// 估算偏差倍数，行数过小或未知时为0
+double skew_of(const PlanNode& n) {
+    if (n.a_rows < 0 || n.e_rows < 0) return 0;
+    double hi = std::max(n.a_rows, n.e_rows), lo = std::max(std::min(n.a_rows, n.e_rows), 1.0);
+    return hi >= kSkewMinRows ? hi / lo : 0;
+}
+
+bool is_big_broadcast(const PlanNode& n) {
+    if (n.stream != StreamKind::Broadcast && n.stream != StreamKind::LocalBroadcast) return false;
+    return (n.a_rows >= 0 ? n.a_rows : n.e_rows) >= kBroadcastRows;
+}
+
+// 压缩计划时节点的关注度：耗时占比 + 偏差/下盘/广播加权，0表示无需关注
+double focus_score(const PlanNode& n, double total) {
+    double score = 0;
+    if (n.self_time_ms > 0 && total > 0 && n.self_time_ms / total >= kCompactMinShare) score += n.self_time_ms / total;
+    double skew = skew_of(n);
+    if (skew >= kSkewRatio) score += std::min(1.0, std::log10(skew) / 3);
+    if (n.spilled) score += 0.5;
+    if (is_big_broadcast(n)) score += 0.5;
+    return score;
+}
+
+void append_plan_line(std::ostringstream& out, const PlanNode& n, int depth) {
+    out << std::string(depth * 2, ' ') << n.id << " | " << n.operation.str();
+    if (n.a_time_ms >= 0) out << " | A-time=" << fmt_num(n.a_time_ms);
+    if (n.self_time_ms >= 0) out << " self=" << fmt_num(n.self_time_ms);
+    if (n.a_rows >= 0) out << " | A-rows=" << fmt_num(n.a_rows, 0);
+    if (n.e_rows >= 0) out << " E-rows=" << fmt_num(n.e_rows, 0);
+    double skew = skew_of(n);
+    if (skew >= kSkewRatio) out << " [偏差" << fmt_num(skew, 1) << "倍]";
+    if (n.spilled) out << " [下盘]";
+    if (n.has_filter && !n.filter.empty()) out << " | Filter: " << n.filter.str();
+    out << "\n";
+}
+
+} // namespace
+
+int PlanTree::find(int id) const {
+    if (id >= 1 && static_cast<size_t>(id) <= nodes.size() && nodes[id - 1].id == id) return id - 1;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].id == id) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+PlanTree parse_plan(const std::string& explain) {
+    PlanTree tree;
+    tree.nodes.reserve(explain.size() / 80 + 16);
+    ParseState st;
+    const char* p = explain.data();
+    const char* end = p + explain.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!nl) nl = end;
+        StrRef line(p, nl - p);
+        p = nl + 1;
+        StrRef t = line.trimmed();
+        if (t.empty()) continue;
+
+        // 表格区：表头 -> 分隔线 -> 节点行
+        if (t.contains("|") && t.contains("operation") && st.section != Section::Table) {
+            parse_table_header(line, st);
+            st.section = Section::Table;
+            continue;
+        }
+        if (st.section == Section::Table) {
+            if (t.starts_with("--") && t.contains("+")) continue;
+            if (t.contains("|")) {
+                parse_table_row(line, tree, st);
+                continue;
+            }
+            st.section = Section::None;
+        }
+
+        // 汇总信息
+        double total = value_after(t, "Total runtime: ");
+        if (total < 0) total = value_after(t, "Execution Time: ");
+        if (total < 0) total = value_after(t, "Execution time: ");
+        if (total >= 0) {
+            tree.total_runtime_ms = total;
+            continue;
+        }
+
+        // 明细段落标题
+        if (t.contains("(identified by plan id)") || t.contains("Query Summary") ||
+            t.starts_with("User Define Profiling")) {
+            if (t.starts_with("Predicate Information")) st.section = Section::Predicate;
+            else if (t.starts_with("Memory Information")) st.section = Section::Memory;
+            else if (t.contains("Query Summary")) st.section = Section::Summary;
+            else st.section = Section::Detail;
+            st.detail_node = -1;
+            continue;
+        }
+        if (st.section != Section::None) {
+            if (t.starts_with("---") || t.starts_with("===")) continue;
+            int index;
+            if (detail_header(t, tree, index)) {
+                st.detail_node = index;
+                continue;
+            }
+            if (st.section != Section::Summary) parse_detail(t, tree, st);
+            continue;
+        }
+
+        // 缩进格式：根节点为第一条带cost/actual的行，其余以 "->" 开头
+        if (t.starts_with("->") || (tree.nodes.empty() && (t.contains("(cost=") || t.contains("(actual")))) {
+            parse_text_node(line, tree, st);
+        } else {
+            parse_detail(t, tree, st);
+        }
+    }
+    finish_tree(tree);
+    return tree;
+}
+
+uint64_t plan_fingerprint(const PlanTree& plan) {
+    uint64_t h = Utils::fnv1a64("plan", 4);
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        int shape[3] = { n.parent, static_cast<int>(n.kind), static_cast<int>(n.stream) };
+        h = Utils::fnv1a64(shape, sizeof(shape), h);
+        h = Utils::fnv1a64(n.relation.data, n.relation.size, h);
+    }
+    return h;
+}
+
+std::string compact_plan(const PlanTree& plan, size_t max_nodes) {
+    const std::vector<PlanNode>& nodes = plan.nodes;
+    size_t n = nodes.size();
+    if (n == 0) return "";
+    double total = plan.total_runtime_ms > 0 ? plan.total_runtime_ms : nodes[0].a_time_ms;
+
+    // 关注度从高到低选入节点，连带祖先（保持树形上下文）与直接子节点
+    std::vector<std::pair<double, int> > focus;
+    for (size_t i = 0; i < n; ++i) {
+        double score = focus_score(nodes[i], total);
+        if (score > 0) focus.push_back(std::make_pair(score, static_cast<int>(i)));
+    }
+    std::sort(focus.begin(), focus.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+        return a.first > b.first;
+    });
+    std::vector<char> keep(n, 0);
+    keep[0] = 1;
+    size_t kept = 1;
+    for (size_t f = 0; f < focus.size() && kept < max_nodes; ++f) {
+        for (int p = focus[f].second; p >= 0 && !keep[p]; p = nodes[p].parent) {
+            keep[p] = 1;
+            ++kept;
+        }
+        for (int c = nodes[focus[f].second].first_child; c >= 0 && kept < max_nodes; c = nodes[c].next_sibling) {
+            if (!keep[c]) {
+                keep[c] = 1;
+                ++kept;
+            }
+        }
+    }
+
+    // 子树规模（先序存储，逆序累加到父节点）与树深度
+    std::vector<size_t> subtree(n, 1);
+    for (size_t i = n; i-- > 1;) {
+        if (nodes[i].parent >= 0) subtree[nodes[i].parent] += subtree[i];
+    }
+    std::vector<int> depth(n, 0);
+    for (size_t i = 1; i < n; ++i) {
+        if (nodes[i].parent >= 0) depth[i] = depth[nodes[i].parent] + 1;
+    }
+
+    std::ostringstream out;
+    out << "（计划共" << n << "个节点，已压缩为" << kept << "个：保留耗时热点、估算偏差、下盘与大广播节点）\n";
+    for (size_t i = 0; i < n; ++i) {
+        if (!keep[i]) continue;
+        append_plan_line(out, nodes[i], depth[i]);
+        size_t hidden = 0;
+        double hidden_ms = 0;
+        for (int c = nodes[i].first_child; c >= 0; c = nodes[c].next_sibling) {
+            if (keep[c]) continue;
+            hidden += subtree[c];
+            if (nodes[c].a_time_ms > 0) hidden_ms += nodes[c].a_time_ms;
+        }
+        if (hidden > 0) {
+            out << std::string((depth[i] + 1) * 2, ' ') << "... 省略" << hidden << "个节点";
+            if (hidden_ms > 0) out << "（合计耗时" << fmt_num(hidden_ms) << " ms）";
+            out << "\n";
+        }
+    }
+    return out.str();
+}
 
 DiagnosticReport analyze_plan(const InputData& input) {
+    return diagnose_plan(parse_plan(input.explain_result), input);
+}
+
+DiagnosticReport diagnose_plan(PlanTree plan_tree, const InputData& input) {
     DiagnosticReport report;
-    report.summary = "[诊断报告] SQL长度:" + std::to_string(input.sql.size()) + ", EXPLAIN长度:" + std::to_string(input.explain_result.size());
+    report.plan.nodes.swap(plan_tree.nodes);
+    report.plan.total_runtime_ms = plan_tree.total_runtime_ms;
+    report.plan.analyzed = plan_tree.analyzed;
+    report.hottest_node = -1;
+    report.performance_score = 100;
+    const PlanTree& plan = report.plan;
+    if (plan.nodes.empty()) {
+        report.summary = "[诊断报告] 未能从执行计划中识别出算子，SQL长度:" + std::to_string(input.sql.size()) +
+                         ", EXPLAIN长度:" + std::to_string(input.explain_result.size());
+        return report;
+    }
+
+    // 1. 行数估算偏差
+    std::vector<std::pair<double, int> > skews;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        double skew = skew_of(plan.nodes[i]);
+        if (skew >= kSkewRatio) skews.push_back(std::make_pair(skew, static_cast<int>(i)));
+    }
+    std::sort(skews.begin(), skews.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+        return a.first > b.first;
+    });
+    for (size_t i = 0; i < skews.size() && i < kMaxReportedSkews; ++i) {
+        const PlanNode& n = plan.nodes[skews[i].second];
+        report.issues.push_back("行数估算偏差：" + node_label(n) + " E-rows=" + fmt_num(n.e_rows, 0) +
+                                " A-rows=" + fmt_num(n.a_rows, 0) + "（偏差" + fmt_num(skews[i].first, 1) + "倍）");
+    }
+    if (!skews.empty()) {
+        report.suggestions.push_back("对偏差节点涉及的表执行ANALYZE，必要时提高default_statistics_target或收集多列统计信息");
+        report.performance_score -= std::min<double>(20, 5.0 * skews.size());
+    }
+
+    // 2. 最耗时算子
+    double total = plan.total_runtime_ms > 0 ? plan.total_runtime_ms : 0;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (n.self_time_ms < 0) continue;
+        if (report.hottest_node < 0 || n.self_time_ms > plan.nodes[report.hottest_node].self_time_ms) {
+            report.hottest_node = static_cast<int>(i);
+        }
+    }
+    if (report.hottest_node >= 0) {
+        const PlanNode& hot = plan.nodes[report.hottest_node];
+        double share = total > 0 ? hot.self_time_ms / total : 0;
+        report.bottleneck_analysis = "最耗时算子：" + node_label(hot) + "，自身耗时" + fmt_num(hot.self_time_ms) + " ms";
+        if (total > 0) report.bottleneck_analysis += "，占总耗时" + fmt_num(share * 100, 1) + "%";
+        if (share >= kHotspotShare) {
+            report.issues.push_back("耗时热点：" + report.bottleneck_analysis);
+            report.performance_score -= 10;
+        }
+    }
+
+    // 3. 下盘
+    int spills = 0;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (!n.spilled) continue;
+        std::string msg = "算子下盘：" + node_label(n);
+        if (n.peak_memory_kb >= 0) msg += "，峰值内存" + fmt_num(n.peak_memory_kb, 0) + "KB";
+        report.issues.push_back(msg);
+        ++spills;
+    }
+    if (spills > 0) {
+        report.suggestions.push_back("存在Sort/Hash下盘，建议适当调大work_mem或减少参与排序/哈希的数据量");
+        report.performance_score -= std::min(30, 10 * spills);
+    }
+
+    // 4. 广播
+    int broadcasts = 0;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (!is_big_broadcast(n)) continue;
+        double rows = n.a_rows >= 0 ? n.a_rows : n.e_rows;
+        report.issues.push_back("大数据量广播：" + node_label(n) + " 广播行数" + fmt_num(rows, 0));
+        ++broadcasts;
+    }
+    if (broadcasts > 0) {
+        report.suggestions.push_back("存在大表广播，建议检查连接列与分布键，必要时用hint改为redistribute");
+        report.performance_score -= std::min(30, 10 * broadcasts);
+    }
+    if (report.performance_score < 0) report.performance_score = 0;
+
+    std::ostringstream oss;
+    oss << "[诊断报告] 解析算子" << plan.nodes.size() << "个";
+    if (total > 0) oss << "，总耗时" << fmt_num(total) << " ms";
+    if (!plan.analyzed) oss << "（计划不含实际执行信息）";
+    oss << "，发现问题" << report.issues.size() << "个，性能评分" << fmt_num(report.performance_score, 0);
+    report.summary = oss.str();
     return report;
 }
@@ -0,0 +1,247 @@
+#include "plan_diff.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// 预期提升达到该比例即视为"达到预期"
+const double kExpectationTolerance = 0.8;
+
+// 耗时变化不足该值（ms）且算子未变的节点，在限量输出时不列出
+const double kNegligibleDeltaMs = 1.0;
+
+std::string fmt_num(double v, int precision = 2) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(precision) << v;
+    return oss.str();
+}
+
+std::string fmt_memory(double kb) {
+    if (kb < 0) return "-";
+    if (kb >= 1024 * 1024) return fmt_num(kb / 1024 / 1024, 1) + "GB";
+    if (kb >= 1024) return fmt_num(kb / 1024, 1) + "MB";
+    return fmt_num(kb, 0) + "KB";
+}
+
+double total_ms(const PlanTree& plan) {
+    if (plan.total_runtime_ms > 0) return plan.total_runtime_ms;
+    return plan.nodes.empty() ? -1 : plan.nodes[0].a_time_ms;
+}
+
+std::vector<int> children_of(const PlanTree& plan, int i) {
+    std::vector<int> out;
+    for (int c = plan.nodes[i].first_child; c >= 0; c = plan.nodes[c].next_sibling) out.push_back(c);
+    return out;
+}
+
+bool same_operator(const PlanNode& a, const PlanNode& b) {
+    if (a.kind != b.kind || a.stream != b.stream) return false;
+    if (a.relation.size != b.relation.size) return false;
+    if (a.kind == OperatorKind::Other || a.kind == OperatorKind::Unknown) {
+        // 未归类的算子比较描述文本的首个单词
+        Utils::StrRef x = a.operation.trimmed(), y = b.operation.trimmed();
+        size_t nx = x.find(" "), ny = y.find(" ");
+        if (x.substr(0, nx).str() != y.substr(0, ny).str()) return false;
+    }
+    return a.relation.str() == b.relation.str();
+}
+
+struct Aligner {
+    const PlanTree& before;
+    const PlanTree& after;
+    std::vector<int> match_before;   // before下标 -> after下标
+    std::vector<int> match_after;    // after下标 -> before下标
+
+    Aligner(const PlanTree& b, const PlanTree& a)
+        : before(b), after(a), match_before(b.nodes.size(), -1), match_after(a.nodes.size(), -1) {}
+
+    void pair(int b, int a) {
+        match_before[b] = a;
+        match_after[a] = b;
+    }
+
+    // 对齐一对已匹配节点的子节点序列，并递归
+    void align(int b, int a) {
+        pair(b, a);
+        std::vector<int> cb = children_of(before, b), ca = children_of(after, a);
+        size_t n = cb.size(), m = ca.size();
+        // 最长公共子序列（子节点数很少，直接DP）
+        std::vector<std::vector<int> > dp(n + 1, std::vector<int>(m + 1, 0));
+        for (size_t i = n; i-- > 0;) {
+            for (size_t j = m; j-- > 0;) {
+                dp[i][j] = same_operator(before.nodes[cb[i]], after.nodes[ca[j]]) ? dp[i + 1][j + 1] + 1
+                                                                                  : std::max(dp[i + 1][j], dp[i][j + 1]);
+            }
+        }
+        size_t i = 0, j = 0, gap_i = 0, gap_j = 0;
+        while (i < n && j < m) {
+            if (same_operator(before.nodes[cb[i]], after.nodes[ca[j]]) && dp[i][j] == dp[i + 1][j + 1] + 1) {
+                align_gap(cb, gap_i, i, ca, gap_j, j);
+                align(cb[i], ca[j]);
+                gap_i = ++i;
+                gap_j = ++j;
+            } else if (dp[i + 1][j] >= dp[i][j + 1]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+        align_gap(cb, gap_i, n, ca, gap_j, m);
+    }
+
+    // 两个锚点之间未匹配的子节点：数量相等时按位置对应（算子被替换）
+    void align_gap(const std::vector<int>& cb, size_t bi, size_t be, const std::vector<int>& ca, size_t ai, size_t ae) {
+        if (be - bi != ae - ai) return;
+        for (size_t k = 0; k < be - bi; ++k) align(cb[bi + k], ca[ai + k]);
+    }
+
+    // 结构调整后仍可按表名对应的扫描节点
+    void pair_by_relation() {
+        for (size_t a = 0; a < after.nodes.size(); ++a) {
+            if (match_after[a] >= 0 || after.nodes[a].relation.empty()) continue;
+            for (size_t b = 0; b < before.nodes.size(); ++b) {
+                if (match_before[b] >= 0 || before.nodes[b].relation.str() != after.nodes[a].relation.str()) continue;
+                pair(static_cast<int>(b), static_cast<int>(a));
+                break;
+            }
+        }
+    }
+};
+
+std::string delta_text(double before, double after, int precision, const char* unit) {
+    if (before < 0 && after < 0) return "-";
+    std::string out = (before < 0 ? "-" : fmt_num(before, precision) + unit) + "→" +
+                      (after < 0 ? "-" : fmt_num(after, precision) + unit);
+    if (before >= 0 && after >= 0) {
+        double d = after - before;
+        // 变化小于显示精度时不标注
+        if (std::fabs(d) >= 0.5 * std::pow(10.0, -precision)) {
+            out += "（" + std::string(d > 0 ? "+" : "") + fmt_num(d, precision) + "）";
+        }
+    }
+    return out;
+}
+
+std::string node_name(const PlanNode& n) {
+    return std::to_string(n.id) + " " + n.operation.str();
+}
+
+double self_ms(const PlanTree& plan, int i) {
+    return i < 0 ? -1 : plan.nodes[i].self_time_ms;
+}
+
+// 节点的耗时变化量，用于排序
+double time_delta(const PlanTree& before, const PlanTree& after, const NodeDiff& d) {
+    double b = std::max(0.0, self_ms(before, d.before)), a = std::max(0.0, self_ms(after, d.after));
+    return std::fabs(a - b);
+}
+
+} // namespace
+
+PlanDiff diff_plans(const PlanTree& before, const PlanTree& after) {
+    PlanDiff diff;
+    diff.before_ms = total_ms(before);
+    diff.after_ms = total_ms(after);
+    if (diff.has_timing()) {
+        diff.speedup = diff.before_ms / diff.after_ms;
+        diff.improvement_pct = (diff.before_ms - diff.after_ms) / diff.before_ms * 100;
+    }
+    if (before.nodes.empty() && after.nodes.empty()) return diff;
+
+    Aligner aligner(before, after);
+    if (!before.nodes.empty() && !after.nodes.empty()) {
+        aligner.align(0, 0);
+        aligner.pair_by_relation();
+    }
+    for (size_t a = 0; a < after.nodes.size(); ++a) {
+        NodeDiff d;
+        d.after = static_cast<int>(a);
+        d.before = aligner.match_after[a];
+        if (d.before < 0) {
+            d.status = DiffStatus::Added;
+            ++diff.added;
+        } else if (same_operator(before.nodes[d.before], after.nodes[a])) {
+            d.status = DiffStatus::Same;
+            ++diff.same;
+        } else {
+            d.status = DiffStatus::Changed;
+            ++diff.changed;
+        }
+        diff.nodes.push_back(d);
+    }
+    for (size_t b = 0; b < before.nodes.size(); ++b) {
+        if (aligner.match_before[b] >= 0) continue;
+        NodeDiff d;
+        d.before = static_cast<int>(b);
+        d.after = -1;
+        d.status = DiffStatus::Removed;
+        ++diff.removed;
+        diff.nodes.push_back(d);
+    }
+    return diff;
+}
+
+std::string check_improvement(const PlanDiff& diff, double expected_pct, bool* met) {
+    if (met) *met = false;
+    if (!diff.has_timing()) return "缺少总耗时，无法核对预期提升";
+    std::string actual = diff.improvement_pct >= 0 ? "实际耗时降低" + fmt_num(diff.improvement_pct, 1) + "%"
+                                                   : "实际耗时增加" + fmt_num(-diff.improvement_pct, 1) + "%";
+    if (expected_pct <= 0) return actual + "（未给出预期提升）";
+    bool ok = diff.improvement_pct >= expected_pct * kExpectationTolerance;
+    if (met) *met = ok;
+    std::string verdict = ok ? "达到预期" : (diff.improvement_pct > 0 ? "未达预期" : "性能未改善");
+    return "预期提升约" + fmt_num(expected_pct, 0) + "%，" + actual + "，" + verdict;
+}
+
+std::string format_plan_diff(const PlanDiff& diff, const PlanTree& before, const PlanTree& after, size_t max_nodes) {
+    std::ostringstream out;
+    out << "[计划对比] ";
+    if (diff.has_timing()) {
+        out << "总耗时 " << fmt_num(diff.before_ms) << " ms → " << fmt_num(diff.after_ms) << " ms，加速"
+            << fmt_num(diff.speedup) << "倍（" << (diff.improvement_pct >= 0 ? "降低" : "增加")
+            << fmt_num(std::fabs(diff.improvement_pct), 1) << "%）";
+    } else {
+        out << "缺少总耗时";
+    }
+    out << "；算子 相同" << diff.same << " 变化" << diff.changed << " 新增" << diff.added << " 删除" << diff.removed
+        << "\n";
+
+    // 限量输出时按耗时变化排序，并略去耗时几乎不变的相同算子
+    std::vector<NodeDiff> rows = diff.nodes;
+    if (max_nodes > 0) {
+        std::stable_sort(rows.begin(), rows.end(), [&](const NodeDiff& x, const NodeDiff& y) {
+            return time_delta(before, after, x) > time_delta(before, after, y);
+        });
+        std::vector<NodeDiff> kept;
+        for (size_t i = 0; i < rows.size() && kept.size() < max_nodes; ++i) {
+            if (rows[i].status == DiffStatus::Same && time_delta(before, after, rows[i]) < kNegligibleDeltaMs) continue;
+            kept.push_back(rows[i]);
+        }
+        rows.swap(kept);
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const NodeDiff& d = rows[i];
+        const PlanNode* b = d.before >= 0 ? &before.nodes[d.before] : nullptr;
+        const PlanNode* a = d.after >= 0 ? &after.nodes[d.after] : nullptr;
+        switch (d.status) {
+        case DiffStatus::Same: out << "  [相同] " << node_name(*a); break;
+        case DiffStatus::Changed: out << "  [变化] " << node_name(*b) << " → " << node_name(*a); break;
+        case DiffStatus::Added: out << "  [新增] " << node_name(*a); break;
+        case DiffStatus::Removed: out << "  [删除] " << node_name(*b); break;
+        }
+        out << " | A-time " << delta_text(b ? b->a_time_ms : -1, a ? a->a_time_ms : -1, 2, "ms")
+            << " | 自身 " << delta_text(b ? b->self_time_ms : -1, a ? a->self_time_ms : -1, 2, "ms")
+            << " | A-rows " << delta_text(b ? b->a_rows : -1, a ? a->a_rows : -1, 0, "");
+        double mb = b ? b->peak_memory_kb : -1, ma = a ? a->peak_memory_kb : -1;
+        if (mb >= 0 || ma >= 0) out << " | 内存 " << fmt_memory(mb) << "→" << fmt_memory(ma);
+        if (b && a && b->spilled != a->spilled) out << (a->spilled ? " | 新增下盘" : " | 不再下盘");
+        else if (a && a->spilled) out << " | 仍下盘";
+        out << "\n";
+    }
+    if (max_nodes > 0 && rows.size() < diff.nodes.size()) {
+        out << "  （其余" << diff.nodes.size() - rows.size() << "个节点耗时变化不明显，已省略）\n";
+    }
+    return out.str();
+}
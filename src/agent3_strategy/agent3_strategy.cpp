@@ -1,21 +1,428 @@
 #include <agent3_strategy.h>
+#include <algorithm>
 #include <sstream>
+#include <iomanip>
+
+using Utils::StrRef;
+
+namespace {
+
+// 规则阈值
+const double kEstimateSkewRatio = 100.0;     // 连接/聚合等节点的估算偏差倍数
+const double kScanSkewRatio = 10.0;          // 扫描节点的估算偏差倍数（统计信息缺失/过期）
+const double kMinRows = 1000.0;              // 行数过小时不判断偏差
+const double kSeqScanMinRows = 100000.0;     // 全表扫描的最少扫描行数
+const double kSelectiveFilter = 0.05;        // 过滤后保留比例不高于该值视为高选择性
+const double kNestLoopRows = 10000.0;        // 嵌套循环两侧的行数阈值
+const double kStreamSkewSpread = 3.0;        // 重分布各DN耗时最大/最小比
+const double kStreamSkewMinMs = 100.0;       // 重分布倾斜的最小耗时
+const double kMaxImprovement = 90.0;         // 预期提升上限（%）
+
+// 提示词压缩
+const size_t kTokensPerPlanLine = 40;        // 压缩计划中每个节点行的估算token数
+const size_t kMinCompactNodes = 16;          // 压缩计划至少保留的节点数
+
+struct NamedRule {
+    std::string name;
+    PlanRule rule;
+};
+
+double rows_of(const PlanNode& n) {
+    return n.a_rows >= 0 ? n.a_rows : n.e_rows;
+}
+
+double skew_ratio(const PlanNode& n) {
+    if (n.a_rows < 0 || n.e_rows < 0) return 1;
+    double hi = std::max(n.a_rows, n.e_rows), lo = std::max(std::min(n.a_rows, n.e_rows), 1.0);
+    return hi < kMinRows ? 1 : hi / lo;
+}
+
+bool is_scan(const PlanNode& n) {
+    return n.kind == OperatorKind::SeqScan || n.kind == OperatorKind::IndexScan || n.kind == OperatorKind::BitmapScan;
+}
+
+std::string fmt_num(double v, int precision) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(precision) << v;
+    return oss.str();
+}
+
+std::string label(const PlanNode& n) {
+    return "节点" + std::to_string(n.id) + " " + n.operation.str();
+}
+
+// 收集子树中扫描到的表
+void subtree_relations(const PlanTree& plan, int index, std::vector<std::string>& out) {
+    const PlanNode& n = plan.nodes[index];
+    if (!n.relation.empty()) {
+        std::string rel = n.relation.str();
+        if (std::find(out.begin(), out.end(), rel) == out.end()) out.push_back(rel);
+    }
+    for (int c = n.first_child; c >= 0; c = plan.nodes[c].next_sibling) subtree_relations(plan, c, out);
+}
+
+bool is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_ident_char(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9') || c == '$' || c == '.';
+}
+
+bool is_filter_keyword(const std::string& w) {
+    static const char* const kWords[] = {
+        "and", "or", "not", "null", "is", "in", "like", "ilike", "between", "true", "false",
+        "any", "all", "some", "case", "when", "then", "else", "end", "subplan", "hashed", "exists"
+    };
+    std::string lower = Utils::to_lower(w);
+    for (size_t i = 0; i < sizeof(kWords) / sizeof(kWords[0]); ++i) {
+        if (lower == kWords[i]) return true;
+    }
+    return false;
+}
+
+// 从过滤条件中提取列名，如 "(o_orderdate < '1995-03-15'::date)" -> o_orderdate
+std::vector<std::string> filter_columns(StrRef filter, size_t limit) {
+    std::vector<std::string> cols;
+    size_t i = 0;
+    while (i < filter.size && cols.size() < limit) {
+        char c = filter[i];
+        if (c == '\'') {
+            ++i;
+            while (i < filter.size && filter[i] != '\'') ++i;
+            ++i;
+            continue;
+        }
+        if (!is_ident_start(c)) {
+            ++i;
+            continue;
+        }
+        size_t b = i;
+        while (i < filter.size && is_ident_char(filter[i])) ++i;
+        bool cast = b >= 2 && filter[b - 1] == ':' && filter[b - 2] == ':';
+        bool func = i < filter.size && filter[i] == '(';
+        std::string word = filter.substr(b, i - b).str();
+        size_t dot = word.rfind('.');
+        if (dot != std::string::npos) word = word.substr(dot + 1);
+        if (cast || func || word.empty() || is_filter_keyword(word)) continue;
+        if (std::find(cols.begin(), cols.end(), word) == cols.end()) cols.push_back(word);
+    }
+    return cols;
+}
+
+void push_unique(std::vector<std::string>& v, const std::string& s) {
+    if (std::find(v.begin(), v.end(), s) == v.end()) v.push_back(s);
+}
+
+std::string bare_table(const std::string& name) {
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(dot + 1);
+}
+
+// 已有索引的前导列覆盖建议的索引列时返回该索引，否则返回nullptr
+const IndexInfo* covering_index(const std::string& hint, const std::vector<IndexInfo>& existing) {
+    IndexInfo wanted;
+    if (!parse_index_definition(hint, wanted)) return nullptr;
+    for (size_t i = 0; i < existing.size(); ++i) {
+        const IndexInfo& idx = existing[i];
+        if (bare_table(idx.table) != bare_table(wanted.table) || idx.columns.size() < wanted.columns.size()) continue;
+        if (std::equal(wanted.columns.begin(), wanted.columns.end(), idx.columns.begin())) return &idx;
+    }
+    return nullptr;
+}
+
+// 规则1：扫描节点估算偏差大，多为统计信息缺失或过期
+void rule_missing_analyze(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (!is_scan(n) || n.relation.empty() || skew_ratio(n) < kScanSkewRatio) continue;
+        RuleFinding f;
+        f.rule = "missing_analyze";
+        f.node = static_cast<int>(i);
+        f.message = label(n) + " 估算行数" + fmt_num(n.e_rows, 0) + "，实际" + fmt_num(n.a_rows, 0) +
+                    "，表统计信息可能缺失或过期";
+        f.param_hints.push_back("ANALYZE " + n.relation.str() + ";");
+        if (n.has_filter) {
+            f.param_hints.push_back("SET default_statistics_target = 1000;  -- 过滤列分布不均时提高采样精度");
+        }
+        f.saved_ms = n.self_time_ms > 0 ? n.self_time_ms * 0.2 : 0;
+        out.push_back(f);
+    }
+}
+
+// 规则2：非扫描节点估算偏差 >= 100倍，且偏差源自本节点（子节点估算正常）
+void rule_estimate_skew(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (is_scan(n) || n.kind == OperatorKind::Streaming || skew_ratio(n) < kEstimateSkewRatio) continue;
+        bool inherited = false;
+        for (int c = n.first_child; c >= 0; c = plan.nodes[c].next_sibling) {
+            if (skew_ratio(plan.nodes[c]) >= kScanSkewRatio) inherited = true;
+        }
+        if (inherited) continue;
+        std::vector<std::string> rels;
+        subtree_relations(plan, static_cast<int>(i), rels);
+        RuleFinding f;
+        f.rule = "estimate_skew";
+        f.node = static_cast<int>(i);
+        f.message = label(n) + " E-rows=" + fmt_num(n.e_rows, 0) + " A-rows=" + fmt_num(n.a_rows, 0) + "（偏差" +
+                    fmt_num(skew_ratio(n), 0) + "倍），连接/过滤选择率估算失真，可收集多列统计信息或用rows hint校正基数";
+        for (size_t r = 0; r < rels.size(); ++r) f.param_hints.push_back("ANALYZE " + rels[r] + ";");
+        f.saved_ms = n.self_time_ms > 0 ? n.self_time_ms * 0.3 : 0;
+        out.push_back(f);
+    }
+}
+
+// 规则3：高选择性过滤条件上的全表扫描
+void rule_seqscan_filter(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (n.kind != OperatorKind::SeqScan || !n.has_filter || n.relation.empty() || n.a_rows < 0) continue;
+        double removed = n.rows_removed > 0 ? n.rows_removed : 0;
+        double scanned = n.a_rows + removed;
+        if (scanned < kSeqScanMinRows || n.a_rows / scanned > kSelectiveFilter) continue;
+        std::vector<std::string> cols = filter_columns(n.filter, 3);
+        if (cols.empty()) continue;
+        std::string table = n.relation.str();
+        std::string name = "idx_" + table;
+        std::string list;
+        for (size_t c = 0; c < cols.size(); ++c) {
+            name += "_" + cols[c];
+            list += (c ? ", " : "") + cols[c];
+        }
+        std::replace(name.begin(), name.end(), '.', '_');
+        RuleFinding f;
+        f.rule = "seqscan_filter";
+        f.node = static_cast<int>(i);
+        f.message = label(n) + " 扫描" + fmt_num(scanned, 0) + "行仅保留" + fmt_num(n.a_rows, 0) +
+                    "行（" + fmt_num(n.a_rows / scanned * 100, 2) + "%），建议在过滤列上建索引";
+        f.index_hints.push_back("CREATE INDEX " + name + " ON " + table + "(" + list + ");");
+        f.saved_ms = n.self_time_ms > 0 ? n.self_time_ms * 0.8 : 0;
+        out.push_back(f);
+    }
+}
+
+// 规则4：大数据量上的嵌套循环
+void rule_large_nestloop(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (n.kind != OperatorKind::NestLoop || n.first_child < 0) continue;
+        int inner = plan.nodes[n.first_child].next_sibling;
+        if (inner < 0) continue;
+        double outer_rows = rows_of(plan.nodes[n.first_child]);
+        double inner_rows = rows_of(plan.nodes[inner]);
+        if (outer_rows < kNestLoopRows || (inner_rows < kNestLoopRows && outer_rows * inner_rows < kNestLoopRows * kNestLoopRows)) {
+            continue;
+        }
+        std::vector<std::string> rels;
+        subtree_relations(plan, static_cast<int>(i), rels);
+        RuleFinding f;
+        f.rule = "large_nestloop";
+        f.node = static_cast<int>(i);
+        f.message = label(n) + " 外表" + fmt_num(outer_rows, 0) + "行、内表" + fmt_num(inner_rows, 0) +
+                    "行，嵌套循环代价过高，建议改为Hash Join";
+        if (rels.size() >= 2) f.message += "，如 /*+ hashjoin(" + rels[0] + " " + rels[1] + ") */";
+        f.param_hints.push_back("SET enable_nestloop = off;");
+        f.saved_ms = n.a_time_ms > 0 ? n.a_time_ms * 0.6 : 0;
+        out.push_back(f);
+    }
+}
+
+// 规则5：Sort/Hash下盘
+void rule_spill(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    double need_kb = 0;
+    RuleFinding f;
+    f.rule = "spill";
+    f.node = -1;
+    f.saved_ms = 0;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (!n.spilled) continue;
+        if (f.node < 0) f.node = static_cast<int>(i);
+        f.message += (f.message.empty() ? "" : "；") + label(n) + " 发生下盘";
+        need_kb = std::max(need_kb, n.peak_memory_kb);
+        f.saved_ms += n.self_time_ms > 0 ? n.self_time_ms * 0.5 : 0;
+    }
+    if (f.node < 0) return;
+    // 按峰值内存的2倍取整到2的幂，至少64MB
+    double mb = 64;
+    while (mb < need_kb * 2 / 1024 && mb < 16384) mb *= 2;
+    f.message += "，建议调大work_mem";
+    f.param_hints.push_back("SET work_mem = '" + fmt_num(mb, 0) + "MB';");
+    out.push_back(f);
+}
+
+// 规则6：重分布数据倾斜（各DN耗时差异大）
+void rule_stream_skew(const PlanTree& plan, std::vector<RuleFinding>& out) {
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (n.stream != StreamKind::Redistribute && n.stream != StreamKind::LocalRedistribute) continue;
+        if (n.a_time_ms < kStreamSkewMinMs || n.a_time_min_ms < 0) continue;
+        double spread = n.a_time_ms / std::max(n.a_time_min_ms, 1.0);
+        if (spread < kStreamSkewSpread) continue;
+        RuleFinding f;
+        f.rule = "stream_skew";
+        f.node = static_cast<int>(i);
+        f.message = label(n) + " 各DN耗时" + fmt_num(n.a_time_min_ms, 1) + "~" + fmt_num(n.a_time_ms, 1) +
+                    " ms，重分布列存在数据倾斜，建议检查分布键或使用skew hint";
+        f.param_hints.push_back("SET skew_option = normal;");
+        f.saved_ms = (n.a_time_ms - n.a_time_min_ms) * 0.5;
+        out.push_back(f);
+    }
+}
+
+std::vector<NamedRule> builtin_rules() {
+    NamedRule builtins[] = {
+        { "missing_analyze", rule_missing_analyze },
+        { "estimate_skew", rule_estimate_skew },
+        { "seqscan_filter", rule_seqscan_filter },
+        { "large_nestloop", rule_large_nestloop },
+        { "spill", rule_spill },
+        { "stream_skew", rule_stream_skew }
+    };
+    return std::vector<NamedRule>(builtins, builtins + sizeof(builtins) / sizeof(builtins[0]));
+}
+
+std::vector<NamedRule>& rule_registry() {
+    static std::vector<NamedRule> rules = builtin_rules();
+    return rules;
+}
+
+} // namespace
+
+void register_rule(const std::string& name, const PlanRule& rule) {
+    NamedRule r = { name, rule };
+    rule_registry().push_back(r);
+}
+
+std::vector<RuleFinding> run_rules(const PlanTree& plan) {
+    std::vector<RuleFinding> findings;
+    if (plan.nodes.empty()) return findings;
+    const std::vector<NamedRule>& rules = rule_registry();
+    for (size_t i = 0; i < rules.size(); ++i) rules[i].rule(plan, findings);
+    return findings;
+}
 
 OptimizationStrategy generate_strategy(const EnrichedDiagnosticReport& enriched) {
     OptimizationStrategy strategy;
+    strategy.expected_improvement = 0;
+    strategy.from_rules = false;
+    const PlanTree& plan = enriched.base_report.plan;
+    std::vector<RuleFinding> findings = run_rules(plan);
+
     std::ostringstream oss;
     oss << "[建议] ";
-    if (enriched.base_report.summary.find("全表扫描") != std::string::npos) {
-        oss << "建议为相关表添加合适索引，或优化WHERE条件。";
-    } else if (enriched.base_report.summary.find("嵌套循环") != std::string::npos) {
-        oss << "建议优化JOIN顺序，或考虑并行查询。";
-    } else {
+    double saved_ms = 0;
+    for (size_t i = 0; i < findings.size(); ++i) {
+        const RuleFinding& f = findings[i];
+        oss << "\n" << (i + 1) << ". [" << f.rule << "] " << f.message;
+        for (size_t h = 0; h < f.index_hints.size(); ++h) {
+            // 统计信息快照显示索引已存在时不再建议，提示检查索引未被使用的原因
+            const IndexInfo* existing = covering_index(f.index_hints[h], enriched.existing_indexes);
+            if (existing) {
+                oss << "（已有索引 " << existing->name << " 覆盖该列但未被使用，请检查统计信息、类型转换或函数包裹）";
+                continue;
+            }
+            push_unique(strategy.index_hints, f.index_hints[h]);
+        }
+        for (size_t h = 0; h < f.param_hints.size(); ++h) push_unique(strategy.param_hints, f.param_hints[h]);
+        saved_ms += f.saved_ms;
+    }
+    if (findings.empty()) {
         oss << "可考虑增加索引或调整SQL结构。";
     }
     if (!enriched.user_knowledge.empty()) {
         oss << " 用户补充：" << enriched.user_knowledge;
     }
     strategy.suggestion = oss.str();
-    strategy.optimized_sql = "-- 优化建议SQL示例：\n-- 可在WHERE条件涉及的列上创建索引，如：\n-- CREATE INDEX idx_col ON table(col);";
+    strategy.from_rules = !strategy.index_hints.empty() || !strategy.param_hints.empty();
+    if (plan.total_runtime_ms > 0) {
+        strategy.expected_improvement = std::min(kMaxImprovement, saved_ms / plan.total_runtime_ms * 100);
+    }
+
+    if (!strategy.from_rules) {
+        strategy.optimized_sql = "-- 优化建议SQL示例：\n-- 可在WHERE条件涉及的列上创建索引，如：\n-- CREATE INDEX idx_col ON table(col);";
+        return strategy;
+    }
+    std::ostringstream sql;
+    sql << "-- 本地规则生成的优化脚本（原SQL保持不变，执行前请评估）\n";
+    for (size_t i = 0; i < strategy.param_hints.size(); ++i) sql << strategy.param_hints[i] << "\n";
+    for (size_t i = 0; i < strategy.index_hints.size(); ++i) sql << strategy.index_hints[i] << "\n";
+    strategy.optimized_sql = sql.str();
+
+    std::string risk;
+    if (!strategy.index_hints.empty()) risk += "新增索引会增加写入与存储开销；";
+    for (size_t i = 0; i < strategy.param_hints.size(); ++i) {
+        if (strategy.param_hints[i].find("work_mem") != std::string::npos) {
+            risk += "调大work_mem需结合并发数评估总内存；";
+            break;
+        }
+    }
+    for (size_t i = 0; i < strategy.param_hints.size(); ++i) {
+        if (strategy.param_hints[i].find("enable_nestloop") != std::string::npos) {
+            risk += "enable_nestloop仅建议会话级设置，避免影响其他查询；";
+            break;
+        }
+    }
+    strategy.risk_assessment = risk.empty() ? "低风险：仅涉及统计信息或会话级参数。" : risk;
     return strategy;
 }
+
+std::string build_ai_prompt(const InputData& input, const DiagnosticReport& diag, size_t plan_token_budget,
+                            const EnrichedDiagnosticReport* context) {
+    std::ostringstream prompt;
+    prompt << "你是GaussDB/TPCH数据库SQL优化专家，精通大规模数据分析、执行计划解读与GUC参数调优。请严格按照如下要求分析和优化：\n";
+    prompt << "【输入SQL】\n" << input.sql << "\n";
+    if (plan_token_budget > 0 && !diag.plan.nodes.empty() &&
+        Utils::estimate_tokens(input.explain_result) > plan_token_budget) {
+        size_t max_nodes = std::max<size_t>(kMinCompactNodes, plan_token_budget / kTokensPerPlanLine);
+        prompt << "【执行计划/分析结果】\n" << compact_plan(diag.plan, max_nodes) << "\n";
+    } else {
+        prompt << "【执行计划/分析结果】\n" << input.explain_result << "\n";
+    }
+    if (!diag.issues.empty()) {
+        prompt << "【本地预诊断结果】\n" << diag.summary << "\n";
+        if (!diag.bottleneck_analysis.empty()) prompt << diag.bottleneck_analysis << "\n";
+        for (size_t i = 0; i < diag.issues.size(); ++i) prompt << "- " << diag.issues[i] << "\n";
+    }
+    if (context && !context->known_facts.empty()) {
+        prompt << "【统计信息与参数（来自系统表快照，无需再向用户确认）】\n";
+        for (size_t i = 0; i < context->known_facts.size(); ++i) prompt << "- " << context->known_facts[i] << "\n";
+    }
+    if (context && !context->similar_cases.empty()) {
+        prompt << "【历史相似案例（已实测有效，供参考，需结合本次计划判断是否适用）】\n";
+        for (size_t i = 0; i < context->similar_cases.size(); ++i) {
+            prompt << i + 1 << ". " << context->similar_cases[i] << "\n";
+        }
+    }
+    if (context && !context->user_knowledge.empty()) {
+        prompt << "【用户补充信息】\n" << context->user_knowledge << "\n";
+    }
+    if (context && context->needs_more_info) {
+        prompt << "【尚未掌握的信息】\n";
+        for (size_t i = 0; i < context->questions.size(); ++i) prompt << "- " << context->questions[i] << "\n";
+    }
+    prompt << "【分析要求】\n";
+    prompt << "1. 详细解读执行计划中的每个关键节点（如Hash Join、Sort、Scan、Aggregate、Streaming等），指出耗时/高消耗/行数偏差的环节，并用表格或分点方式展示。\n";
+    prompt << "2. 结合A-time、A-rows、E-rows等指标，分析瓶颈和优化空间，尤其关注：\n";
+    prompt << "   - 行数估算严重偏差\n";
+    prompt << "   - 连接顺序与Join类型是否合理\n";
+    prompt << "   - 是否有不合理的全表扫描、数据倾斜、重复数据流转\n";
+    prompt << "   - GUC参数（如query_dop、work_mem、统计信息采样率等）对执行计划的影响\n";
+    prompt << "3. 给出专业的优化建议，包括但不限于：\n";
+    prompt << "   - SQL重写（如加hint、CTE、子查询、聚合下推、消除冗余等）\n";
+    prompt << "   - 建议的索引（普通索引、函数索引、分区、统计信息收集等）\n";
+    prompt << "   - GUC参数设置建议（如并行度、内存、采样率等）\n";
+    prompt << "   - 统计信息收集与分析（如analyze、default_statistics_target等）\n";
+    prompt << "   - 业务约束下的特殊优化（如必须保留模糊匹配、不能建索引等场景的权衡）\n";
+    prompt << "4. 输出优化后SQL（如需加hint、索引、参数等请直接体现在SQL中），并说明每一处优化的理由。\n";
+    prompt << "5. 如需用户补充信息（如表行数、索引、数据分布、业务约束、参数配置等），请明确提出具体问题，并说明补充这些信息的意义；上文已给出的统计信息与参数不要再问。\n";
+    prompt << "6. 输出结构建议：\n";
+    prompt << "   - # SQL优化分析报告\n";
+    prompt << "   - ## 1. 优化建议（分点详细说明）\n";
+    prompt << "   - ## 2. 优化后SQL（含注释）\n";
+    prompt << "   - ## 3. 需要用户补充的信息（如有，分点列出）\n";
+    prompt << "   - ## 4. 预期优化效果（如有数据可估算）\n";
+    prompt << "请用专业、简明、结构化的方式输出，避免泛泛而谈。";
+    return prompt.str();
+}
@@ -1,9 +1,748 @@
 #include "agent4_report.h"
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define report_open _open
+#define report_write ::_write
+#define report_close _close
+#else
+#include <unistd.h>
+#define report_open open
+#define report_write ::write
+#define report_close close
+#endif
+
+namespace {
+
+// 每线程复用的报告缓冲区大小
+const size_t kReportBufferSize = 64 * 1024;
+
+// 自身耗时占总耗时达到该比例即标为热点
+const double kHotShare = 0.2;
+
+const char* const kDefaultTitle = "SQL优化报告";
+
+// 估算偏差倍数（实际/估算取较大一方），未知返回-1
+double estimate_error(const PlanNode& n) {
+    if (n.a_rows < 0 || n.e_rows < 0) return -1;
+    double a = std::max(n.a_rows, 1.0), e = std::max(n.e_rows, 1.0);
+    return a > e ? a / e : e / a;
+}
+
+// 偏差热力等级：0 <2倍，1 <10倍，2 <100倍，3 ≥100倍，-1未知
+int heat_level(double error) {
+    if (error < 0) return -1;
+    if (error < 2) return 0;
+    if (error < 10) return 1;
+    if (error < 100) return 2;
+    return 3;
+}
+
+double plan_total_ms(const PlanTree& plan) {
+    if (plan.total_runtime_ms > 0) return plan.total_runtime_ms;
+    return plan.nodes.empty() ? -1 : plan.nodes[0].a_time_ms;
+}
+
+// 单个节点的标注
+struct NodeNote {
+    double share;   // 自身耗时占比，未知为-1
+    double error;   // 估算偏差倍数，未知为-1
+    int heat;
+    bool hot;
+    bool under;     // 实际行数多于估算（低估）
+};
+
+NodeNote note_of(const DiagnosticReport& diag, size_t i, double total) {
+    const PlanNode& n = diag.plan.nodes[i];
+    NodeNote note;
+    note.share = (total > 0 && n.self_time_ms >= 0) ? n.self_time_ms / total : -1;
+    note.error = estimate_error(n);
+    note.heat = heat_level(note.error);
+    note.hot = static_cast<int>(i) == diag.hottest_node || note.share >= kHotShare;
+    note.under = n.a_rows > n.e_rows;
+    return note;
+}
+
+// 各节点在树中的层级（nodes按先序存储，父节点总在子节点之前）
+std::vector<int> tree_levels(const PlanTree& plan) {
+    std::vector<int> levels(plan.nodes.size(), 0);
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        int p = plan.nodes[i].parent;
+        if (p >= 0 && static_cast<size_t>(p) < i) levels[i] = levels[p] + 1;
+    }
+    return levels;
+}
+
+// 写入文本，末尾无换行时补一个
+void write_line(ReportWriter& w, const std::string& text) {
+    w.write(text);
+    if (text.empty() || text[text.size() - 1] != '\n') w.put('\n');
+}
+
+bool has_plan(const ReportContent& c) {
+    return c.diag && !c.diag->plan.nodes.empty();
+}
+
+const char* title_of(const ReportContent& c) {
+    return c.title.empty() ? kDefaultTitle : c.title.c_str();
+}
+
+void write_rows(ReportWriter& w, double rows) {
+    if (rows < 0) w.put('-');
+    else w.write_fixed(rows, 0);
+}
+
+void write_error(ReportWriter& w, const NodeNote& note) {
+    if (note.error < 0) {
+        w.put('-');
+        return;
+    }
+    w.write_fixed(note.error, note.error < 10 ? 1 : 0);
+    w.write(note.error < 2 ? "x" : (note.under ? "x 低估" : "x 高估"));
+}
+
+void write_share(ReportWriter& w, double share) {
+    if (share < 0) {
+        w.put('-');
+        return;
+    }
+    w.write_fixed(share * 100, 1);
+    w.put('%');
+}
+
+// ---------- 纯文本 ----------
+
+void render_text(const ReportContent& c, ReportWriter& w) {
+    const OptimizationStrategy& s = *c.strategy;
+    w.write("\n===== 优化建议报告 =====\n");
+    w.write(s.suggestion);
+    w.put('\n');
+    if (has_plan(c)) {
+        const DiagnosticReport& d = *c.diag;
+        double total = plan_total_ms(d.plan);
+        std::vector<int> levels = tree_levels(d.plan);
+        w.write("\n===== 执行计划（*为耗时热点）=====\n");
+        for (size_t i = 0; i < d.plan.nodes.size(); ++i) {
+            const PlanNode& n = d.plan.nodes[i];
+            NodeNote note = note_of(d, i, total);
+            for (int k = 0; k < levels[i]; ++k) w.write("  ");
+            w.write(note.hot ? "* " : "  ");
+            w.write_int(n.id);
+            w.write(" ");
+            w.write(n.operation);
+            w.write("  自身 ");
+            if (n.self_time_ms < 0) w.put('-');
+            else w.write_fixed(n.self_time_ms, 2);
+            w.write(" ms (");
+            write_share(w, note.share);
+            w.write(")  行数 ");
+            write_rows(w, n.a_rows);
+            w.put('/');
+            write_rows(w, n.e_rows);
+            w.write("  偏差 ");
+            write_error(w, note);
+            w.put('\n');
+        }
+    }
+    if (!s.index_hints.empty()) {
+        w.write("\n===== 索引建议 =====\n");
+        for (size_t i = 0; i < s.index_hints.size(); ++i) {
+            w.write(s.index_hints[i]);
+            w.put('\n');
+        }
+    }
+    if (!s.param_hints.empty()) {
+        w.write("\n===== 参数/统计信息建议 =====\n");
+        for (size_t i = 0; i < s.param_hints.size(); ++i) {
+            w.write(s.param_hints[i]);
+            w.put('\n');
+        }
+    }
+    w.write("\n===== 优化后SQL =====\n");
+    w.write(s.optimized_sql);
+    w.put('\n');
+    if (c.ai_result && !c.ai_result->empty()) {
+        w.write("\n===== AI分析 =====\n");
+        w.write(*c.ai_result);
+        w.put('\n');
+    }
+    if (s.expected_improvement > 0) {
+        w.write("\n预期性能提升：约");
+        w.write_int(static_cast<long long>(s.expected_improvement));
+        w.write("%\n");
+    }
+    if (!s.risk_assessment.empty()) {
+        w.write("风险评估：");
+        w.write(s.risk_assessment);
+        w.put('\n');
+    }
+}
+
+// ---------- Markdown ----------
+
+const char* const kHeatMarks[] = {"🟢", "🟡", "🟠", "🔴"};
+
+void md_list(ReportWriter& w, const char* heading, const std::vector<std::string>& items) {
+    if (items.empty()) return;
+    w.write("\n## ");
+    w.write(heading);
+    w.write("\n\n");
+    for (size_t i = 0; i < items.size(); ++i) {
+        w.write("- ");
+        w.write(items[i]);
+        w.put('\n');
+    }
+}
+
+void md_code(ReportWriter& w, const char* heading, const std::vector<std::string>& lines) {
+    if (lines.empty()) return;
+    w.write("\n## ");
+    w.write(heading);
+    w.write("\n\n```sql\n");
+    for (size_t i = 0; i < lines.size(); ++i) {
+        w.write(lines[i]);
+        w.put('\n');
+    }
+    w.write("```\n");
+}
+
+void md_plan(const DiagnosticReport& d, ReportWriter& w) {
+    double total = plan_total_ms(d.plan);
+    std::vector<int> levels = tree_levels(d.plan);
+    w.write("\n## 执行计划\n\n🔥 耗时热点；估算偏差：🟢 <2倍 🟡 <10倍 🟠 <100倍 🔴 ≥100倍\n\n"
+            "| 节点 | 算子 | 自身耗时(ms) | 占比 | 实际行数 | 估算行数 | 估算偏差 |\n"
+            "|---:|---|---:|---:|---:|---:|---|\n");
+    for (size_t i = 0; i < d.plan.nodes.size(); ++i) {
+        const PlanNode& n = d.plan.nodes[i];
+        NodeNote note = note_of(d, i, total);
+        w.write("| ");
+        w.write_int(n.id);
+        w.write(" | ");
+        for (int k = 1; k < levels[i]; ++k) w.write("&emsp;");
+        if (levels[i] > 0) w.write("└ ");
+        if (note.hot) w.write("🔥 **");
+        w.write_escaped(n.operation, ReportFormat::Markdown);
+        if (note.hot) w.write("**");
+        if (n.spilled) w.write(" 💾");
+        w.write(" | ");
+        if (n.self_time_ms < 0) w.put('-');
+        else w.write_fixed(n.self_time_ms, 2);
+        w.write(" | ");
+        write_share(w, note.share);
+        w.write(" | ");
+        write_rows(w, n.a_rows);
+        w.write(" | ");
+        write_rows(w, n.e_rows);
+        w.write(" | ");
+        if (note.heat >= 0) {
+            w.write(kHeatMarks[note.heat]);
+            w.put(' ');
+        }
+        write_error(w, note);
+        w.write(" |\n");
+    }
+}
+
+void render_markdown(const ReportContent& c, ReportWriter& w) {
+    const OptimizationStrategy& s = *c.strategy;
+    w.write("# ");
+    w.write(title_of(c));
+    w.put('\n');
+    if (c.diag) {
+        w.write("\n> ");
+        w.write_escaped(c.diag->summary, ReportFormat::Markdown);
+        w.put('\n');
+        if (!c.diag->bottleneck_analysis.empty()) {
+            w.write(">\n> ");
+            w.write_escaped(c.diag->bottleneck_analysis, ReportFormat::Markdown);
+            w.put('\n');
+        }
+    }
+    if (c.input && !c.input->sql.empty()) {
+        w.write("\n## 原始SQL\n\n```sql\n");
+        write_line(w, c.input->sql);
+        w.write("```\n");
+    }
+    w.write("\n## 优化建议\n\n");
+    write_line(w, s.suggestion);
+    if (c.diag) md_list(w, "发现的问题", c.diag->issues);
+    if (has_plan(c)) md_plan(*c.diag, w);
+    md_code(w, "索引建议", s.index_hints);
+    md_list(w, "参数/统计信息建议", s.param_hints);
+    w.write("\n## 优化后SQL\n\n```sql\n");
+    write_line(w, s.optimized_sql);
+    w.write("```\n");
+    if (c.ai_result && !c.ai_result->empty()) {
+        w.write("\n## AI分析\n\n");
+        write_line(w, *c.ai_result);
+    }
+    if (s.expected_improvement > 0 || !s.risk_assessment.empty()) w.put('\n');
+    if (s.expected_improvement > 0) {
+        w.write("**预期性能提升**：约");
+        w.write_int(static_cast<long long>(s.expected_improvement));
+        w.write("%\n");
+    }
+    if (!s.risk_assessment.empty()) {
+        if (s.expected_improvement > 0) w.put('\n');
+        w.write("**风险评估**：");
+        w.write(s.risk_assessment);
+        w.put('\n');
+    }
+}
+
+// ---------- HTML ----------
+
+const char* const kHtmlHead =
+    "<!DOCTYPE html>\n<html lang=\"zh-CN\">\n<head>\n<meta charset=\"utf-8\">\n<title>";
+
+const char* const kHtmlStyle =
+    "</title>\n<style>\n"
+    "body{font-family:-apple-system,\"Segoe UI\",\"Microsoft YaHei\",sans-serif;margin:2em auto;max-width:1100px;"
+    "color:#222;line-height:1.5}\n"
+    "h1{border-bottom:2px solid #444}h2{margin-top:1.6em;border-bottom:1px solid #ccc}\n"
+    "pre{background:#f6f8fa;padding:.8em;overflow-x:auto;white-space:pre-wrap}\n"
+    ".summary{background:#eef4ff;padding:.6em 1em;border-left:4px solid #4a7bd0}\n"
+    "table{border-collapse:collapse;width:100%;font-size:13px}\n"
+    "th,td{border:1px solid #ddd;padding:3px 6px}th{background:#f0f0f0}td.n{text-align:right}\n"
+    "tr.hot td{font-weight:bold;background:#fff1e6}\n"
+    ".h0{background:#e6f4ea}.h1{background:#fff8db}.h2{background:#ffe2c6}.h3{background:#ffc9c9}\n"
+    ".legend span{padding:0 .6em;margin-right:.4em}\n"
+    "</style>\n</head>\n<body>\n";
+
+void html_section(ReportWriter& w, const char* heading) {
+    w.write("<h2>");
+    w.write(heading);
+    w.write("</h2>\n");
+}
+
+void html_pre(ReportWriter& w, const std::string& text, const char* cls) {
+    w.write("<pre class=\"");
+    w.write(cls);
+    w.write("\">");
+    w.write_escaped(text, ReportFormat::Html);
+    w.write("</pre>\n");
+}
+
+void html_list(ReportWriter& w, const char* heading, const std::vector<std::string>& items) {
+    if (items.empty()) return;
+    html_section(w, heading);
+    w.write("<ul>\n");
+    for (size_t i = 0; i < items.size(); ++i) {
+        w.write("<li>");
+        w.write_escaped(items[i], ReportFormat::Html);
+        w.write("</li>\n");
+    }
+    w.write("</ul>\n");
+}
+
+void html_plan(const DiagnosticReport& d, ReportWriter& w) {
+    double total = plan_total_ms(d.plan);
+    std::vector<int> levels = tree_levels(d.plan);
+    html_section(w, "执行计划");
+    w.write("<p class=\"legend\">加粗行为耗时热点；估算偏差：<span class=\"h0\">&lt;2倍</span>"
+            "<span class=\"h1\">&lt;10倍</span><span class=\"h2\">&lt;100倍</span><span class=\"h3\">≥100倍</span></p>\n"
+            "<table class=\"plan\">\n<tr><th>节点</th><th>算子</th><th>自身耗时(ms)</th><th>占比</th>"
+            "<th>实际行数</th><th>估算行数</th><th>估算偏差</th></tr>\n");
+    for (size_t i = 0; i < d.plan.nodes.size(); ++i) {
+        const PlanNode& n = d.plan.nodes[i];
+        NodeNote note = note_of(d, i, total);
+        w.write(note.hot ? "<tr class=\"hot\"><td class=\"n\">" : "<tr><td class=\"n\">");
+        w.write_int(n.id);
+        w.write("</td><td style=\"padding-left:");
+        w.write_int(6 + 16 * levels[i]);
+        w.write("px\">");
+        w.write_escaped(n.operation, ReportFormat::Html);
+        if (n.spilled) w.write(" <em>(下盘)</em>");
+        w.write("</td><td class=\"n\">");
+        if (n.self_time_ms < 0) w.put('-');
+        else w.write_fixed(n.self_time_ms, 2);
+        w.write("</td><td class=\"n\">");
+        write_share(w, note.share);
+        w.write("</td><td class=\"n\">");
+        write_rows(w, n.a_rows);
+        w.write("</td><td class=\"n\">");
+        write_rows(w, n.e_rows);
+        if (note.heat >= 0) {
+            w.write("</td><td class=\"h");
+            w.write_int(note.heat);
+            w.write("\">");
+        } else {
+            w.write("</td><td>");
+        }
+        write_error(w, note);
+        w.write("</td></tr>\n");
+    }
+    w.write("</table>\n");
+}
+
+void render_html(const ReportContent& c, ReportWriter& w) {
+    const OptimizationStrategy& s = *c.strategy;
+    w.write(kHtmlHead);
+    w.write_escaped(title_of(c), std::strlen(title_of(c)), ReportFormat::Html);
+    w.write(kHtmlStyle);
+    w.write("<h1>");
+    w.write_escaped(title_of(c), std::strlen(title_of(c)), ReportFormat::Html);
+    w.write("</h1>\n");
+    if (c.diag) {
+        w.write("<p class=\"summary\">");
+        w.write_escaped(c.diag->summary, ReportFormat::Html);
+        if (!c.diag->bottleneck_analysis.empty()) {
+            w.write("<br>");
+            w.write_escaped(c.diag->bottleneck_analysis, ReportFormat::Html);
+        }
+        w.write("</p>\n");
+    }
+    if (c.input && !c.input->sql.empty()) {
+        html_section(w, "原始SQL");
+        html_pre(w, c.input->sql, "sql");
+    }
+    html_section(w, "优化建议");
+    html_pre(w, s.suggestion, "text");
+    if (c.diag) html_list(w, "发现的问题", c.diag->issues);
+    if (has_plan(c)) html_plan(*c.diag, w);
+    html_list(w, "索引建议", s.index_hints);
+    html_list(w, "参数/统计信息建议", s.param_hints);
+    html_section(w, "优化后SQL");
+    html_pre(w, s.optimized_sql, "sql");
+    if (c.ai_result && !c.ai_result->empty()) {
+        html_section(w, "AI分析");
+        html_pre(w, *c.ai_result, "text");
+    }
+    if (s.expected_improvement > 0) {
+        w.write("<p><b>预期性能提升</b>：约");
+        w.write_int(static_cast<long long>(s.expected_improvement));
+        w.write("%</p>\n");
+    }
+    if (!s.risk_assessment.empty()) {
+        w.write("<p><b>风险评估</b>：");
+        w.write_escaped(s.risk_assessment, ReportFormat::Html);
+        w.write("</p>\n");
+    }
+    w.write("</body>\n</html>\n");
+}
+
+// ---------- JSON ----------
+
+void json_key(ReportWriter& w, const char* key, bool& first) {
+    if (!first) w.put(',');
+    first = false;
+    w.put('"');
+    w.write(key);
+    w.write("\":");
+}
+
+void json_string(ReportWriter& w, Utils::StrRef s) {
+    w.put('"');
+    w.write_escaped(s, ReportFormat::Json);
+    w.put('"');
+}
+
+// NaN/Inf等非法值写为null
+void json_number(ReportWriter& w, double v, int precision) {
+    if (std::isnan(v) || std::isinf(v)) w.write("null");
+    else w.write_fixed(v, precision);
+}
+
+void json_strings(ReportWriter& w, const std::vector<std::string>& items) {
+    w.put('[');
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) w.put(',');
+        json_string(w, items[i]);
+    }
+    w.put(']');
+}
+
+void json_plan(const DiagnosticReport& d, ReportWriter& w) {
+    double total = plan_total_ms(d.plan);
+    std::vector<int> levels = tree_levels(d.plan);
+    bool first = true;
+    w.put('{');
+    json_key(w, "total_runtime_ms", first);
+    json_number(w, total, 3);
+    json_key(w, "hottest_node", first);
+    bool has_hottest = d.hottest_node >= 0 && static_cast<size_t>(d.hottest_node) < d.plan.nodes.size();
+    w.write_int(has_hottest ? d.plan.nodes[d.hottest_node].id : -1);
+    json_key(w, "nodes", first);
+    w.put('[');
+    for (size_t i = 0; i < d.plan.nodes.size(); ++i) {
+        const PlanNode& n = d.plan.nodes[i];
+        NodeNote note = note_of(d, i, total);
+        bool f = true;
+        if (i > 0) w.put(',');
+        w.put('{');
+        json_key(w, "id", f);
+        w.write_int(n.id);
+        json_key(w, "parent", f);
+        w.write_int(n.parent >= 0 ? d.plan.nodes[n.parent].id : -1);
+        json_key(w, "depth", f);
+        w.write_int(levels[i]);
+        json_key(w, "operation", f);
+        json_string(w, n.operation);
+        if (!n.relation.empty()) {
+            json_key(w, "relation", f);
+            json_string(w, n.relation);
+        }
+        json_key(w, "self_time_ms", f);
+        json_number(w, n.self_time_ms, 3);
+        json_key(w, "share", f);
+        json_number(w, note.share, 4);
+        json_key(w, "a_rows", f);
+        json_number(w, n.a_rows, 0);
+        json_key(w, "e_rows", f);
+        json_number(w, n.e_rows, 0);
+        json_key(w, "estimate_error", f);
+        json_number(w, note.error, 2);
+        json_key(w, "heat", f);
+        w.write_int(note.heat);
+        json_key(w, "hot", f);
+        w.write(note.hot ? "true" : "false");
+        json_key(w, "spilled", f);
+        w.write(n.spilled ? "true" : "false");
+        w.put('}');
+    }
+    w.write("]}");
+}
+
+void render_json(const ReportContent& c, ReportWriter& w) {
+    const OptimizationStrategy& s = *c.strategy;
+    bool first = true;
+    w.put('{');
+    json_key(w, "title", first);
+    json_string(w, Utils::StrRef(title_of(c), std::strlen(title_of(c))));
+    if (c.input) {
+        json_key(w, "sql", first);
+        json_string(w, c.input->sql);
+    }
+    if (c.diag) {
+        json_key(w, "summary", first);
+        json_string(w, c.diag->summary);
+        json_key(w, "performance_score", first);
+        json_number(w, c.diag->performance_score, 1);
+        json_key(w, "bottleneck", first);
+        json_string(w, c.diag->bottleneck_analysis);
+        json_key(w, "issues", first);
+        json_strings(w, c.diag->issues);
+    }
+    json_key(w, "suggestion", first);
+    json_string(w, s.suggestion);
+    json_key(w, "index_hints", first);
+    json_strings(w, s.index_hints);
+    json_key(w, "param_hints", first);
+    json_strings(w, s.param_hints);
+    json_key(w, "optimized_sql", first);
+    json_string(w, s.optimized_sql);
+    json_key(w, "expected_improvement", first);
+    json_number(w, s.expected_improvement, 1);
+    json_key(w, "risk_assessment", first);
+    json_string(w, s.risk_assessment);
+    json_key(w, "source", first);
+    w.write(s.from_rules ? "\"rules\"" : "\"local\"");
+    if (c.ai_result && !c.ai_result->empty()) {
+        json_key(w, "ai_result", first);
+        json_string(w, *c.ai_result);
+    }
+    if (has_plan(c)) {
+        json_key(w, "plan", first);
+        json_plan(*c.diag, w);
+    }
+    w.write("}\n");
+}
+
+} // namespace
+
+bool parse_report_format(const std::string& name, ReportFormat& format) {
+    if (name == "text" || name == "txt") format = ReportFormat::Text;
+    else if (name == "md" || name == "markdown") format = ReportFormat::Markdown;
+    else if (name == "html" || name == "htm") format = ReportFormat::Html;
+    else if (name == "json") format = ReportFormat::Json;
+    else return false;
+    return true;
+}
+
+const char* report_extension(ReportFormat format) {
+    switch (format) {
+    case ReportFormat::Markdown: return "md";
+    case ReportFormat::Html: return "html";
+    case ReportFormat::Json: return "json";
+    default: return "txt";
+    }
+}
+
+ReportWriter::ReportWriter(char* buffer, size_t capacity, int fd)
+    : buffer_(buffer), capacity_(capacity), used_(0), fd_(fd), out_(nullptr), total_(0), truncated_(false),
+      failed_(false) {}
+
+ReportWriter::ReportWriter(std::string* out)
+    : buffer_(nullptr), capacity_(0), used_(0), fd_(-1), out_(out), total_(0), truncated_(false), failed_(false) {}
+
+ReportWriter::~ReportWriter() {
+    flush();
+}
+
+void ReportWriter::write(const char* data, size_t n) {
+    total_ += n;
+    if (out_) {
+        out_->append(data, n);
+        return;
+    }
+    while (n > 0) {
+        if (used_ == capacity_) {
+            if (fd_ < 0 || !flush()) {
+                truncated_ = true;
+                return;
+            }
+        }
+        size_t k = std::min(n, capacity_ - used_);
+        std::memcpy(buffer_ + used_, data, k);
+        used_ += k;
+        data += k;
+        n -= k;
+    }
+}
+
+void ReportWriter::write(const char* s) {
+    write(s, std::strlen(s));
+}
+
+void ReportWriter::put(char c) {
+    if (!out_ && used_ < capacity_) {
+        buffer_[used_++] = c;
+        ++total_;
+        return;
+    }
+    write(&c, 1);
+}
+
+void ReportWriter::write_int(long long v) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%lld", v);
+    write(tmp, static_cast<size_t>(n));
+}
+
+void ReportWriter::write_fixed(double v, int precision) {
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), "%.*f", precision, v);
+    if (n < 0) return;
+    write(tmp, std::min(static_cast<size_t>(n), sizeof(tmp) - 1));
+}
+
+void ReportWriter::write_escaped(const char* data, size_t n, ReportFormat format) {
+    // 连续无需转义的片段整段写入
+    size_t run = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        const char* rep = nullptr;
+        char hex[8];
+        switch (format) {
+        case ReportFormat::Html:
+            if (c == '&') rep = "&amp;";
+            else if (c == '<') rep = "&lt;";
+            else if (c == '>') rep = "&gt;";
+            else if (c == '"') rep = "&quot;";
+            break;
+        case ReportFormat::Json:
+            if (c == '"') rep = "\\\"";
+            else if (c == '\\') rep = "\\\\";
+            else if (c == '\n') rep = "\\n";
+            else if (c == '\r') rep = "\\r";
+            else if (c == '\t') rep = "\\t";
+            else if (c < 0x20) {
+                snprintf(hex, sizeof(hex), "\\u%04x", c);
+                rep = hex;
+            }
+            break;
+        case ReportFormat::Markdown:
+            if (c == '|') rep = "\\|";
+            else if (c == '\n') rep = "<br>";
+            else if (c == '\r') rep = "";
+            break;
+        default:
+            break;
+        }
+        if (!rep) continue;
+        write(data + run, i - run);
+        write(rep);
+        run = i + 1;
+    }
+    write(data + run, n - run);
+}
+
+bool ReportWriter::flush() {
+    if (fd_ < 0 || used_ == 0) return !failed_;
+    if (failed_) {
+        used_ = 0;
+        return false;
+    }
+    size_t done = 0;
+    while (done < used_) {
+        int n = static_cast<int>(report_write(fd_, buffer_ + done, static_cast<unsigned>(used_ - done)));
+        if (n <= 0) {
+            failed_ = true;
+            used_ = 0;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    used_ = 0;
+    return true;
+}
+
+void render_report(const ReportContent& content, ReportFormat format, ReportWriter& writer) {
+    if (!content.strategy) return;
+    switch (format) {
+    case ReportFormat::Markdown: render_markdown(content, writer); break;
+    case ReportFormat::Html: render_html(content, writer); break;
+    case ReportFormat::Json: render_json(content, writer); break;
+    default: render_text(content, writer); break;
+    }
+}
+
+bool write_report_file(const std::string& path, const ReportContent& content, ReportFormat format) {
+#ifdef _WIN32
+    int fd = report_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = report_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0) return false;
+    static thread_local std::vector<char> buffer(kReportBufferSize);
+    bool ok;
+    {
+        ReportWriter writer(buffer.data(), buffer.size(), fd);
+        render_report(content, format, writer);
+        ok = writer.flush();
+    }
+    return report_close(fd) == 0 && ok;
+}
 
 void output_report(const OptimizationStrategy& strategy) {
-    std::cout << "\n===== 优化建议报告 =====" << std::endl;
-    std::cout << strategy.suggestion << std::endl;
-    std::cout << "\n===== 优化后SQL =====" << std::endl;
-    std::cout << strategy.optimized_sql << std::endl;
+    std::cout.flush();
+    char buffer[4096];
+    ReportContent content;
+    content.strategy = &strategy;
+    ReportWriter writer(buffer, sizeof(buffer), fileno(stdout));
+    render_report(content, ReportFormat::Text, writer);
+    writer.flush();
+}
+
+std::string generate_html_report(const OptimizationStrategy& strategy) {
+    std::string out;
+    ReportContent content;
+    content.strategy = &strategy;
+    ReportWriter writer(&out);
+    render_report(content, ReportFormat::Html, writer);
+    return out;
+}
+
+std::string generate_markdown_report(const OptimizationStrategy& strategy) {
+    std::string out;
+    ReportContent content;
+    content.strategy = &strategy;
+    ReportWriter writer(&out);
+    render_report(content, ReportFormat::Markdown, writer);
+    return out;
 }
@@ -1,13 +1,238 @@
 #include "agent5_interactive.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include <string>
 
-bool need_user_interaction(const DiagnosticReport& report) {
-    // 简单逻辑：如果summary长度为偶数则需要交互
-    return report.summary.size() % 2 == 0;
+namespace {
+
+const size_t kMaxQuestions = 5;          // 一次最多提出的问题数
+const size_t kMaxFacts = 40;             // 写入提示词的已知事实上限
+const double kScanSkewRatio = 10.0;      // 扫描节点估算偏差倍数，超过时关注列分布与统计信息
+const double kStaleRatio = 10.0;         // reltuples 与计划中全表扫描实际行数相差该倍数以上视为统计信息过期
+
+// 快照中有值时列为已知事实的参数
+const char* const kFactGucs[] = {
+    "work_mem", "query_dop", "default_statistics_target", "enable_nestloop", "enable_hashjoin",
+    "enable_seqscan", "effective_cache_size", "random_page_cost", "max_process_memory"
+};
+
+std::string fmt_num(double v, int precision) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(precision) << v;
+    return oss.str();
+}
+
+std::string fmt_pct(double frac) {
+    return fmt_num(frac * 100, 1) + "%";
+}
+
+std::string bare(const std::string& name) {
+    size_t dot = name.rfind('.');
+    return Utils::to_lower(dot == std::string::npos ? name : name.substr(dot + 1));
+}
+
+double ratio(double a, double b) {
+    a = std::max(a, 1.0);
+    b = std::max(b, 1.0);
+    return a > b ? a / b : b / a;
+}
+
+bool is_scan(const PlanNode& n) {
+    return n.kind == OperatorKind::SeqScan || n.kind == OperatorKind::IndexScan || n.kind == OperatorKind::BitmapScan;
+}
+
+void push_unique(std::vector<std::string>& v, const std::string& s) {
+    if (std::find(v.begin(), v.end(), s) == v.end()) v.push_back(s);
+}
+
+// 执行计划中某张表的扫描情况
+struct TableScan {
+    double rows;        // 全表扫描得到的实际表行数，未知为-1
+    double skew;        // 扫描节点估算偏差的最大倍数
+    bool seqscan;       // 是否有全表扫描
+    bool scanned;       // 计划中是否出现
+
+    TableScan() : rows(-1), skew(1), seqscan(false), scanned(false) {}
+};
+
+TableScan scan_of(const PlanTree& plan, const std::string& table) {
+    TableScan s;
+    std::string name = bare(table);
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        const PlanNode& n = plan.nodes[i];
+        if (!is_scan(n) || n.relation.empty() || bare(n.relation.str()) != name) continue;
+        s.scanned = true;
+        if (n.kind == OperatorKind::SeqScan) s.seqscan = true;
+        if (n.a_rows >= 0 && !n.has_filter) s.rows = std::max(s.rows, n.a_rows);
+        // 带过滤的全表扫描：保留行数 + Rows Removed by Filter 即表行数
+        if (n.kind == OperatorKind::SeqScan && n.a_rows >= 0 && n.rows_removed > 0) {
+            s.rows = std::max(s.rows, n.a_rows + n.rows_removed);
+        }
+        if (n.a_rows >= 0 && n.e_rows >= 0) s.skew = std::max(s.skew, ratio(n.a_rows, n.e_rows));
+    }
+    return s;
+}
+
+// 列名 "表.列" 属于table时返回列名部分，否则返回空串
+std::string column_of(const std::string& column, const std::string& table) {
+    if (column.size() > table.size() + 1 && column.compare(0, table.size(), table) == 0 && column[table.size()] == '.') {
+        return column.substr(table.size() + 1);
+    }
+    return "";
+}
+
+std::string column_fact(const std::string& table, const ColumnStats& c, double reltuples) {
+    std::string out = "列 " + table + "." + c.name + "：";
+    if (c.n_distinct > 0) {
+        out += "不同值约" + fmt_num(c.n_distinct, 0) + "个";
+    } else if (c.n_distinct < 0) {
+        out += "不同值约占行数" + fmt_pct(-c.n_distinct);
+        if (reltuples > 0) out += "（约" + fmt_num(-c.n_distinct * reltuples, 0) + "个）";
+    } else {
+        out += "不同值数未知";
+    }
+    if (c.null_frac >= 0) out += "，空值比例" + fmt_pct(c.null_frac);
+    if (c.top_freq >= 0) out += "，最高频值占比" + fmt_pct(c.top_freq);
+    if (c.correlation >= -1) out += "，物理顺序相关性" + fmt_num(c.correlation, 2);
+    return out;
 }
 
-std::string generate_question(const DiagnosticReport& report) {
-    return "请补充业务相关信息（示例问题）：该SQL是否经常执行？";
+std::string index_list(const TableStats& t) {
+    std::string out;
+    for (size_t i = 0; i < t.indexes.size(); ++i) {
+        const IndexInfo& idx = t.indexes[i];
+        out += (i ? "、" : "") + (idx.name.empty() ? std::string("(未命名)") : idx.name) + "(";
+        for (size_t c = 0; c < idx.columns.size(); ++c) out += (c ? ", " : "") + idx.columns[c];
+        out += idx.unique ? ") 唯一" : ")";
+    }
+    return out;
+}
+
+void add_question(EnrichedDiagnosticReport& e, const std::string& q) {
+    if (e.questions.size() < kMaxQuestions) push_unique(e.questions, q);
+}
+
+void add_fact(EnrichedDiagnosticReport& e, const std::string& f) {
+    if (e.known_facts.size() < kMaxFacts) push_unique(e.known_facts, f);
+}
+
+} // namespace
+
+EnrichedDiagnosticReport collect_context(const DiagnosticReport& report, const Utils::SqlShape& shape,
+                                         const CatalogSnapshot* catalog) {
+    EnrichedDiagnosticReport e = enrich_report(report, "");
+    const PlanTree& plan = report.plan;
+
+    // 谓词与连接条件中出现的列
+    std::vector<std::string> predicate_columns;
+    for (size_t i = 0; i < shape.predicates.size(); ++i) {
+        push_unique(predicate_columns, shape.predicates[i].column);
+        if (shape.predicates[i].join) push_unique(predicate_columns, shape.predicates[i].value);
+    }
+
+    for (size_t t = 0; t < shape.tables.size(); ++t) {
+        const std::string& table = shape.tables[t];
+        TableScan scan = scan_of(plan, table);
+        const TableStats* stats = catalog ? catalog->find_table(table) : nullptr;
+
+        // 该表被引用的列：限定名直接归属；单表查询的列已被限定；多表时的裸列按快照中的列归属
+        std::vector<std::string> columns, filters;
+        for (size_t c = 0; c < shape.columns.size(); ++c) {
+            std::string col = column_of(shape.columns[c], table);
+            if (col.empty() && stats && shape.columns[c].find('.') == std::string::npos &&
+                stats->find_column(shape.columns[c])) {
+                col = shape.columns[c];
+            }
+            if (col.empty()) continue;
+            push_unique(columns, col);
+            bool in_predicate = std::find(predicate_columns.begin(), predicate_columns.end(), shape.columns[c]) !=
+                                predicate_columns.end();
+            if (in_predicate) push_unique(filters, col);
+        }
+        std::string filter_list;
+        for (size_t c = 0; c < filters.size(); ++c) filter_list += (c ? "、" : "") + filters[c];
+
+        if (!stats) {
+            // 计划中有全表扫描的实际行数时行数已知（计划本身已在提示词中，不再列为事实）
+            if (scan.rows < 0) {
+                add_question(e, "表 " + table + " 的数据量（行数）和已有索引？（可提供 \\d " + table + " 的输出）");
+            } else if (!filters.empty() && scan.seqscan) {
+                add_question(e, "表 " + table + " 在 " + filter_list + " 上是否已有索引？");
+            }
+            if (scan.skew >= kScanSkewRatio) {
+                add_question(e, "表 " + table + " 最近一次ANALYZE是什么时候？" +
+                                (filter_list.empty() ? "" : "列 " + filter_list + " 的取值分布是否倾斜？"));
+            }
+            continue;
+        }
+
+        if (stats->reltuples >= 0 || stats->analyze_known) {
+            std::string line = "表 " + table + "：";
+            line += stats->reltuples >= 0 ? "约" + fmt_num(stats->reltuples, 0) + "行" : "行数未知";
+            if (stats->relpages >= 0) line += "、" + fmt_num(stats->relpages, 0) + "页";
+            if (!stats->last_analyze.empty()) line += "，最近ANALYZE " + stats->last_analyze;
+            else if (stats->analyze_known) line += "，从未ANALYZE";
+            add_fact(e, line);
+        }
+        if (scan.rows >= 0 && stats->reltuples >= 0 && ratio(scan.rows, stats->reltuples) >= kStaleRatio) {
+            add_fact(e, "表 " + table + " 统计信息可能过期：reltuples约" + fmt_num(stats->reltuples, 0) +
+                            "，执行计划中全表扫描实际" + fmt_num(scan.rows, 0) + "行");
+        }
+        if (stats->indexes_known) {
+            add_fact(e, stats->indexes.empty() ? "表 " + table + " 上没有索引" : "表 " + table + " 的索引：" + index_list(*stats));
+            e.existing_indexes.insert(e.existing_indexes.end(), stats->indexes.begin(), stats->indexes.end());
+        } else if (!filters.empty() && (scan.seqscan || !scan.scanned)) {
+            add_question(e, "表 " + table + " 在 " + filter_list + " 上是否已有索引？");
+        }
+        if (stats->reltuples < 0 && scan.rows < 0) add_question(e, "表 " + table + " 的大致行数？");
+        std::string missing;
+        for (size_t c = 0; c < columns.size(); ++c) {
+            const ColumnStats* cs = stats->find_column(columns[c]);
+            if (cs) add_fact(e, column_fact(table, *cs, stats->reltuples));
+            else if (std::find(filters.begin(), filters.end(), columns[c]) != filters.end()) {
+                missing += (missing.empty() ? "" : "、") + columns[c];
+            }
+        }
+        // 过滤列没有统计信息且扫描估算失真：分布只能由用户确认
+        if (!missing.empty() && scan.skew >= kScanSkewRatio) {
+            add_question(e, "表 " + table + " 的列 " + missing + " 在快照中没有统计信息，其取值分布是否倾斜（如某个值占大多数）？");
+        }
+    }
+
+    // 与诊断出的问题相关的参数：下盘看work_mem，数据流转/并行看query_dop
+    bool spilled = false, parallel = false;
+    for (size_t i = 0; i < plan.nodes.size(); ++i) {
+        spilled = spilled || plan.nodes[i].spilled;
+        parallel = parallel || plan.nodes[i].stream != StreamKind::None || plan.nodes[i].dop > 1;
+    }
+    std::string value, gucs;
+    for (size_t i = 0; catalog && i < sizeof(kFactGucs) / sizeof(kFactGucs[0]); ++i) {
+        if (catalog->find_guc(kFactGucs[i], value)) gucs += (gucs.empty() ? "" : "，") + std::string(kFactGucs[i]) + "=" + value;
+    }
+    if (!gucs.empty()) add_fact(e, "参数：" + gucs);
+    if (spilled && !(catalog && catalog->find_guc("work_mem", value))) {
+        add_question(e, "当前 work_mem 设置是多少？（计划中有算子下盘）");
+    }
+    if (parallel && !(catalog && catalog->find_guc("query_dop", value))) {
+        add_question(e, "当前 query_dop 设置是多少？（计划中有数据流转/并行算子）");
+    }
+    // 本地诊断未发现问题时不打扰用户
+    if (report.issues.empty()) e.questions.clear();
+    e.needs_more_info = !e.questions.empty();
+    return e;
+}
+
+bool need_user_interaction(const EnrichedDiagnosticReport& enriched) {
+    return enriched.needs_more_info && !enriched.questions.empty();
+}
+
+std::string generate_question(const EnrichedDiagnosticReport& enriched) {
+    if (enriched.questions.empty()) return "";
+    std::ostringstream oss;
+    oss << "以下信息在执行计划和统计信息快照中都没有，补充后分析更准确：";
+    for (size_t i = 0; i < enriched.questions.size(); ++i) oss << "\n" << (i + 1) << ". " << enriched.questions[i];
+    return oss.str();
 }
 
 EnrichedDiagnosticReport enrich_report(const DiagnosticReport& report, const std::string& user_answer) {
@@ -16,3 +241,20 @@ EnrichedDiagnosticReport enrich_report(const DiagnosticReport& report, const std
     enriched.user_knowledge = user_answer;
     return enriched;
 }
+
+void add_user_answer(EnrichedDiagnosticReport& enriched, const std::string& answer) {
+    enriched.answers.push_back(answer);
+    enriched.user_knowledge += (enriched.user_knowledge.empty() ? "" : "\n") + answer;
+    enriched.needs_more_info = false;
+}
+
+uint64_t context_fingerprint(const EnrichedDiagnosticReport& enriched, uint64_t seed) {
+    uint64_t h = seed;
+    for (size_t i = 0; i < enriched.known_facts.size(); ++i) {
+        h = Utils::fnv1a64(enriched.known_facts[i].data(), enriched.known_facts[i].size(), h);
+    }
+    for (size_t i = 0; i < enriched.similar_cases.size(); ++i) {
+        h = Utils::fnv1a64(enriched.similar_cases[i].data(), enriched.similar_cases[i].size(), h);
+    }
+    return Utils::fnv1a64(enriched.user_knowledge.data(), enriched.user_knowledge.size(), h);
+}
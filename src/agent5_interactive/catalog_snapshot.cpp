@@ -0,0 +1,429 @@
+#include "catalog_snapshot.h"
+#include <sql_normalize.h>
+#include <utils.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// 一行系统表数据：列名（小写）-> 文本值
+typedef std::unordered_map<std::string, std::string> Row;
+
+const size_t kNoTable = static_cast<size_t>(-1);
+
+// 标识符规范化：去掉双引号并转小写，用作查找键
+std::string ident_key(const std::string& name) {
+    std::string out;
+    out.reserve(name.size());
+    for (size_t i = 0; i < name.size(); ++i) {
+        char c = name[i];
+        if (c == '"') continue;
+        out += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    return Utils::trim(out);
+}
+
+std::string bare_name(const std::string& key) {
+    size_t dot = key.rfind('.');
+    return dot == std::string::npos ? key : key.substr(dot + 1);
+}
+
+const std::string* field(const Row& row, const char* key) {
+    Row::const_iterator it = row.find(key);
+    return it == row.end() ? nullptr : &it->second;
+}
+
+std::string first_field(const Row& row, const char* const* keys, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const std::string* v = field(row, keys[i]);
+        if (v && !v->empty()) return *v;
+    }
+    return "";
+}
+
+// 解析数字，空串或非数字返回def；"{0.3,0.1}"/"[0.3,0.1]" 取首项
+double parse_num(const std::string& s, double def) {
+    size_t i = 0;
+    while (i < s.size() && (s[i] == ' ' || s[i] == '{' || s[i] == '[' || s[i] == '"')) ++i;
+    if (i >= s.size()) return def;
+    const char* begin = s.c_str() + i;
+    char* end = nullptr;
+    double v = std::strtod(begin, &end);
+    return end == begin ? def : v;
+}
+
+// 解析带表头的CSV（支持双引号转义与字段内换行）；表头行不含逗号而含"|"或制表符时按该分隔符解析（psql -A 输出）
+std::vector<Row> parse_csv(const std::string& text) {
+    std::vector<Row> rows;
+    size_t header_end = text.find('\n');
+    std::string header = text.substr(0, header_end);
+    char sep = ',';
+    if (header.find(',') == std::string::npos) {
+        if (header.find('|') != std::string::npos) sep = '|';
+        else if (header.find('\t') != std::string::npos) sep = '\t';
+    }
+    std::vector<std::string> names;
+    std::vector<std::string> fields;
+    std::string cur;
+    bool quoted = false;
+    size_t i = 0, n = text.size();
+    while (i <= n) {
+        char c = i < n ? text[i] : '\n';
+        if (quoted) {
+            if (c == '"' && i + 1 < n && text[i + 1] == '"') {
+                cur += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                cur += c;
+            }
+        } else if (c == '"' && Utils::trim(cur).empty()) {
+            cur.clear();
+            quoted = true;
+        } else if (c == sep) {
+            fields.push_back(Utils::trim(cur));
+            cur.clear();
+        } else if (c == '\n') {
+            fields.push_back(Utils::trim(cur));
+            cur.clear();
+            bool blank = fields.size() == 1 && fields[0].empty();
+            // psql 的 "(N rows)" 结尾行
+            bool footer = fields.size() == 1 && !fields[0].empty() && fields[0][0] == '(';
+            if (!blank && !footer) {
+                if (names.empty()) {
+                    for (size_t k = 0; k < fields.size(); ++k) names.push_back(ident_key(fields[k]));
+                } else {
+                    Row row;
+                    for (size_t k = 0; k < fields.size() && k < names.size(); ++k) row[names[k]] = fields[k];
+                    rows.push_back(row);
+                }
+            }
+            fields.clear();
+        } else if (c != '\r') {
+            cur += c;
+        }
+        ++i;
+    }
+    return rows;
+}
+
+std::string json_text(const json& v) {
+    if (v.is_string()) return v.get<std::string>();
+    if (v.is_null()) return "";
+    return v.dump();
+}
+
+// 规范化后的单词文本（去引号、小写）
+std::string token_ident(const Utils::SqlToken& t) {
+    return ident_key(t.text.str());
+}
+
+bool token_is(const std::vector<Utils::SqlToken>& tokens, size_t i, const char* word) {
+    return i < tokens.size() && tokens[i].kind == Utils::SqlTokenKind::Word && token_ident(tokens[i]) == word;
+}
+
+bool token_punct(const std::vector<Utils::SqlToken>& tokens, size_t i, char c) {
+    return i < tokens.size() && tokens[i].kind == Utils::SqlTokenKind::Punct && tokens[i].text.size == 1 &&
+           tokens[i].text[0] == c;
+}
+
+bool token_name(const std::vector<Utils::SqlToken>& tokens, size_t i) {
+    return i < tokens.size() &&
+           (tokens[i].kind == Utils::SqlTokenKind::Word || tokens[i].kind == Utils::SqlTokenKind::QuotedIdent);
+}
+
+} // namespace
+
+const ColumnStats* TableStats::find_column(const std::string& column) const {
+    std::string key = ident_key(column);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == key) return &columns[i];
+    }
+    return nullptr;
+}
+
+struct CatalogSnapshot::Impl {
+    std::vector<TableStats> tables;
+    std::unordered_map<std::string, size_t> by_name;   // 完整名 -> 下标
+    std::unordered_map<std::string, size_t> by_bare;   // 不含schema的表名 -> 下标，多个schema同名时为kNoTable
+    std::unordered_map<std::string, std::string> gucs;
+
+    TableStats& table(const Row& row) {
+        static const char* const kSchemaKeys[] = { "schemaname", "nspname", "schema", "table_schema" };
+        static const char* const kTableKeys[] = { "tablename", "relname", "table_name", "table" };
+        std::string schema = ident_key(first_field(row, kSchemaKeys, 4));
+        std::string rel = ident_key(first_field(row, kTableKeys, 4));
+        std::string name = schema.empty() ? rel : schema + "." + rel;
+        std::unordered_map<std::string, size_t>::iterator it = by_name.find(name);
+        if (it != by_name.end()) return tables[it->second];
+        size_t index = tables.size();
+        tables.push_back(TableStats());
+        tables.back().name = name;
+        by_name[name] = index;
+        std::unordered_map<std::string, size_t>::iterator bare = by_bare.find(rel);
+        if (bare == by_bare.end()) by_bare[rel] = index;
+        else if (bare->second != index) bare->second = kNoTable;
+        return tables[index];
+    }
+
+    bool has_table_name(const Row& row) const {
+        return field(row, "tablename") || field(row, "relname") || field(row, "table_name") || field(row, "table");
+    }
+
+    // 按字段识别行来自哪张系统表，返回是否识别
+    bool apply(const Row& row) {
+        if (const std::string* def = field(row, "indexdef")) {
+            IndexInfo index;
+            if (!parse_index_definition(*def, index)) return false;
+            if (const std::string* name = field(row, "indexname")) index.name = ident_key(*name);
+            TableStats& t = has_table_name(row) ? table(row) : table_for_index(index.table);
+            index.table = t.name;
+            t.indexes_known = true;
+            for (size_t i = 0; i < t.indexes.size(); ++i) {
+                if (t.indexes[i].name == index.name) return true;
+            }
+            t.indexes.push_back(index);
+            return true;
+        }
+        if (const std::string* att = field(row, "attname")) {
+            if (!has_table_name(row)) return false;
+            TableStats& t = table(row);
+            std::string name = ident_key(*att);
+            ColumnStats* col = nullptr;
+            for (size_t i = 0; i < t.columns.size() && !col; ++i) {
+                if (t.columns[i].name == name) col = &t.columns[i];
+            }
+            if (!col) {
+                t.columns.push_back(ColumnStats());
+                col = &t.columns.back();
+                col->name = name;
+            }
+            if (const std::string* v = field(row, "null_frac")) col->null_frac = parse_num(*v, col->null_frac);
+            if (const std::string* v = field(row, "n_distinct")) col->n_distinct = parse_num(*v, col->n_distinct);
+            if (const std::string* v = field(row, "avg_width")) {
+                col->avg_width = static_cast<int>(parse_num(*v, col->avg_width));
+            }
+            if (const std::string* v = field(row, "correlation")) col->correlation = parse_num(*v, col->correlation);
+            if (const std::string* v = field(row, "most_common_freqs")) col->top_freq = parse_num(*v, col->top_freq);
+            return true;
+        }
+        const std::string* name = field(row, "name");
+        const std::string* setting = field(row, "setting");
+        if (!setting) setting = field(row, "value");
+        if (name && setting && !has_table_name(row)) {
+            gucs[ident_key(*name)] = with_unit(*setting, field(row, "unit"));
+            return true;
+        }
+        if (!has_table_name(row)) return false;
+        // pg_class中的索引、序列、TOAST表等不计入
+        if (const std::string* kind = field(row, "relkind")) {
+            if (!kind->empty() && *kind != "r" && *kind != "p" && *kind != "f" && *kind != "m") return true;
+        }
+        TableStats& t = table(row);
+        if (const std::string* v = field(row, "reltuples")) t.reltuples = parse_num(*v, t.reltuples);
+        else if (const std::string* v = field(row, "n_live_tup")) t.reltuples = parse_num(*v, t.reltuples);
+        if (const std::string* v = field(row, "relpages")) t.relpages = parse_num(*v, t.relpages);
+        const std::string* manual = field(row, "last_analyze");
+        const std::string* autov = field(row, "last_autoanalyze");
+        if (manual || autov) {
+            t.analyze_known = true;
+            std::string a = manual ? Utils::trim(*manual) : "", b = autov ? Utils::trim(*autov) : "";
+            // ISO时间可直接按字符串比较
+            std::string latest = a > b ? a : b;
+            if (latest > t.last_analyze) t.last_analyze = latest;
+        }
+        return true;
+    }
+
+    // 索引DDL中的表名可能带schema，只在已知同名表中找
+    TableStats& table_for_index(const std::string& name) {
+        Row row;
+        size_t dot = name.rfind('.');
+        if (dot != std::string::npos) {
+            row["schemaname"] = name.substr(0, dot);
+            row["tablename"] = name.substr(dot + 1);
+        } else {
+            row["tablename"] = name;
+        }
+        return table(row);
+    }
+
+    // pg_settings 的 unit 列：数值单位如 "8kB" 时换算
+    static std::string with_unit(const std::string& setting, const std::string* unit) {
+        if (!unit || unit->empty()) return setting;
+        double factor = parse_num(*unit, 0);
+        if (factor > 0) {
+            size_t p = 0;
+            while (p < unit->size() && (((*unit)[p] >= '0' && (*unit)[p] <= '9') || (*unit)[p] == '.')) ++p;
+            std::ostringstream oss;
+            oss << static_cast<long long>(parse_num(setting, 0) * factor) << unit->substr(p);
+            return oss.str();
+        }
+        return setting + *unit;
+    }
+
+    size_t load_json(const json& j) {
+        size_t applied = 0;
+        if (j.is_array()) {
+            for (size_t i = 0; i < j.size(); ++i) {
+                if (!j[i].is_object()) continue;
+                Row row;
+                for (json::const_iterator it = j[i].begin(); it != j[i].end(); ++it) {
+                    row[ident_key(it.key())] = json_text(it.value());
+                }
+                if (apply(row)) ++applied;
+            }
+            return applied;
+        }
+        if (!j.is_object()) return 0;
+        for (json::const_iterator it = j.begin(); it != j.end(); ++it) {
+            std::string key = ident_key(it.key());
+            if (it.value().is_object() && (key == "gucs" || key == "settings" || key == "guc")) {
+                for (json::const_iterator g = it.value().begin(); g != it.value().end(); ++g) {
+                    gucs[ident_key(g.key())] = json_text(g.value());
+                    ++applied;
+                }
+            } else if (it.value().is_array() || it.value().is_object()) {
+                applied += load_json(it.value());
+            }
+        }
+        return applied;
+    }
+};
+
+CatalogSnapshot::CatalogSnapshot() : impl_(new Impl()) {}
+
+CatalogSnapshot::~CatalogSnapshot() {
+    delete impl_;
+}
+
+bool CatalogSnapshot::load(const std::string& path, std::string* error) {
+    std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+    if (!fin.is_open()) {
+        if (error) *error = "无法打开 " + path;
+        return false;
+    }
+    std::ostringstream oss;
+    oss << fin.rdbuf();
+    std::string hint;
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos) hint = Utils::to_lower(path.substr(dot + 1));
+    if (hint != "json" && hint != "csv") hint.clear();
+    if (!load_text(oss.str(), hint, error)) {
+        if (error) *error = path + "：" + *error;
+        return false;
+    }
+    return true;
+}
+
+bool CatalogSnapshot::load_text(const std::string& text, const std::string& format_hint, std::string* error) {
+    std::string format = format_hint;
+    if (format.empty()) {
+        size_t p = text.find_first_not_of(" \t\r\n");
+        format = p != std::string::npos && (text[p] == '{' || text[p] == '[') ? "json" : "csv";
+    }
+    size_t applied = 0;
+    if (format == "json") {
+        try {
+            applied = impl_->load_json(json::parse(text));
+        } catch (const std::exception& e) {
+            if (error) *error = std::string("JSON解析失败: ") + e.what();
+            return false;
+        }
+    } else {
+        std::vector<Row> rows = parse_csv(text);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (impl_->apply(rows[i])) ++applied;
+        }
+    }
+    if (applied == 0) {
+        if (error) *error = "未识别出 pg_class/pg_stats/pg_indexes/pg_settings 数据";
+        return false;
+    }
+    return true;
+}
+
+const TableStats* CatalogSnapshot::find_table(const std::string& name) const {
+    std::string key = ident_key(name);
+    std::unordered_map<std::string, size_t>::const_iterator it = impl_->by_name.find(key);
+    if (it != impl_->by_name.end()) return &impl_->tables[it->second];
+    // 快照或SQL一侧未带schema时按表名匹配
+    it = impl_->by_bare.find(bare_name(key));
+    if (it != impl_->by_bare.end() && it->second != kNoTable) {
+        const TableStats& t = impl_->tables[it->second];
+        if (key.find('.') == std::string::npos || t.name.find('.') == std::string::npos) return &t;
+    }
+    return nullptr;
+}
+
+bool CatalogSnapshot::find_guc(const std::string& name, std::string& value) const {
+    std::unordered_map<std::string, std::string>::const_iterator it = impl_->gucs.find(ident_key(name));
+    if (it == impl_->gucs.end()) return false;
+    value = it->second;
+    return true;
+}
+
+size_t CatalogSnapshot::table_count() const {
+    return impl_->tables.size();
+}
+
+size_t CatalogSnapshot::guc_count() const {
+    return impl_->gucs.size();
+}
+
+bool parse_index_definition(const std::string& ddl, IndexInfo& out) {
+    std::vector<Utils::SqlToken> tokens = Utils::tokenize_sql(ddl);
+    size_t i = 0;
+    if (!token_is(tokens, i++, "create")) return false;
+    out.unique = token_is(tokens, i, "unique");
+    if (out.unique) ++i;
+    if (!token_is(tokens, i++, "index")) return false;
+    if (token_is(tokens, i, "concurrently")) ++i;
+    if (token_is(tokens, i, "if") && token_is(tokens, i + 1, "not") && token_is(tokens, i + 2, "exists")) i += 3;
+    if (!token_is(tokens, i, "on")) {
+        if (!token_name(tokens, i)) return false;
+        out.name = token_ident(tokens[i++]);
+    }
+    if (!token_is(tokens, i++, "on")) return false;
+    if (token_is(tokens, i, "only")) ++i;
+    if (!token_name(tokens, i)) return false;
+    out.table = token_ident(tokens[i++]);
+    while (token_punct(tokens, i, '.') && token_name(tokens, i + 1)) {
+        out.table += "." + token_ident(tokens[i + 1]);
+        i += 2;
+    }
+    if (token_is(tokens, i, "using")) i += 2;
+    if (!token_punct(tokens, i++, '(')) return false;
+    // 逐个读取括号内以逗号分隔的索引项
+    out.columns.clear();
+    int depth = 0;
+    size_t start = i;
+    for (; i < tokens.size(); ++i) {
+        bool close = token_punct(tokens, i, ')');
+        if (token_punct(tokens, i, '(')) ++depth;
+        else if (close && depth > 0) --depth;
+        else if (depth == 0 && (close || token_punct(tokens, i, ','))) {
+            if (i == start) return false;
+            // 单个列名（可带 ASC/DESC、NULLS、COLLATE、操作符类）取列名，表达式保留原文
+            bool simple = token_name(tokens, start) && (start + 1 == i || tokens[start + 1].kind == Utils::SqlTokenKind::Word);
+            if (simple) {
+                out.columns.push_back(token_ident(tokens[start]));
+            } else {
+                const char* b = tokens[start].text.data;
+                const char* e = tokens[i - 1].text.data + tokens[i - 1].text.size;
+                out.columns.push_back(Utils::to_lower(std::string(b, e - b)));
+            }
+            start = i + 1;
+            if (close) break;
+        }
+    }
+    if (i >= tokens.size() || out.columns.empty()) return false;
+    out.definition = Utils::trim(ddl);
+    return true;
+}
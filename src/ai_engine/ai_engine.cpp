@@ -1,12 +1,224 @@
 #include <ai_engine.h>
+#include <response_cache.h>
+#include <ai_recorder.h>
 #include <fstream>
 #include <sstream>
 #include <iostream>
-#include <nlohmann/json.hpp>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <json.hpp>
 #include <curl/curl.h>
 
 using json = nlohmann::json;
 
+const char* const kAISystemPrompt = "你是GaussDB SQL优化专家。请根据用户输入的SQL和EXPLAIN(ANALYZE)结果，输出详细优化建议和优化后SQL。";
+
+namespace {
+
+const size_t kMaxRawBytes = 64 * 1024;   // 流式模式下非SSE内容（如错误JSON）与单行未完整数据的最大缓存
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// 构造OpenAI兼容body
+std::string build_body(const std::vector<ChatMessage>& messages, const AIModelConfig& model, bool stream) {
+    json body;
+    body["model"] = model.model_id;
+    json& arr = body["messages"] = json::array();
+    for (size_t i = 0; i < messages.size(); ++i) {
+        arr.push_back({ {"role", messages[i].role}, {"content", messages[i].content} });
+    }
+    body["stream"] = stream;
+    return body.dump();
+}
+
+// 单条提示词：系统提示 + 用户消息
+std::vector<ChatMessage> single_turn(const std::string& prompt) {
+    std::vector<ChatMessage> messages;
+    messages.push_back(ChatMessage("system", kAISystemPrompt));
+    messages.push_back(ChatMessage("user", prompt));
+    return messages;
+}
+
+// SSE增量解析状态：只缓存未完整的一行，已解析的文本追加到reply
+struct StreamState {
+    const TokenSink* sink;
+    std::string line;        // 未遇到换行的残余数据
+    std::string reply;       // 累积的回复文本
+    std::string raw;         // 非SSE内容（错误响应等），有上限
+    bool done;
+    bool overflow;           // 单行超过上限（非SSE或无换行的响应），已中止传输
+    Clock::time_point start;
+    AICallStats* stats;
+    const std::atomic<bool>* cancel;
+};
+
+// 记录非SSE内容，总量截断到kMaxRawBytes
+void append_raw(StreamState& st, const std::string& line) {
+    if (st.raw.size() >= kMaxRawBytes) return;
+    st.raw.append(line, 0, kMaxRawBytes - st.raw.size());
+    if (st.raw.size() < kMaxRawBytes) st.raw += '\n';
+}
+
+void handle_sse_line(StreamState& st, std::string& line) {
+    if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+    if (line.empty() || line[0] == ':') return;   // 空行为事件分隔，':'开头为注释/心跳
+    if (line.compare(0, 5, "data:") != 0) {
+        append_raw(st, line);
+        return;
+    }
+    size_t b = 5;
+    while (b < line.size() && line[b] == ' ') ++b;
+    if (line.compare(b, std::string::npos, "[DONE]") == 0) {
+        st.done = true;
+        return;
+    }
+    try {
+        json j = json::parse(line.begin() + b, line.end());
+        if (!j.contains("choices") || j["choices"].empty()) return;
+        const json& delta = j["choices"][0].contains("delta") ? j["choices"][0]["delta"] : j["choices"][0]["message"];
+        if (!delta.is_object() || !delta.contains("content") || !delta["content"].is_string()) return;
+        const std::string& text = delta["content"].get_ref<const std::string&>();
+        if (text.empty()) return;
+        if (st.stats) {
+            if (st.stats->first_token_ms < 0) st.stats->first_token_ms = elapsed_ms(st.start);
+            ++st.stats->chunks;
+        }
+        st.reply += text;
+        if (st.sink && *st.sink) (*st.sink)(text);
+    } catch (...) {
+        append_raw(st, line);
+    }
+}
+
+// libcurl回调：按行切分SSE数据，逐行解析
+size_t StreamCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    StreamState& st = *static_cast<StreamState*>(userp);
+    const char* p = static_cast<const char*>(contents);
+    size_t n = size * nmemb;
+    if (st.cancel && st.cancel->load()) return 0;   // 返回0使curl以写错误中止
+    size_t begin = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (p[i] != '\n') continue;
+        st.line.append(p + begin, i - begin);
+        if (st.line.size() > kMaxRawBytes) break;
+        handle_sse_line(st, st.line);
+        st.line.clear();
+        begin = i + 1;
+    }
+    if (st.line.size() <= kMaxRawBytes) st.line.append(p + begin, n - begin);
+    // 服务端返回非SSE或不换行的内容时不无限缓存
+    if (st.line.size() > kMaxRawBytes) {
+        st.overflow = true;
+        return 0;
+    }
+    return n;
+}
+
+// 每个端点（url + api_key）一组可复用的curl句柄与请求头
+struct Endpoint {
+    CURL* curl;
+    struct curl_slist* headers;
+    struct curl_slist* stream_headers;
+};
+
+typedef size_t (*WriteFn)(void*, size_t, size_t, void*);
+
+std::once_flag g_curl_init;
+
+AIClient& default_client() {
+    static thread_local AIClient client;
+    return client;
+}
+
+// 进度回调：取消标志置位时中止传输
+int CancelCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<const std::atomic<bool>*>(clientp)->load() ? 1 : 0;
+}
+
+std::string parse_reply(const std::string& readBuffer) {
+    try {
+        auto j = json::parse(readBuffer);
+        if (j.contains("choices") && j["choices"].size() > 0 && j["choices"][0]["message"].contains("content")) {
+            return j["choices"][0]["message"]["content"].get<std::string>();
+        } else {
+            return "[AI回复解析失败] " + readBuffer;
+        }
+    } catch (...) {
+        return "[AI回复JSON解析异常] " + readBuffer;
+    }
+}
+
+// 等到start后的第ms毫秒，期间取消标志置位则返回false
+bool wait_until(Clock::time_point start, double ms, const std::atomic<bool>* cancel) {
+    Clock::time_point deadline = start + std::chrono::microseconds(static_cast<long long>(ms * 1000));
+    while (Clock::now() < deadline) {
+        if (cancel && cancel->load()) return false;
+        Clock::time_point step = Clock::now() + std::chrono::milliseconds(10);
+        std::this_thread::sleep_until(std::min(step, deadline));
+    }
+    return !(cancel && cancel->load());
+}
+
+// 从录制中取回复；按录制的首字/总耗时推送增量片段，复现状态码与Retry-After，供路由器照常退避与切换
+std::string replay_reply(AIRecorder& recorder, const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                         const TokenSink* sink, AICallStats* stats, const std::atomic<bool>* cancel) {
+    Clock::time_point start = Clock::now();
+    RecordedReply rec;
+    if (!recorder.replay(make_record_key(model.model_id, messages), rec)) {
+        if (stats) stats->total_ms = elapsed_ms(start);
+        return "[AI回放] 录制文件中没有该请求";
+    }
+    bool timing = recorder.replay_timing();
+    const std::string aborted = std::string("[AI调用失败] ") + curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK);
+    if (stats) {
+        stats->http_status = rec.http_status;
+        stats->retry_after_s = rec.retry_after_s;
+    }
+    if (sink && *sink && !ai_reply_failed(rec.reply)) {
+        double first = rec.first_token_ms >= 0 ? rec.first_token_ms : rec.total_ms;
+        std::vector<std::string> parts = split_reply_chunks(rec.reply, std::max<size_t>(1, rec.chunks));
+        for (size_t i = 0; i < parts.size(); ++i) {
+            double at = parts.size() > 1 ? first + (rec.total_ms - first) * i / (parts.size() - 1) : first;
+            if (timing && !wait_until(start, at, cancel)) return aborted;
+            if (stats) {
+                if (i == 0) stats->first_token_ms = elapsed_ms(start);
+                ++stats->chunks;
+            }
+            (*sink)(parts[i]);
+        }
+    } else if (timing && !wait_until(start, rec.total_ms, cancel)) {
+        return aborted;
+    }
+    if (stats) stats->total_ms = elapsed_ms(start);
+    return rec.reply;
+}
+
+// 录制一次请求结果（含失败），被取消的对冲请求不录制
+void record_reply(AIRecorder& recorder, const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                  const std::string& reply, const AICallStats& stats, const std::atomic<bool>* cancel) {
+    if (cancel && cancel->load()) return;
+    RecordedReply rec;
+    rec.reply = reply;
+    rec.http_status = stats.http_status;
+    rec.retry_after_s = stats.retry_after_s;
+    rec.first_token_ms = stats.first_token_ms;
+    rec.total_ms = stats.total_ms;
+    rec.chunks = stats.chunks;
+    recorder.record(make_record_key(model.model_id, messages), rec);
+}
+
+} // namespace
+
+bool ai_reply_failed(const std::string& reply) {
+    return reply.compare(0, 3, "[AI") == 0;
+}
+
 bool load_ai_config(const std::string& path, std::vector<AIModelConfig>& models) {
     std::ifstream fin(path);
     if (!fin.is_open()) return false;
@@ -19,6 +231,13 @@ bool load_ai_config(const std::string& path, std::vector<AIModelConfig>& models)
         cfg.url = m.value("url", "");
         cfg.api_key = m.value("api_key", "");
         cfg.model_id = m.value("model_id", "");
+        cfg.timeout_ms = m.value("timeout_ms", cfg.timeout_ms);
+        cfg.connect_timeout_ms = m.value("connect_timeout_ms", cfg.connect_timeout_ms);
+        cfg.dns_cache_seconds = m.value("dns_cache_seconds", cfg.dns_cache_seconds);
+        cfg.keep_alive = m.value("keep_alive", cfg.keep_alive);
+        cfg.http2 = m.value("http2", cfg.http2);
+        cfg.context_tokens = m.value("context_tokens", cfg.context_tokens);
+        cfg.history_tokens = m.value("history_tokens", cfg.history_tokens);
         models.push_back(cfg);
     }
     return !models.empty();
@@ -30,44 +249,243 @@ static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* use
     return size * nmemb;
 }
 
-std::string call_ai(const std::string& prompt, const AIModelConfig& model) {
-    CURL* curl = curl_easy_init();
-    if (!curl) return "[AI调用失败] curl初始化失败";
-    std::string readBuffer;
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, ("Authorization: Bearer " + model.api_key).c_str());
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+struct AIClient::Impl {
+    CURLSH* share;
+    std::map<std::string, Endpoint> endpoints;
 
-    // 构造OpenAI兼容body
-    json body;
-    body["model"] = model.model_id;
-    body["messages"] = {
-        { {"role", "system"}, {"content", "你是GaussDB SQL优化专家。请根据用户输入的SQL和EXPLAIN(ANALYZE)结果，输出详细优化建议和优化后SQL。"} },
-        { {"role", "user"}, {"content", prompt} }
-    };
-    body["stream"] = false;
-    std::string body_str = body.dump();
-
-    curl_easy_setopt(curl, CURLOPT_URL, model.url.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body_str.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    Impl() {
+        std::call_once(g_curl_init, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+        share = curl_share_init();
+        if (share) {
+            curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+            curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        }
+    }
+
+    ~Impl() {
+        for (std::map<std::string, Endpoint>::iterator it = endpoints.begin(); it != endpoints.end(); ++it) {
+            curl_easy_cleanup(it->second.curl);
+            curl_slist_free_all(it->second.headers);
+            curl_slist_free_all(it->second.stream_headers);
+        }
+        if (share) curl_share_cleanup(share);
+    }
+
+    // 取（或创建）端点句柄，不变的选项只在创建时设置一次，
+    // 因此这些选项（http2/keep_alive/dns_cache_seconds）也是句柄键的一部分
+    Endpoint* endpoint(const AIModelConfig& model) {
+        std::string key = model.url + "\n" + model.api_key + "\n" + (model.http2 ? "h2" : "h1") +
+                          (model.keep_alive ? ",ka," : ",close,") + std::to_string(model.dns_cache_seconds);
+        std::map<std::string, Endpoint>::iterator it = endpoints.find(key);
+        if (it != endpoints.end()) return &it->second;
+
+        CURL* curl = curl_easy_init();
+        if (!curl) return nullptr;
+        Endpoint ep;
+        ep.curl = curl;
+        ep.headers = curl_slist_append(NULL, ("Authorization: Bearer " + model.api_key).c_str());
+        ep.headers = curl_slist_append(ep.headers, "Content-Type: application/json");
+        ep.stream_headers = curl_slist_append(NULL, ("Authorization: Bearer " + model.api_key).c_str());
+        ep.stream_headers = curl_slist_append(ep.stream_headers, "Content-Type: application/json");
+        ep.stream_headers = curl_slist_append(ep.stream_headers, "Accept: text/event-stream");
+
+        curl_easy_setopt(curl, CURLOPT_URL, model.url.c_str());
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        if (share) curl_easy_setopt(curl, CURLOPT_SHARE, share);
+        curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, model.dns_cache_seconds);
+        curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+        if (model.keep_alive) {
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 30L);
+        } else {
+            curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+                         model.http2 ? (long)CURL_HTTP_VERSION_2TLS : (long)CURL_HTTP_VERSION_1_1);
+        return &(endpoints[key] = ep);
+    }
+
+    // 执行一次POST请求，写回调与数据由调用方提供
+    CURLcode perform(Endpoint& ep, const AIModelConfig& model, const std::string& body, bool stream,
+                     WriteFn cb, void* data, long* status, AICallStats* stats, const std::atomic<bool>* cancel) {
+        CURL* curl = ep.curl;
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, stream ? ep.stream_headers : ep.headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body.size());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cb);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, model.timeout_ms);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, model.connect_timeout_ms);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, cancel ? 0L : 1L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, cancel ? CancelCallback : NULL);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(cancel));
+        CURLcode res = curl_easy_perform(curl);
+        *status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, status);
+        if (stats) {
+            curl_off_t retry_after = 0;
+            curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+            stats->http_status = *status;
+            stats->retry_after_s = static_cast<long>(retry_after);
+            curl_off_t lookup = 0, connect = 0, appconnect = 0;
+            long new_conns = 0;
+            curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+            curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+            curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+            curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_conns);
+            stats->reused_connection = (res == CURLE_OK && new_conns == 0);
+            stats->connect_ms = connect > lookup ? (connect - lookup) / 1000.0 : 0;
+            stats->tls_ms = appconnect > connect ? (appconnect - connect) / 1000.0 : 0;
+        }
+        return res;
+    }
+};
+
+AIClient::AIClient() : impl_(new Impl()), cache_(nullptr), cancel_(nullptr), recorder_(nullptr) {}
+
+AIClient::~AIClient() {
+    delete impl_;
+}
+
+void AIClient::set_cache(ResponseCache* cache) {
+    cache_ = cache;
+}
+
+void AIClient::set_cancel_flag(const std::atomic<bool>* cancel) {
+    cancel_ = cancel;
+}
+
+void AIClient::set_recorder(AIRecorder* recorder) {
+    recorder_ = recorder;
+}
+
+std::string AIClient::call(const std::string& prompt, const AIModelConfig& model, AICallStats* stats,
+                           uint64_t cache_key) {
+    return call(single_turn(prompt), model, stats, cache_key);
+}
+
+std::string AIClient::call(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                           AICallStats* stats, uint64_t cache_key) {
+    Clock::time_point start = Clock::now();
+    AICallStats local;
+    if (!stats && recorder_) stats = &local;   // 录制需要状态码与耗时
+    if (stats) *stats = AICallStats();
+    std::string cached;
+    if (cache_ && cache_key && cache_->get(cache_key, cached)) {
+        if (stats) {
+            stats->cache_hit = true;
+            stats->total_ms = elapsed_ms(start);
+        }
+        return cached;
+    }
+    std::string reply;
+    if (recorder_ && recorder_->mode() == RecordMode::Replay) {
+        reply = replay_reply(*recorder_, messages, model, nullptr, stats, cancel_);
+    } else {
+        reply = fetch(messages, model, stats);
+        if (recorder_) record_reply(*recorder_, messages, model, reply, *stats, cancel_);
+    }
+    if (cache_ && cache_key && !ai_reply_failed(reply)) cache_->put(cache_key, reply);
+    return reply;
+}
+
+std::string AIClient::fetch(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                            AICallStats* stats) {
+    Clock::time_point start = Clock::now();
+    Endpoint* ep = impl_->endpoint(model);
+    if (!ep) return "[AI调用失败] curl初始化失败";
+    std::string readBuffer;
+    std::string body_str = build_body(messages, model, false);
+    long status = 0;
+    CURLcode res = impl_->perform(*ep, model, body_str, false, WriteCallback, &readBuffer, &status, stats, cancel_);
+    if (stats) stats->total_ms = elapsed_ms(start);
     if (res != CURLE_OK) {
         return std::string("[AI调用失败] ") + curl_easy_strerror(res);
     }
     // 解析AI回复
-    try {
-        auto j = json::parse(readBuffer);
-        if (j.contains("choices") && j["choices"].size() > 0 && j["choices"][0]["message"].contains("content")) {
-            return j["choices"][0]["message"]["content"].get<std::string>();
-        } else {
-            return "[AI回复解析失败] " + readBuffer;
+    return parse_reply(readBuffer);
+}
+
+std::string AIClient::call_stream(const std::string& prompt, const AIModelConfig& model,
+                                  const TokenSink& sink, AICallStats* stats, uint64_t cache_key) {
+    return call_stream(single_turn(prompt), model, sink, stats, cache_key);
+}
+
+std::string AIClient::call_stream(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                                  const TokenSink& sink, AICallStats* stats, uint64_t cache_key) {
+    Clock::time_point start = Clock::now();
+    AICallStats local;
+    if (!stats && recorder_) stats = &local;
+    if (stats) *stats = AICallStats();
+    std::string cached;
+    if (cache_ && cache_key && cache_->get(cache_key, cached)) {
+        if (stats) {
+            stats->cache_hit = true;
+            stats->first_token_ms = stats->total_ms = elapsed_ms(start);
+            stats->chunks = 1;
         }
-    } catch (...) {
-        return "[AI回复JSON解析异常] " + readBuffer;
+        if (sink) sink(cached);
+        return cached;
+    }
+    std::string reply;
+    if (recorder_ && recorder_->mode() == RecordMode::Replay) {
+        reply = replay_reply(*recorder_, messages, model, &sink, stats, cancel_);
+    } else {
+        reply = fetch_stream(messages, model, sink, stats);
+        if (recorder_) record_reply(*recorder_, messages, model, reply, *stats, cancel_);
     }
+    if (cache_ && cache_key && !ai_reply_failed(reply)) cache_->put(cache_key, reply);
+    return reply;
+}
+
+std::string AIClient::fetch_stream(const std::vector<ChatMessage>& messages, const AIModelConfig& model,
+                                   const TokenSink& sink, AICallStats* stats) {
+    StreamState st;
+    st.sink = &sink;
+    st.done = false;
+    st.overflow = false;
+    st.start = Clock::now();
+    st.stats = stats;
+    st.cancel = cancel_;
+
+    Endpoint* ep = impl_->endpoint(model);
+    if (!ep) return "[AI调用失败] curl初始化失败";
+    std::string body_str = build_body(messages, model, true);
+    long status = 0;
+    CURLcode res = impl_->perform(*ep, model, body_str, true, StreamCallback, &st, &status, stats, cancel_);
+    if (!st.line.empty() && !st.overflow) handle_sse_line(st, st.line);
+    if (stats) stats->total_ms = elapsed_ms(st.start);
+
+    if (st.overflow) {
+        return "[AI回复解析失败] HTTP " + std::to_string(status) + " 响应不是SSE格式且单行超过" +
+               std::to_string(kMaxRawBytes / 1024) + "KB，已中止读取";
+    }
+    if (res != CURLE_OK) {
+        return std::string("[AI调用失败] ") + curl_easy_strerror(res);
+    }
+    if (st.reply.empty()) {
+        // 服务端未按SSE返回（错误或不支持stream），尝试按普通JSON解析
+        try {
+            auto j = json::parse(st.raw);
+            if (j.contains("choices") && j["choices"].size() > 0 && j["choices"][0]["message"].contains("content")) {
+                std::string text = j["choices"][0]["message"]["content"].get<std::string>();
+                if (sink) sink(text);
+                return text;
+            }
+        } catch (...) {
+        }
+        return "[AI回复解析失败] HTTP " + std::to_string(status) + " " + st.raw;
+    }
+    return st.reply;
+}
+
+std::string call_ai(const std::string& prompt, const AIModelConfig& model) {
+    return default_client().call(prompt, model);
+}
+
+std::string call_ai_stream(const std::string& prompt, const AIModelConfig& model,
+                           const TokenSink& sink, AICallStats* stats) {
+    return default_client().call_stream(prompt, model, sink, stats);
 }
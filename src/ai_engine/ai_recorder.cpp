@@ -0,0 +1,192 @@
+#include <ai_recorder.h>
+#include <utils.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t kRecordMagic = 0x52524941;   // "AIRR"
+const uint32_t kUnknownMs = std::numeric_limits<uint32_t>::max();
+
+// 录制记录头（40字节），后接回复文本并补齐到8字节
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t length;            // 回复字节数
+    uint64_t key;
+    uint32_t http_status;
+    uint32_t retry_after_s;
+    uint32_t first_token_us;    // 微秒，未知为kUnknownMs
+    uint32_t total_us;
+    uint32_t chunks;
+    uint32_t reserved;
+};
+
+size_t padded(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+uint32_t to_us(double ms) {
+    if (ms < 0) return kUnknownMs;
+    double us = ms * 1000;
+    return us >= kUnknownMs ? kUnknownMs - 1 : static_cast<uint32_t>(us);
+}
+
+double from_us(uint32_t us) {
+    return us == kUnknownMs ? -1 : us / 1000.0;
+}
+
+// 同一请求的多条录制与回放游标
+struct Slot {
+    std::vector<RecordedReply> replies;
+    size_t next;
+
+    Slot() : next(0) {}
+};
+
+} // namespace
+
+struct AIRecorder::Impl {
+    std::string path;
+    RecordMode mode;
+    bool replay_timing;
+    bool ok;
+    mutable std::mutex mutex;
+    std::ofstream out;
+    std::unordered_map<uint64_t, Slot> slots;
+    size_t count;
+    size_t replayed;
+    size_t misses;
+
+    Impl(const std::string& p, RecordMode m, bool timing)
+        : path(p), mode(m), replay_timing(timing), ok(false), count(0), replayed(0), misses(0) {
+        if (mode == RecordMode::Record) {
+            out.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+            ok = out.is_open();
+        } else {
+            ok = load();
+        }
+    }
+
+    // 顺序读取录制文件，遇到损坏的尾部则停止
+    bool load() {
+        std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+        if (!fin.is_open()) return false;
+        RecordHeader h;
+        while (fin.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+            if (h.magic != kRecordMagic) break;
+            RecordedReply r;
+            r.reply.resize(h.length);
+            if (h.length > 0 && !fin.read(&r.reply[0], h.length)) break;
+            fin.seekg(static_cast<std::streamoff>(padded(h.length) - h.length), std::ios::cur);
+            r.http_status = h.http_status;
+            r.retry_after_s = h.retry_after_s;
+            r.first_token_ms = from_us(h.first_token_us);
+            r.total_ms = from_us(h.total_us);
+            r.chunks = h.chunks;
+            slots[h.key].replies.push_back(r);
+            ++count;
+        }
+        return true;
+    }
+};
+
+AIRecorder::AIRecorder(const std::string& path, RecordMode mode, bool replay_timing)
+    : impl_(new Impl(path, mode, replay_timing)) {}
+
+AIRecorder::~AIRecorder() {
+    delete impl_;
+}
+
+bool AIRecorder::ok() const {
+    return impl_->ok;
+}
+
+RecordMode AIRecorder::mode() const {
+    return impl_->mode;
+}
+
+bool AIRecorder::replay_timing() const {
+    return impl_->replay_timing;
+}
+
+void AIRecorder::record(uint64_t key, const RecordedReply& reply) {
+    RecordHeader h = { kRecordMagic, static_cast<uint32_t>(reply.reply.size()), key,
+                       static_cast<uint32_t>(std::max(0L, reply.http_status)),
+                       static_cast<uint32_t>(std::max(0L, reply.retry_after_s)), to_us(reply.first_token_ms),
+                       to_us(reply.total_ms), static_cast<uint32_t>(reply.chunks), 0 };
+    static const char kPad[8] = { 0 };
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    if (!impl_->ok || impl_->mode != RecordMode::Record) return;
+    impl_->out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    impl_->out.write(reply.reply.data(), reply.reply.size());
+    impl_->out.write(kPad, padded(reply.reply.size()) - reply.reply.size());
+    // 每条立即落盘，进程中断时已录制的部分仍可回放
+    impl_->out.flush();
+    ++impl_->count;
+}
+
+bool AIRecorder::replay(uint64_t key, RecordedReply& reply) {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    std::unordered_map<uint64_t, Slot>::iterator it = impl_->slots.find(key);
+    if (it == impl_->slots.end() || it->second.replies.empty()) {
+        ++impl_->misses;
+        return false;
+    }
+    Slot& slot = it->second;
+    reply = slot.replies[slot.next];
+    slot.next = (slot.next + 1) % slot.replies.size();
+    ++impl_->replayed;
+    return true;
+}
+
+size_t AIRecorder::size() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return impl_->count;
+}
+
+size_t AIRecorder::misses() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return impl_->misses;
+}
+
+std::string AIRecorder::stats_line() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    std::ostringstream oss;
+    if (impl_->mode == RecordMode::Record) {
+        oss << "已录制 " << impl_->count << " 条（" << impl_->path << "）";
+    } else {
+        oss << "录制 " << impl_->count << " 条，回放 " << impl_->replayed << " 次，未找到 " << impl_->misses << " 次";
+    }
+    return oss.str();
+}
+
+uint64_t make_record_key(const std::string& model_id, const std::vector<ChatMessage>& messages) {
+    uint64_t h = Utils::fnv1a64(model_id.data(), model_id.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        // 以长度分隔各字段，避免拼接歧义
+        uint64_t sizes[2] = { messages[i].role.size(), messages[i].content.size() };
+        h = Utils::fnv1a64(sizes, sizeof(sizes), h);
+        h = Utils::fnv1a64(messages[i].role.data(), messages[i].role.size(), h);
+        h = Utils::fnv1a64(messages[i].content.data(), messages[i].content.size(), h);
+    }
+    return h;
+}
+
+std::vector<std::string> split_reply_chunks(const std::string& reply, size_t n) {
+    std::vector<std::string> parts;
+    if (n == 0) n = 1;
+    size_t step = std::max<size_t>(1, reply.size() / n);
+    size_t pos = 0;
+    while (pos < reply.size()) {
+        size_t end = std::min(reply.size(), pos + step);
+        while (end < reply.size() && (static_cast<unsigned char>(reply[end]) & 0xC0) == 0x80) ++end;
+        parts.push_back(reply.substr(pos, end - pos));
+        pos = end;
+    }
+    return parts;
+}
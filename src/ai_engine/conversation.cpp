@@ -0,0 +1,131 @@
+#include <conversation.h>
+#include <utils.h>
+#include <sstream>
+
+namespace {
+
+const size_t kUserSnippetBytes = 360;        // 摘要中每条用户消息保留的字节数
+const size_t kPointSnippetBytes = 240;       // 摘要中每条要点保留的字节数
+const size_t kMaxPointsPerReply = 6;         // 摘要中每条AI回复保留的要点数
+
+// 按字节截断，不切断UTF-8多字节字符
+std::string utf8_prefix(const std::string& s, size_t max_bytes) {
+    if (s.size() <= max_bytes) return s;
+    size_t n = max_bytes;
+    while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) --n;
+    return s.substr(0, n) + "…";
+}
+
+std::string trim_line(const std::string& line) {
+    size_t b = line.find_first_not_of(" \t\r");
+    if (b == std::string::npos) return "";
+    size_t e = line.find_last_not_of(" \t\r");
+    return line.substr(b, e - b + 1);
+}
+
+// 标题或列表要点
+bool is_point(const std::string& line) {
+    if (line.empty()) return false;
+    if (line[0] == '#' || line.compare(0, 2, "- ") == 0 || line.compare(0, 2, "* ") == 0) return true;
+    size_t i = 0;
+    while (i < line.size() && line[i] >= '0' && line[i] <= '9') ++i;
+    return i > 0 && i < line.size() && (line[i] == '.' || line[i] == ')');
+}
+
+size_t tokens_of(const std::vector<ChatMessage>& messages) {
+    size_t total = 0;
+    for (size_t i = 0; i < messages.size(); ++i) total += Utils::estimate_tokens(messages[i].content) + 4;
+    return total;
+}
+
+} // namespace
+
+std::string summarize_turns(const std::vector<ChatMessage>& turns) {
+    std::ostringstream out;
+    for (size_t i = 0; i < turns.size(); ++i) {
+        const ChatMessage& m = turns[i];
+        if (m.role == "user") {
+            std::string text = m.content;
+            for (size_t p = 0; p < text.size(); ++p) {
+                if (text[p] == '\n' || text[p] == '\r') text[p] = ' ';
+            }
+            out << "- 用户：" << utf8_prefix(trim_line(text), kUserSnippetBytes) << "\n";
+            continue;
+        }
+        std::istringstream in(m.content);
+        std::string line;
+        size_t points = 0;
+        out << "- AI要点：";
+        while (points < kMaxPointsPerReply && std::getline(in, line)) {
+            line = trim_line(line);
+            if (!is_point(line)) continue;
+            out << (points == 0 ? "" : "；") << utf8_prefix(line, kPointSnippetBytes);
+            ++points;
+        }
+        if (points == 0) out << utf8_prefix(trim_line(m.content), kPointSnippetBytes);
+        out << "\n";
+    }
+    return out.str();
+}
+
+Conversation::Conversation(const std::string& system_prompt, size_t history_budget_tokens)
+    : system_prompt_(system_prompt), budget_(history_budget_tokens), summarized_(0), summarizer_(summarize_turns) {}
+
+void Conversation::set_context(const std::string& content) {
+    context_ = content;
+}
+
+void Conversation::add_user(const std::string& content) {
+    // 上一轮AI调用失败等情况下会出现连续的用户消息，合并为一条
+    if (!history_.empty() && history_.back().role == "user") {
+        history_.back().content += "\n" + content;
+    } else {
+        history_.push_back(ChatMessage("user", content));
+    }
+    compact();
+}
+
+void Conversation::add_assistant(const std::string& content) {
+    history_.push_back(ChatMessage("assistant", content));
+    compact();
+}
+
+void Conversation::set_summarizer(const TurnSummarizer& summarizer) {
+    summarizer_ = summarizer;
+}
+
+void Conversation::compact() {
+    // 至少保留最近的一问一答
+    while (history_.size() > 2 && tokens_of(history_) > budget_) {
+        std::vector<ChatMessage> oldest(history_.begin(), history_.begin() + 2);
+        summary_ += summarizer_(oldest);
+        history_.erase(history_.begin(), history_.begin() + 2);
+        summarized_ += 2;
+    }
+    // 摘要本身最多占预算的一半，超出时丢弃最早的行
+    while (!summary_.empty() && Utils::estimate_tokens(summary_) > budget_ / 2) {
+        size_t nl = summary_.find('\n');
+        summary_.erase(0, nl == std::string::npos ? std::string::npos : nl + 1);
+    }
+}
+
+std::vector<ChatMessage> Conversation::messages() const {
+    std::vector<ChatMessage> out;
+    out.reserve(history_.size() + 2);
+    if (!system_prompt_.empty()) out.push_back(ChatMessage("system", system_prompt_));
+    std::string first = context_;
+    if (!summary_.empty()) first += "\n【此前对话摘要】\n" + summary_;
+    size_t begin = 0;
+    if (!history_.empty() && history_[0].role == "user") {
+        // 保持user/assistant交替：紧随首条消息的用户消息并入首条
+        first += "\n" + history_[0].content;
+        begin = 1;
+    }
+    out.push_back(ChatMessage("user", first));
+    out.insert(out.end(), history_.begin() + begin, history_.end());
+    return out;
+}
+
+size_t Conversation::estimated_tokens() const {
+    return tokens_of(messages());
+}
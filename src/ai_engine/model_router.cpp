@@ -0,0 +1,446 @@
+#include <model_router.h>
+#include <response_cache.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t kLatencySamples = 64;     // 每个模型保留的最近延迟样本数（用于p95）
+const size_t kMinP95Samples = 8;       // 样本少于该值时使用默认对冲等待时间
+const double kErrorWeight = 4.0;       // 排序时错误率对延迟的放大系数
+const long kHttpTooManyRequests = 429;
+
+double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+struct ModelState {
+    AIModelConfig config;
+    double latency_ewma;          // -1表示无样本
+    double error_ewma;
+    std::vector<double> samples;  // 环形缓冲
+    size_t next_sample;
+    size_t calls, errors, throttled, hedge_wins;
+    int consecutive_failures;
+    Clock::time_point cool_until;
+
+    explicit ModelState(const AIModelConfig& c)
+        : config(c), latency_ewma(-1), error_ewma(0), next_sample(0), calls(0), errors(0), throttled(0),
+          hedge_wins(0), consecutive_failures(0), cool_until(Clock::now()) {}
+
+    double p95() const {
+        if (samples.size() < kMinP95Samples) return -1;
+        std::vector<double> v(samples);
+        size_t k = (v.size() * 95 + 99) / 100 - 1;
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+};
+
+// 一次请求尝试
+struct Attempt {
+    int index;                  // 在Race::attempts中的下标
+    int model;
+    bool hedge;                 // 是否为对冲请求
+    std::atomic<bool> cancel;
+    std::atomic<bool> done;     // 置位后请求线程不再访问本结构以外的共享状态
+    bool failed;
+    std::string reply;
+    AICallStats stats;
+
+    Attempt(int i, int m, bool h) : index(i), model(m), hedge(h), cancel(false), done(false), failed(false) {}
+};
+
+// 一次路由调用中的全部尝试，由调用线程与各请求线程共享
+struct Race {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<ChatMessage> messages;
+    bool stream;
+    const TokenSink* sink;      // 仅胜出的请求在调用方等待期间使用
+    std::vector<std::shared_ptr<Attempt> > attempts;
+    int winner;                 // 胜出请求下标，-1表示尚未决出
+    double first_token_ms;
+    Clock::time_point start;
+
+    Race() : stream(false), sink(nullptr), winner(-1), first_token_ms(-1), start(Clock::now()) {}
+
+    // 须持有mutex
+    void claim(int index) {
+        winner = index;
+        for (size_t i = 0; i < attempts.size(); ++i) {
+            if (static_cast<int>(i) != index) attempts[i]->cancel = true;
+        }
+        cv.notify_all();
+    }
+};
+
+} // namespace
+
+struct ModelRouter::Impl {
+    RouterOptions options;
+    std::vector<ModelState> models;
+    ResponseCache* cache;
+    AIRecorder* recorder;
+    mutable std::mutex mutex;              // 保护models与idle
+    std::vector<AIClient*> idle;           // 空闲客户端池，连接在请求间复用
+    std::minstd_rand rng;
+    std::mutex threads_mutex;
+    std::vector<std::pair<std::thread, std::shared_ptr<Attempt> > > threads;
+
+    Impl(const std::vector<AIModelConfig>& configs, const RouterOptions& opts)
+        : options(opts), cache(nullptr), recorder(nullptr), rng(static_cast<unsigned>(Clock::now().time_since_epoch().count())) {
+        for (size_t i = 0; i < configs.size(); ++i) models.push_back(ModelState(configs[i]));
+    }
+
+    ~Impl() {
+        for (size_t i = 0; i < threads.size(); ++i) threads[i].first.join();
+        for (size_t i = 0; i < idle.size(); ++i) delete idle[i];
+    }
+
+    AIClient* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.empty()) return new AIClient();
+        AIClient* c = idle.back();
+        idle.pop_back();
+        return c;
+    }
+
+    void release(AIClient* c) {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(c);
+    }
+
+    // 可用模型按 延迟EWMA x (1 + k x 错误率) 升序，退避中的模型排在最后；无样本时保持配置顺序
+    std::vector<int> ranking() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        std::vector<std::pair<std::pair<int, double>, int> > keyed;
+        for (size_t i = 0; i < models.size(); ++i) {
+            const ModelState& m = models[i];
+            double latency = m.latency_ewma >= 0 ? m.latency_ewma : options.hedge_default_ms;
+            double score = latency * (1 + kErrorWeight * m.error_ewma);
+            int cooling = m.cool_until > now ? 1 : 0;
+            if (cooling) score = std::chrono::duration<double, std::milli>(m.cool_until - now).count();
+            keyed.push_back(std::make_pair(std::make_pair(cooling, score), static_cast<int>(i)));
+        }
+        std::stable_sort(keyed.begin(), keyed.end());
+        std::vector<int> order;
+        for (size_t i = 0; i < keyed.size(); ++i) order.push_back(keyed[i].second);
+        return order;
+    }
+
+    double hedge_delay(int model) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        double p95 = models[model].p95();
+        double delay = p95 > 0 ? p95 : options.hedge_default_ms;
+        return std::min(options.hedge_max_ms, std::max(options.hedge_min_ms, delay));
+    }
+
+    double cooldown_remaining_ms(int model) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        const ModelState& m = models[model];
+        return m.cool_until > now ? std::chrono::duration<double, std::milli>(m.cool_until - now).count() : 0;
+    }
+
+    // 记录一次完成（未被取消）的请求
+    void record(const Attempt& a, bool stream) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ModelState& m = models[a.model];
+        double alpha = options.ewma_alpha;
+        ++m.calls;
+        m.error_ewma = alpha * (a.failed ? 1 : 0) + (1 - alpha) * m.error_ewma;
+        if (!a.failed) {
+            double sample = stream && a.stats.first_token_ms >= 0 ? a.stats.first_token_ms : a.stats.total_ms;
+            m.latency_ewma = m.latency_ewma < 0 ? sample : alpha * sample + (1 - alpha) * m.latency_ewma;
+            if (m.samples.size() < kLatencySamples) m.samples.push_back(sample);
+            else m.samples[m.next_sample] = sample;
+            m.next_sample = (m.next_sample + 1) % kLatencySamples;
+            m.consecutive_failures = 0;
+            return;
+        }
+        ++m.errors;
+        if (a.stats.http_status == kHttpTooManyRequests) ++m.throttled;
+        // 指数退避（带±20%抖动，不超过上限）；服务端给出的Retry-After是下限，不受上限截断
+        int n = std::min(m.consecutive_failures++, 16);
+        double backoff = options.backoff_base_ms * (1 << n) * (0.8 + 0.4 * (rng() % 1000) / 1000.0);
+        backoff = std::min(backoff, options.backoff_max_ms);
+        backoff = std::max(backoff, a.stats.retry_after_s * 1000.0);
+        m.cool_until = Clock::now() + std::chrono::milliseconds(static_cast<long long>(backoff));
+    }
+
+    void run_attempt(std::shared_ptr<Race> race, std::shared_ptr<Attempt> a) {
+        AIClient* client = acquire();
+        client->set_cancel_flag(&a->cancel);
+        client->set_recorder(recorder);
+        const AIModelConfig& config = models[a->model].config;
+        std::string reply;
+        if (race->stream) {
+            reply = client->call_stream(race->messages, config, [race, a](const std::string& delta) {
+                bool mine;
+                {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    if (race->winner < 0) {
+                        race->first_token_ms = elapsed_ms(race->start);
+                        race->claim(a->index);
+                    }
+                    mine = race->winner == a->index;
+                }
+                if (!mine) a->cancel = true;
+                else if (race->sink && *race->sink) (*race->sink)(delta);
+            }, &a->stats);
+        } else {
+            reply = client->call(race->messages, config, &a->stats);
+        }
+        client->set_cancel_flag(nullptr);
+        release(client);
+
+        bool cancelled = a->cancel.load();
+        a->failed = cancelled || ai_reply_failed(reply);
+        if (!cancelled) record(*a, race->stream);
+        std::lock_guard<std::mutex> lock(race->mutex);
+        a->reply.swap(reply);
+        if (!a->failed && race->winner < 0) race->claim(a->index);
+        a->done = true;
+        race->cv.notify_all();
+    }
+
+    // 发出一个请求，须持有race->mutex
+    void launch(const std::shared_ptr<Race>& race, int model, bool hedge) {
+        std::shared_ptr<Attempt> a(new Attempt(static_cast<int>(race->attempts.size()), model, hedge));
+        race->attempts.push_back(a);
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        // 回收已结束的请求线程
+        for (size_t i = 0; i < threads.size();) {
+            if (threads[i].second->done) {
+                threads[i].first.join();
+                threads[i] = std::move(threads.back());
+                threads.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        threads.push_back(std::make_pair(std::thread(&Impl::run_attempt, this, race, a), a));
+    }
+
+    std::string route(const std::vector<ChatMessage>& messages, const TokenSink* sink, AICallStats* stats,
+                      uint64_t cache_key, RouteInfo* info) {
+        Clock::time_point start = Clock::now();
+        if (stats) *stats = AICallStats();
+        if (info) *info = RouteInfo();
+        std::string cached;
+        if (cache && cache_key && cache->get(cache_key, cached)) {
+            if (stats) {
+                stats->cache_hit = true;
+                stats->first_token_ms = stats->total_ms = elapsed_ms(start);
+                stats->chunks = 1;
+            }
+            if (sink && *sink) (*sink)(cached);
+            return cached;
+        }
+        if (models.empty()) return "[AI调用失败] 未配置AI模型";
+
+        std::shared_ptr<Race> race(new Race());
+        race->messages = messages;
+        race->stream = sink != nullptr;
+        race->sink = sink;
+        std::vector<int> order = ranking();
+        int max_attempts = std::max(1, options.max_attempts);
+        bool can_hedge = options.hedge && order.size() > 1;
+        size_t next = 0;
+        bool hedged = false, failed_over = false;
+
+        std::unique_lock<std::mutex> lock(race->mutex);
+        launch(race, order[next++ % order.size()], false);
+        Clock::time_point hedge_at = start + std::chrono::milliseconds(static_cast<long long>(hedge_delay(order[0])));
+        while (true) {
+            if (race->winner >= 0) {
+                if (race->attempts[race->winner]->done) break;
+                race->cv.wait(lock);   // 流式：已决出胜者，等待其完成
+                continue;
+            }
+            bool running = false;
+            for (size_t i = 0; i < race->attempts.size(); ++i) running = running || !race->attempts[i]->done;
+            if (!running) {
+                // 全部失败：切换到下一个模型，若其处于退避期则等待
+                if (static_cast<int>(race->attempts.size()) >= max_attempts) break;
+                int model = order[next++ % order.size()];
+                double wait = cooldown_remaining_ms(model);
+                if (wait > 0) {
+                    lock.unlock();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long long>(wait)));
+                    lock.lock();
+                }
+                failed_over = true;
+                launch(race, model, false);
+                hedge_at = Clock::now() + std::chrono::milliseconds(static_cast<long long>(hedge_delay(model)));
+                continue;
+            }
+            if (can_hedge && !hedged && static_cast<int>(race->attempts.size()) < max_attempts) {
+                if (Clock::now() >= hedge_at) {
+                    hedged = true;
+                    launch(race, order[next++ % order.size()], true);
+                } else {
+                    race->cv.wait_until(lock, hedge_at);
+                }
+                continue;
+            }
+            race->cv.wait(lock);
+        }
+
+        // 胜出者；全部失败时取最后完成的失败回复
+        std::shared_ptr<Attempt> result;
+        if (race->winner >= 0) {
+            result = race->attempts[race->winner];
+        } else {
+            for (size_t i = 0; i < race->attempts.size(); ++i) {
+                if (race->attempts[i]->done) result = race->attempts[i];
+            }
+        }
+        double first_token_ms = race->first_token_ms;
+        int attempts = static_cast<int>(race->attempts.size());
+        lock.unlock();
+
+        if (stats) {
+            *stats = result->stats;
+            stats->total_ms = elapsed_ms(start);
+            if (race->stream) stats->first_token_ms = first_token_ms;
+        }
+        if (info) {
+            info->model = models[result->model].config.name;
+            info->attempts = attempts;
+            info->hedged = hedged;
+            info->failed_over = failed_over;
+        }
+        if (!result->failed && result->hedge) {
+            std::lock_guard<std::mutex> guard(mutex);
+            ++models[result->model].hedge_wins;
+        }
+        if (!result->failed && cache && cache_key) cache->put(cache_key, result->reply);
+        return result->reply;
+    }
+};
+
+ModelRouter::ModelRouter(const std::vector<AIModelConfig>& models, const RouterOptions& options)
+    : impl_(new Impl(models, options)) {}
+
+ModelRouter::~ModelRouter() {
+    delete impl_;
+}
+
+void ModelRouter::set_cache(ResponseCache* cache) {
+    impl_->cache = cache;
+}
+
+void ModelRouter::set_recorder(AIRecorder* recorder) {
+    impl_->recorder = recorder;
+}
+
+std::string ModelRouter::call(const std::vector<ChatMessage>& messages, AICallStats* stats, uint64_t cache_key,
+                              RouteInfo* route) {
+    return impl_->route(messages, nullptr, stats, cache_key, route);
+}
+
+std::string ModelRouter::call_stream(const std::vector<ChatMessage>& messages, const TokenSink& sink,
+                                     AICallStats* stats, uint64_t cache_key, RouteInfo* route) {
+    return impl_->route(messages, &sink, stats, cache_key, route);
+}
+
+size_t ModelRouter::context_tokens() const {
+    size_t tokens = 0;
+    for (size_t i = 0; i < impl_->models.size(); ++i) {
+        size_t t = impl_->models[i].config.context_tokens;
+        if (i == 0 || t < tokens) tokens = t;
+    }
+    return tokens;
+}
+
+size_t ModelRouter::history_tokens() const {
+    size_t tokens = 0;
+    for (size_t i = 0; i < impl_->models.size(); ++i) {
+        size_t t = impl_->models[i].config.history_tokens;
+        if (i == 0 || t < tokens) tokens = t;
+    }
+    return tokens;
+}
+
+std::string ModelRouter::cache_scope() const {
+    std::string scope;
+    for (size_t i = 0; i < impl_->models.size(); ++i) {
+        if (i > 0) scope += ",";
+        scope += impl_->models[i].config.model_id;
+    }
+    return scope;
+}
+
+std::vector<ModelHealth> ModelRouter::health() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    Clock::time_point now = Clock::now();
+    std::vector<ModelHealth> out;
+    for (size_t i = 0; i < impl_->models.size(); ++i) {
+        const ModelState& m = impl_->models[i];
+        ModelHealth h;
+        h.name = m.config.name;
+        h.latency_ewma_ms = m.latency_ewma;
+        h.error_ewma = m.error_ewma;
+        h.p95_ms = m.p95();
+        h.calls = m.calls;
+        h.errors = m.errors;
+        h.throttled = m.throttled;
+        h.hedge_wins = m.hedge_wins;
+        h.cooling = m.cool_until > now;
+        out.push_back(h);
+    }
+    return out;
+}
+
+std::string ModelRouter::health_line() const {
+    std::vector<ModelHealth> hs = health();
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(0);
+    for (size_t i = 0; i < hs.size(); ++i) {
+        const ModelHealth& h = hs[i];
+        if (i > 0) oss << "；";
+        oss << h.name << "：调用" << h.calls << "次";
+        if (h.latency_ewma_ms >= 0) oss << "，延迟EWMA " << h.latency_ewma_ms << " ms";
+        if (h.p95_ms >= 0) oss << "，p95 " << h.p95_ms << " ms";
+        oss << "，错误率 " << std::setprecision(1) << h.error_ewma * 100 << "%" << std::setprecision(0);
+        if (h.throttled > 0) oss << "，限流" << h.throttled << "次";
+        if (h.hedge_wins > 0) oss << "，对冲胜出" << h.hedge_wins << "次";
+    }
+    return oss.str();
+}
+
+void load_router_options(const std::string& path, RouterOptions& options) {
+    std::ifstream fin(path.c_str());
+    if (!fin.is_open()) return;
+    try {
+        json j;
+        fin >> j;
+        if (!j.contains("routing") || !j["routing"].is_object()) return;
+        const json& r = j["routing"];
+        options.hedge = r.value("hedge", options.hedge);
+        options.hedge_default_ms = r.value("hedge_default_ms", options.hedge_default_ms);
+        options.hedge_min_ms = r.value("hedge_min_ms", options.hedge_min_ms);
+        options.hedge_max_ms = r.value("hedge_max_ms", options.hedge_max_ms);
+        options.max_attempts = r.value("max_attempts", options.max_attempts);
+        options.backoff_base_ms = r.value("backoff_base_ms", options.backoff_base_ms);
+        options.backoff_max_ms = r.value("backoff_max_ms", options.backoff_max_ms);
+        options.ewma_alpha = r.value("ewma_alpha", options.ewma_alpha);
+    } catch (...) {
+    }
+}
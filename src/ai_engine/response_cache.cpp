@@ -0,0 +1,310 @@
+#include <response_cache.h>
+#include <utils.h>
+#include <sql_normalize.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t kRecordMagic = 0x43524941;   // "AIRC"
+const char* const kDataFile = "responses.dat";
+
+// 磁盘记录头（24字节），后接payload并补齐到8字节
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t length;      // payload字节数
+    uint64_t key;
+    int64_t created;      // 写入时间（unix秒）
+};
+
+size_t padded(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+int64_t now_seconds() {
+    return static_cast<int64_t>(std::time(nullptr));
+}
+
+void make_dir(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+// 跨进程互斥：同一缓存目录可能被多个进程（常驻服务、批量、交互）同时使用，
+// 追加与压缩（删除+重命名数据文件）都在锁文件的排他锁下进行；Windows下退化为进程内互斥
+class DirLock {
+public:
+    explicit DirLock(const std::string& data_path) : fd_(-1) {
+#ifndef _WIN32
+        std::string lock_path = data_path + ".lock";
+        fd_ = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ >= 0 && flock(fd_, LOCK_EX) != 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+#else
+        (void)data_path;
+#endif
+    }
+
+    ~DirLock() {
+#ifndef _WIN32
+        if (fd_ >= 0) close(fd_);   // 关闭即释放flock
+#endif
+    }
+
+private:
+    DirLock(const DirLock&);
+    DirLock& operator=(const DirLock&);
+
+    int fd_;
+};
+
+// 磁盘索引项：记录在数据文件中的位置
+struct DiskEntry {
+    uint64_t offset;      // payload起始偏移
+    uint32_t length;
+    int64_t created;
+};
+
+// 内存LRU项
+struct MemEntry {
+    uint64_t key;
+    std::string value;
+    int64_t created;
+};
+
+} // namespace
+
+struct ResponseCache::Impl {
+    CacheOptions options;
+    std::string path;
+    mutable std::mutex mutex;
+    std::list<MemEntry> lru;                                           // 头部为最近使用
+    std::unordered_map<uint64_t, std::list<MemEntry>::iterator> memory;
+    std::unordered_map<uint64_t, DiskEntry> disk;
+    uint64_t file_size;
+    CacheStats stats;
+
+    explicit Impl(const CacheOptions& opts) : options(opts), file_size(0) {
+        if (options.dir.empty()) return;
+        make_dir(options.dir);
+        path = options.dir + "/" + kDataFile;
+        load_index();
+    }
+
+    bool expired(int64_t created) const {
+        return options.ttl_seconds > 0 && now_seconds() - created > options.ttl_seconds;
+    }
+
+    // 顺序扫描数据文件建立索引，遇到损坏的尾部则截断
+    void load_index() {
+        DirLock lock(path);
+        std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+        if (!fin.is_open()) return;
+        uint64_t offset = 0;
+        RecordHeader h;
+        while (fin.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+            if (h.magic != kRecordMagic) break;
+            uint64_t next = offset + sizeof(h) + padded(h.length);
+            fin.seekg(static_cast<std::streamoff>(next));
+            if (!fin) break;
+            DiskEntry e = { offset + sizeof(h), h.length, h.created };
+            disk[h.key] = e;
+            offset = next;
+        }
+        fin.close();
+        file_size = offset;
+        std::ifstream probe(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        if (probe.is_open() && static_cast<uint64_t>(probe.tellg()) != offset) {
+            probe.close();
+            compact();
+        }
+    }
+
+    // 读取前先核对记录头：其他进程压缩过数据文件时偏移会失效，不能把别的查询的回复当作命中
+    bool read_disk(uint64_t key, const DiskEntry& e, std::string& value) const {
+        if (e.offset < sizeof(RecordHeader)) return false;
+        std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+        if (!fin.is_open()) return false;
+        fin.seekg(static_cast<std::streamoff>(e.offset - sizeof(RecordHeader)));
+        RecordHeader h;
+        if (!fin.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+        if (h.magic != kRecordMagic || h.key != key || h.length != e.length || h.created != e.created) return false;
+        value.resize(e.length);
+        return e.length == 0 || static_cast<bool>(fin.read(&value[0], e.length));
+    }
+
+    static std::string encode_record(uint64_t key, const std::string& value, int64_t created) {
+        RecordHeader h = { kRecordMagic, static_cast<uint32_t>(value.size()), key, created };
+        std::string record(reinterpret_cast<const char*>(&h), sizeof(h));
+        record += value;
+        record.resize(sizeof(h) + padded(value.size()), '\0');
+        return record;
+    }
+
+    void append_record(std::ofstream& out, uint64_t key, const std::string& value, int64_t created) {
+        std::string record = encode_record(key, value, created);
+        out.write(record.data(), record.size());
+    }
+
+    // 追加一条记录，返回其payload偏移；偏移取自文件的实际末尾（其他进程也可能在追加）
+    bool append_disk(uint64_t key, const std::string& value, int64_t created, uint64_t& offset) {
+        std::string record = encode_record(key, value, created);
+        std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+        if (!out.is_open()) return false;
+        out.seekp(0, std::ios::end);
+        std::streamoff end = out.tellp();
+        if (end < 0) return false;
+        out.write(record.data(), record.size());
+        out.flush();
+        if (!out) return false;
+        offset = static_cast<uint64_t>(end) + sizeof(RecordHeader);
+        file_size = static_cast<uint64_t>(end) + record.size();
+        return true;
+    }
+
+    // 重写数据文件：丢弃过期与被覆盖的记录，按写入时间保留最新的记录直到上限的一半（调用方须持有DirLock）
+    void compact() {
+        std::vector<std::pair<int64_t, uint64_t> > order;
+        for (std::unordered_map<uint64_t, DiskEntry>::iterator it = disk.begin(); it != disk.end(); ++it) {
+            if (!expired(it->second.created)) order.push_back(std::make_pair(it->second.created, it->first));
+        }
+        std::sort(order.rbegin(), order.rend());
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return;
+        std::unordered_map<uint64_t, DiskEntry> kept;
+        uint64_t size = 0;
+        std::string value;
+        for (size_t i = 0; i < order.size(); ++i) {
+            const DiskEntry& e = disk[order[i].second];
+            uint64_t record = sizeof(RecordHeader) + padded(e.length);
+            if (size + record > options.max_disk_bytes / 2) break;
+            if (!read_disk(order[i].second, e, value)) continue;
+            append_record(out, order[i].second, value, e.created);
+            DiskEntry ne = { size + sizeof(RecordHeader), e.length, e.created };
+            kept[order[i].second] = ne;
+            size += record;
+        }
+        out.close();
+        std::remove(path.c_str());
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) return;
+        disk.swap(kept);
+        file_size = size;
+        ++stats.compactions;
+    }
+
+    void remember(uint64_t key, const std::string& value, int64_t created) {
+        std::unordered_map<uint64_t, std::list<MemEntry>::iterator>::iterator it = memory.find(key);
+        if (it != memory.end()) lru.erase(it->second);
+        MemEntry e = { key, value, created };
+        lru.push_front(e);
+        memory[key] = lru.begin();
+        while (lru.size() > options.memory_entries && !lru.empty()) {
+            memory.erase(lru.back().key);
+            lru.pop_back();
+        }
+    }
+};
+
+ResponseCache::ResponseCache(const CacheOptions& options) : impl_(new Impl(options)) {}
+
+ResponseCache::~ResponseCache() {
+    delete impl_;
+}
+
+bool ResponseCache::get(uint64_t key, std::string& value) {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    std::unordered_map<uint64_t, std::list<MemEntry>::iterator>::iterator it = impl_->memory.find(key);
+    if (it != impl_->memory.end()) {
+        if (impl_->expired(it->second->created)) {
+            impl_->lru.erase(it->second);
+            impl_->memory.erase(it);
+            ++impl_->stats.expired;
+            ++impl_->stats.misses;
+            return false;
+        }
+        impl_->lru.splice(impl_->lru.begin(), impl_->lru, it->second);
+        value = it->second->value;
+        ++impl_->stats.hits;
+        return true;
+    }
+    std::unordered_map<uint64_t, DiskEntry>::iterator d = impl_->disk.find(key);
+    if (d != impl_->disk.end()) {
+        if (impl_->expired(d->second.created)) {
+            ++impl_->stats.expired;
+        } else if (impl_->read_disk(key, d->second, value)) {
+            impl_->remember(key, value, d->second.created);
+            ++impl_->stats.hits;
+            ++impl_->stats.disk_hits;
+            return true;
+        } else {
+            impl_->disk.erase(d);   // 记录已被其他进程压缩掉或覆盖
+        }
+    }
+    ++impl_->stats.misses;
+    return false;
+}
+
+void ResponseCache::put(uint64_t key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    int64_t created = now_seconds();
+    impl_->remember(key, value, created);
+    ++impl_->stats.stores;
+    if (impl_->path.empty()) return;
+    DirLock file_lock(impl_->path);
+    uint64_t offset = 0;
+    if (!impl_->append_disk(key, value, created, offset)) return;
+    DiskEntry e = { offset, static_cast<uint32_t>(value.size()), created };
+    impl_->disk[key] = e;
+    if (impl_->file_size > impl_->options.max_disk_bytes) impl_->compact();
+}
+
+CacheStats ResponseCache::stats() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return impl_->stats;
+}
+
+std::string ResponseCache::stats_line() const {
+    CacheStats s = stats();
+    uint64_t lookups = s.hits + s.misses;
+    std::ostringstream oss;
+    oss << "命中 " << s.hits << "（磁盘 " << s.disk_hits << "）/ 未命中 " << s.misses;
+    if (lookups > 0) oss << "（命中率 " << std::fixed << std::setprecision(1) << s.hits * 100.0 / lookups << "%）";
+    return oss.str();
+}
+
+std::string normalize_sql_for_cache(const std::string& sql) {
+    return Utils::normalize_sql(sql);
+}
+
+uint64_t make_cache_key(const std::string& sql, uint64_t plan_fingerprint,
+                        const std::string& model_id, int prompt_version) {
+    std::string normalized = normalize_sql_for_cache(sql);
+    uint64_t h = Utils::fnv1a64(normalized.data(), normalized.size());
+    h = Utils::fnv1a64(&plan_fingerprint, sizeof(plan_fingerprint), h);
+    h = Utils::fnv1a64(model_id.data(), model_id.size(), h);
+    h = Utils::fnv1a64(&prompt_version, sizeof(prompt_version), h);
+    return h == 0 ? 1 : h;   // 0 保留为"不使用缓存"
+}
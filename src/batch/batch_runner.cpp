@@ -0,0 +1,598 @@
+#include "batch_runner.h"
+#include "bounded_queue.h"
+#include "agent3_strategy.h"
+#include "ai_engine.h"
+#include "model_router.h"
+#include "ai_recorder.h"
+#include "trace.h"
+#include "plan_diff.h"
+#include "sql_normalize.h"
+#include "knowledge_base.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <json.hpp>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 结果中计划对比文本最多列出的节点数
+const size_t kDiffReportNodes = 20;
+// 作为few-shot上下文的相似案例数与每条方案摘要的最大字节数
+const size_t kFewShotCases = 3;
+const size_t kCaseBriefChars = 600;
+
+// 同一缓存键（SQL形态+计划指纹+模型+提示词版本）的AI调用进行中时只发出一次，其余任务等待并复用回复；
+// 调用结束即移除，之后的重复查询交给ResponseCache（遵守有效期与--no-cache），常驻运行时不累积
+struct AICallDedup {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_future<std::string> > calls;
+};
+
+// 去重表中由本任务发出的一次调用：析构时移除键并唤醒等待者，
+// AI调用抛出异常时以失败回复结束等待（等待者随后自行重试），键不会残留
+struct DedupSlot {
+    AICallDedup* dedup;
+    uint64_t key;
+    std::shared_ptr<std::promise<std::string> > promise;
+    std::string reply;
+    bool settled;
+
+    DedupSlot() : dedup(nullptr), key(0), settled(false) {}
+
+    void settle(const std::string& r) {
+        reply = r;
+        settled = true;
+    }
+
+    ~DedupSlot() {
+        if (!promise) return;
+        {
+            std::lock_guard<std::mutex> lock(dedup->mutex);
+            dedup->calls.erase(key);
+        }
+        promise->set_value(settled ? reply : std::string("[AI调用失败] 同形态请求出错"));
+    }
+
+private:
+    DedupSlot(const DedupSlot&);
+    DedupSlot& operator=(const DedupSlot&);
+};
+
+// 序列化为单行JSON：输入中的非法UTF-8字节替换为U+FFFD，个别任务的坏数据不会让整批中止
+std::string dump_line(const json& j) {
+    return j.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+void make_dir(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+    if (!fin.is_open()) return false;
+    std::ostringstream oss;
+    oss << fin.rdbuf();
+    out = oss.str();
+    return true;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool is_directory(const std::string& path) {
+#ifdef _WIN32
+    DWORD attr = GetFileAttributesA(path.c_str());
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return false;
+    closedir(dir);
+    return true;
+#endif
+}
+
+std::vector<std::string> list_directory(const std::string& path) {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE) return names;
+    do {
+        names.push_back(data.cFileName);
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return names;
+    while (struct dirent* ent = readdir(dir)) names.push_back(ent->d_name);
+    closedir(dir);
+#endif
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::string first_string(const json& j, const char* const* keys, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (j.contains(keys[i]) && j[keys[i]].is_string()) return j[keys[i]].get<std::string>();
+    }
+    return "";
+}
+
+// 解析一行JSONL：{"id":..., "sql":..., "explain":...}
+BatchJob parse_jsonl_line(const std::string& line, size_t index) {
+    static const char* const kIdKeys[] = { "id", "request_id", "name" };
+    static const char* const kSqlKeys[] = { "sql", "query" };
+    static const char* const kPlanKeys[] = { "explain", "explain_result", "plan" };
+    static const char* const kAfterKeys[] = { "explain_after", "after_explain", "plan_after" };
+    static const char* const kStrategyKeys[] = { "strategy", "applied_strategy" };
+    static const char* const kAppliedSqlKeys[] = { "applied_sql", "sql_after" };
+    BatchJob job;
+    job.index = index;
+    job.id = std::to_string(index);
+    try {
+        json j = json::parse(line);
+        std::string id = first_string(j, kIdKeys, 3);
+        if (id.empty() && j.contains("id") && j["id"].is_number()) id = j["id"].dump();
+        if (!id.empty()) job.id = id;
+        job.input.sql = first_string(j, kSqlKeys, 2);
+        job.input.explain_result = first_string(j, kPlanKeys, 3);
+        job.explain_after = first_string(j, kAfterKeys, 3);
+        job.applied_strategy = first_string(j, kStrategyKeys, 2);
+        job.applied_sql = first_string(j, kAppliedSqlKeys, 2);
+        if (j.contains("options") && j["options"].is_object()) {
+            const json& o = j["options"];
+            job.use_ai = o.value("use_ai", job.use_ai);
+            job.force_ai = o.value("force_ai", job.force_ai);
+        }
+    } catch (const std::exception& e) {
+        // 解析错误信息会带上出错位置附近的原始字节
+        job.error = Utils::sanitize_utf8(std::string("JSON解析失败: ") + e.what());
+    }
+    return job;
+}
+
+// 读取输入并逐条入队，队列满时阻塞（背压），返回入队条数
+size_t produce_jobs(const BatchOptions& options, BoundedQueue<BatchJob>& queue) {
+    size_t count = 0;
+    if (is_directory(options.input_path)) {
+        static const char* const kPlanExts[] = { ".explain", ".plan", ".txt" };
+        std::vector<std::string> names = list_directory(options.input_path);
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (!ends_with(names[i], ".sql")) continue;
+            std::string stem = names[i].substr(0, names[i].size() - 4);
+            TraceSpan span(options.trace, "input", "stage", stem);
+            BatchJob job;
+            job.index = count;
+            job.id = stem;
+            std::string dir = options.input_path + "/";
+            if (!read_file(dir + names[i], job.input.sql)) job.error = "无法读取 " + names[i];
+            bool found = false;
+            for (size_t e = 0; e < 3 && !found; ++e) {
+                found = read_file(dir + stem + kPlanExts[e], job.input.explain_result);
+            }
+            if (!found && job.error.empty()) job.error = "缺少执行计划文件 " + stem + ".explain";
+            read_file(dir + stem + ".after.explain", job.explain_after);
+            read_file(dir + stem + ".after.sql", job.applied_sql);
+            read_file(dir + stem + ".strategy", job.applied_strategy);
+            span.end();
+            if (!queue.push(std::move(job))) break;
+            ++count;
+        }
+        return count;
+    }
+    std::ifstream fin(options.input_path.c_str());
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        TraceSpan span(options.trace, "input");
+        BatchJob job = parse_jsonl_line(line, count);
+        span.end();
+        if (!queue.push(std::move(job))) break;
+        ++count;
+    }
+    return count;
+}
+
+// 报告文件名：id中路径分隔符等字符替换为下划线，id为空时用序号
+std::string report_file_stem(const BatchJob& job) {
+    if (job.id.empty()) return std::to_string(job.index);
+    std::string stem = job.id;
+    for (size_t i = 0; i < stem.size(); ++i) {
+        char c = stem[i];
+        if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' ||
+            c == '|' || static_cast<unsigned char>(c) < 0x20) {
+            stem[i] = '_';
+        }
+    }
+    if (stem == "." || stem == "..") stem = "_" + stem;
+    return stem;
+}
+
+// 分析单条任务，生成结果JSON
+void report_stage(const JobProgress* progress, const char* stage) {
+    if (progress && progress->stage) progress->stage(stage);
+}
+
+json process_job(const BatchJob& job, ModelRouter* router, AICallDedup* dedup, const BatchOptions& options,
+                 JobOutcome& outcome, const JobProgress* progress) {
+    Clock::time_point start = Clock::now();
+    bool& failed = outcome.failed;
+    json out;
+    out["index"] = job.index;
+    out["id"] = job.id;
+    if (job.error.empty() && !validate_input(job.input)) {
+        failed = true;
+        out["error"] = "SQL或执行计划为空";
+    } else if (!job.error.empty()) {
+        failed = true;
+        out["error"] = job.error;
+    } else {
+        Trace* trace = options.trace;
+        TraceSpan shape_span(trace, "sql_shape", "stage", job.id);
+        Utils::SqlShape shape = Utils::analyze_sql(job.input.sql);
+        shape_span.end();
+        outcome.fingerprint = shape.fingerprint;
+        out["sql_fingerprint"] = Utils::fingerprint_hex(shape.fingerprint);
+        out["tables"] = shape.tables;
+        report_stage(progress, "plan_parse");
+        TraceSpan parse_span(trace, "plan_parse", "stage", job.id);
+        PlanTree plan = parse_plan(job.input.explain_result);
+        parse_span.end();
+        report_stage(progress, "diagnose");
+        TraceSpan diagnose_span(trace, "diagnose", "stage", job.id);
+        DiagnosticReport diag = diagnose_plan(std::move(plan), job.input);
+        diagnose_span.end();
+        report_stage(progress, "rules");
+        TraceSpan rules_span(trace, "rules", "stage", job.id);
+        EnrichedDiagnosticReport context = collect_context(diag, shape, options.catalog);
+        OptimizationStrategy strategy = generate_strategy(context);
+        rules_span.end();
+        out["summary"] = diag.summary;
+        out["performance_score"] = diag.performance_score;
+        out["bottleneck"] = diag.bottleneck_analysis;
+        out["issues"] = diag.issues;
+        out["suggestion"] = strategy.suggestion;
+        out["index_hints"] = strategy.index_hints;
+        out["param_hints"] = strategy.param_hints;
+        out["expected_improvement"] = strategy.expected_improvement;
+        out["optimized_sql"] = strategy.optimized_sql;
+        out["risk_assessment"] = strategy.risk_assessment;
+        out["catalog_facts"] = context.known_facts;
+        out["open_questions"] = context.questions;
+        out["source"] = strategy.from_rules ? "rules" : "local";
+        // 知识库：同一查询形态已有实测有效的方案时直接采用，否则取相似案例作为few-shot上下文
+        CaseFeatures features;
+        std::vector<SimilarCase> similar;
+        if (options.knowledge) {
+            TraceSpan kb_span(trace, "knowledge", "stage", job.id);
+            features = make_case_features(diag.plan, shape);
+            similar = options.knowledge->find_similar(features, kFewShotCases);
+            json cases = json::array();
+            for (size_t i = 0; i < similar.size(); ++i) {
+                context.similar_cases.push_back(format_case_brief(similar[i], kCaseBriefChars));
+                cases.push_back({ {"sql_fingerprint", Utils::fingerprint_hex(similar[i].record.features.sql_fingerprint)},
+                                  {"similarity", similar[i].similarity}, {"speedup", similar[i].record.speedup},
+                                  {"same_query", similar[i].same_query} });
+            }
+            out["similar_cases"] = cases;
+        }
+        double measured_speedup = 0;
+        if (!job.explain_after.empty()) {
+            TraceSpan diff_span(trace, "plan_diff", "stage", job.id);
+            PlanTree after = parse_plan(job.explain_after);
+            PlanDiff diff = diff_plans(diag.plan, after);
+            measured_speedup = diff.speedup;
+            bool met = false;
+            std::string verdict = check_improvement(diff, strategy.expected_improvement, &met);
+            json d;
+            d["before_ms"] = diff.before_ms;
+            d["after_ms"] = diff.after_ms;
+            d["speedup"] = diff.speedup;
+            d["improvement_pct"] = diff.improvement_pct;
+            d["expectation_met"] = met;
+            d["verdict"] = verdict;
+            d["nodes"] = { {"same", diff.same}, {"changed", diff.changed}, {"added", diff.added},
+                           {"removed", diff.removed} };
+            d["text"] = format_plan_diff(diff, diag.plan, after, kDiffReportNodes);
+            out["plan_diff"] = d;
+        }
+        std::string reply;
+        bool force_ai = options.force_ai || job.force_ai;
+        bool wants_ai = (!strategy.from_rules || force_ai) && job.use_ai;
+        if (wants_ai && !force_ai && !similar.empty() && can_answer_locally(similar[0])) {
+            outcome.from_knowledge = true;
+            reply = format_case_answer(similar[0]);
+            out["source"] = "knowledge";
+            out["ai_result"] = reply;
+            if (progress && progress->tokens) progress->tokens(reply);
+        } else if (wants_ai && router) {
+            report_stage(progress, "ai");
+            outcome.used_ai = true;
+            AICallStats stats;
+            RouteInfo route;
+            uint64_t key = make_cache_key(job.input.sql, context_fingerprint(context, plan_fingerprint(diag.plan)),
+                                          router->cache_scope(), kPromptTemplateVersion);
+            TraceSpan prompt_span(trace, "prompt", "stage", job.id);
+            std::vector<ChatMessage> messages;
+            messages.push_back(ChatMessage("system", kAISystemPrompt));
+            messages.push_back(ChatMessage("user", build_ai_prompt(job.input, diag, router->context_tokens() / 2, &context)));
+            prompt_span.end();
+            DedupSlot owner;
+            std::shared_future<std::string> pending;
+            if (dedup) {
+                std::lock_guard<std::mutex> lock(dedup->mutex);
+                std::unordered_map<uint64_t, std::shared_future<std::string> >::iterator it = dedup->calls.find(key);
+                if (it != dedup->calls.end()) {
+                    pending = it->second;
+                } else {
+                    owner.dedup = dedup;
+                    owner.key = key;
+                    owner.promise = std::make_shared<std::promise<std::string> >();
+                    dedup->calls[key] = owner.promise->get_future().share();
+                }
+            }
+            if (pending.valid()) {
+                TraceSpan wait_span(trace, "dedup_wait", "stage", job.id);
+                reply = pending.get();
+                // 首个请求失败时自行重试
+                outcome.deduplicated = !ai_reply_failed(reply);
+                if (outcome.deduplicated && progress && progress->tokens) progress->tokens(reply);
+            }
+            if (!outcome.deduplicated) {
+                double ai_start = trace ? trace->now_us() : 0;
+                if (progress && progress->tokens) reply = router->call_stream(messages, progress->tokens, &stats, key, &route);
+                else reply = router->call(messages, &stats, key, &route);
+                trace_ai_call(trace, ai_start, stats, job.id);
+                owner.settle(reply);
+            }
+            outcome.cache_hit = stats.cache_hit;
+            out["source"] = outcome.deduplicated ? "dedup" : (outcome.cache_hit ? "cache" : "ai");
+            if (!outcome.cache_hit && !outcome.deduplicated) {
+                out["model"] = route.model;
+                out["attempts"] = route.attempts;
+            }
+            out["ai_result"] = reply;
+            if (ai_reply_failed(reply)) {
+                failed = true;
+                out["error"] = reply;
+            }
+        }
+        // 实测有效的方案写入知识库：explain_after 是在本次回复之前就已执行的改写，
+        // 只有任务同时给出实际采用的方案/SQL时才能把加速比归功于它，不能记在本次生成的建议名下
+        bool applied_given = !job.applied_strategy.empty() || !job.applied_sql.empty();
+        if (options.knowledge && !failed && applied_given && measured_speedup >= kMinCaseSpeedup) {
+            std::string applied = job.applied_strategy.empty() ? "按以下优化后SQL改写：" : job.applied_strategy;
+            out["knowledge_recorded"] = options.knowledge->add(
+                make_knowledge_case(features, shape, diag, applied, job.applied_sql, measured_speedup));
+        }
+        if (!options.report_dir.empty()) {
+            report_stage(progress, "report");
+            TraceSpan report_span(trace, "report", "stage", job.id);
+            ReportContent content;
+            content.strategy = &strategy;
+            content.diag = &diag;
+            content.input = &job.input;
+            content.ai_result = &reply;
+            content.title = "SQL优化报告：" + job.id;
+            std::string path = options.report_dir + "/" + report_file_stem(job) + "." +
+                               report_extension(options.report_format);
+            if (write_report_file(path, content, options.report_format)) out["report"] = path;
+            else out["report_error"] = "无法写入报告：" + path;
+        }
+    }
+    out["ok"] = !failed;
+    out["elapsed_ms"] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return out;
+}
+
+} // namespace
+
+struct AnalysisEngine::Impl {
+    BatchOptions options;
+    ModelRouter* router;
+    ResponseCache* cache;
+    std::unique_ptr<AIRecorder> recorder;
+    AICallDedup dedup;
+
+    explicit Impl(const BatchOptions& o) : options(o), router(nullptr), cache(nullptr) {}
+
+    ~Impl() {
+        // 路由器持有缓存与录制的指针，先于二者释放
+        delete router;
+        delete cache;
+    }
+};
+
+AnalysisEngine::AnalysisEngine(const BatchOptions& options) : impl_(new Impl(options)) {}
+
+AnalysisEngine::~AnalysisEngine() {
+    delete impl_;
+}
+
+bool AnalysisEngine::init(std::string* error) {
+    const BatchOptions& options = impl_->options;
+    // 录制/回放在所有模型与工作线程间共享
+    if (!options.record_path.empty() || !options.replay_path.empty()) {
+        bool replay = !options.replay_path.empty();
+        const std::string& path = replay ? options.replay_path : options.record_path;
+        impl_->recorder.reset(new AIRecorder(path, replay ? RecordMode::Replay : RecordMode::Record,
+                                             options.replay_timing));
+        if (!impl_->recorder->ok()) {
+            if (error) *error = std::string("无法") + (replay ? "读取" : "写入") + "录制文件：" + path;
+            return false;
+        }
+    }
+
+    // 所有工作线程共享一个路由器：客户端池复用连接，各模型的延迟/错误统计全局累积
+    if (options.use_ai) {
+        std::vector<AIModelConfig> models;
+        if (!options.models.empty() || (load_ai_config(options.config_path, models) && !models.empty())) {
+            if (!options.models.empty()) models = options.models;
+            RouterOptions routing;
+            load_router_options(options.config_path, routing);
+            if (!options.hedge) routing.hedge = false;
+            impl_->router = new ModelRouter(models, routing);
+            impl_->router->set_recorder(impl_->recorder.get());
+        }
+    }
+    if (impl_->router && options.use_cache) {
+        impl_->cache = new ResponseCache(options.cache);
+        impl_->router->set_cache(impl_->cache);
+    }
+    if (!options.report_dir.empty()) make_dir(options.report_dir);
+    return true;
+}
+
+bool AnalysisEngine::has_ai() const {
+    return impl_->router != nullptr;
+}
+
+std::string AnalysisEngine::analyze(const BatchJob& job, JobOutcome& outcome, const JobProgress* progress) {
+    const BatchOptions& options = impl_->options;
+    json result;
+    try {
+        result = process_job(job, impl_->router, options.dedup ? &impl_->dedup : nullptr, options, outcome, progress);
+    } catch (const std::exception& e) {
+        // 单条任务出错只记为失败记录，不影响其余任务
+        outcome.failed = true;
+        result = json::object();
+        result["index"] = job.index;
+        result["id"] = job.id;
+        result["ok"] = false;
+        result["error"] = Utils::sanitize_utf8(std::string("分析失败: ") + e.what());
+    }
+    TraceSpan render_span(options.trace, "render", "stage", job.id);
+    return dump_line(result);
+}
+
+std::string AnalysisEngine::stats_lines(const std::string& prefix) const {
+    std::ostringstream oss;
+    if (impl_->router) oss << prefix << "模型统计：" << impl_->router->health_line() << "\n";
+    if (impl_->recorder) oss << prefix << "录制/回放：" << impl_->recorder->stats_line() << "\n";
+    if (impl_->cache) oss << prefix << "AI回复缓存：" << impl_->cache->stats_line() << "\n";
+    if (impl_->options.knowledge) oss << prefix << "知识库：" << impl_->options.knowledge->stats_line() << "\n";
+    return oss.str();
+}
+
+BatchJob parse_batch_job(const std::string& line, size_t index) {
+    return parse_jsonl_line(line, index);
+}
+
+int run_batch(const BatchOptions& options, BatchSummary* summary) {
+    Clock::time_point start = Clock::now();
+    if (options.input_path.empty()) {
+        std::cerr << "[批量模式] 未指定输入文件或目录" << std::endl;
+        return 1;
+    }
+    if (!is_directory(options.input_path)) {
+        std::ifstream probe(options.input_path.c_str());
+        if (!probe.is_open()) {
+            std::cerr << "[批量模式] 无法打开输入：" << options.input_path << std::endl;
+            return 1;
+        }
+    }
+
+    AnalysisEngine engine(options);
+    std::string error;
+    if (!engine.init(&error)) {
+        std::cerr << "[批量模式] " << error << std::endl;
+        return 1;
+    }
+    if (options.use_ai && !engine.has_ai()) {
+        std::cerr << "[批量模式] AI模型配置加载失败，仅使用本地规则分析" << std::endl;
+    }
+
+    std::ofstream fout;
+    std::ostream* out = &std::cout;
+    if (!options.output_path.empty()) {
+        fout.open(options.output_path.c_str(), std::ios::out | std::ios::trunc);
+        if (!fout.is_open()) {
+            std::cerr << "[批量模式] 无法写入结果文件：" << options.output_path << std::endl;
+            return 1;
+        }
+        out = &fout;
+    }
+
+    size_t workers = std::max<size_t>(1, options.concurrency);
+    BoundedQueue<BatchJob> queue(workers * 2);
+    std::mutex out_mutex;
+    std::atomic<size_t> done(0), local_only(0), knowledge_hits(0), ai_calls(0), cache_hits(0), deduplicated(0), errors(0);
+    std::unordered_set<uint64_t> shapes;   // 受out_mutex保护
+
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+        pool.push_back(std::thread([&]() {
+            BatchJob job;
+            while (queue.pop(job)) {
+                TraceSpan job_span(options.trace, "job", "job", job.id);
+                JobOutcome outcome;
+                std::string line = engine.analyze(job, outcome);
+                if (outcome.cache_hit) ++cache_hits;
+                if (outcome.deduplicated) ++deduplicated;
+                if (outcome.used_ai) ++ai_calls;
+                else if (outcome.from_knowledge) ++knowledge_hits;
+                else if (!outcome.failed) ++local_only;
+                if (outcome.failed) ++errors;
+                std::lock_guard<std::mutex> lock(out_mutex);
+                if (outcome.fingerprint != 0) shapes.insert(outcome.fingerprint);
+                *out << line << "\n";
+                out->flush();
+                std::cerr << "\r[批量模式] 已完成 " << ++done << " 条" << std::flush;
+            }
+        }));
+    }
+    size_t total = produce_jobs(options, queue);
+    queue.close();
+    for (size_t w = 0; w < pool.size(); ++w) pool[w].join();
+
+    BatchSummary s;
+    s.total = total;
+    s.local_only = local_only;
+    s.knowledge_hits = knowledge_hits;
+    s.ai_calls = ai_calls;
+    s.cache_hits = cache_hits;
+    s.deduplicated = deduplicated;
+    s.errors = errors;
+    s.shapes = shapes.size();
+    s.wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cerr << "\n[批量模式] 共" << s.total << "条（" << s.shapes << "种查询形态）：本地规则" << s.local_only << "条";
+    if (options.knowledge) std::cerr << "，沿用历史案例" << s.knowledge_hits << "条";
+    std::cerr << "，调用AI " << s.ai_calls << "条（命中缓存" << s.cache_hits << "条，复用同形态回复" << s.deduplicated
+              << "条），失败" << s.errors << "条，耗时" << static_cast<long>(s.wall_ms) << " ms";
+    if (s.wall_ms > 0) std::cerr << "，吞吐 " << (s.total * 1000.0 / s.wall_ms) << " 条/秒";
+    std::cerr << std::endl;
+    std::cerr << engine.stats_lines("[批量模式] ") << std::flush;
+    if (summary) *summary = s;
+    return s.errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,546 @@
+#include <knowledge_base.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t kCaseMagic = 0x424b4941;   // "AIKB"
+const size_t kBandRows = kMinHashSize / kLshBands;
+const size_t kMaxFieldBytes = 64 * 1024;  // 单个文本字段上限，超出截断
+const size_t kCaseFields = 5;
+// 同一SQL形态且计划相似度达到该值时，历史方案可直接作为本地答案
+const double kLocalAnswerSimilarity = 0.8;
+
+// 案例记录头（168字节），后接5个文本字段（u32长度 + 内容），整条补齐到8字节
+struct CaseHeader {
+    uint32_t magic;
+    uint32_t length;            // 头之后变长部分的字节数（不含补齐）
+    uint64_t sql_fingerprint;
+    uint64_t plan_signature;
+    double speedup;
+    int64_t created;
+    uint32_t minhash[kMinHashSize];
+};
+
+size_t padded(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+// 记录头是否可信：魔数正确且变长部分不超过各字段上限之和
+bool plausible(const CaseHeader& h) {
+    return h.magic == kCaseMagic && h.length <= kCaseFields * (sizeof(uint32_t) + kMaxFieldBytes);
+}
+
+// 跨进程的文件锁（守护进程、批量与交互模式共用同一个知识库文件）：
+// 追加与截断持排他锁；Windows下退化为进程内互斥
+class FileLock {
+public:
+    FileLock(const std::string& path, bool create) : fd_(-1) {
+#ifndef _WIN32
+        fd_ = open(path.c_str(), O_RDWR | O_APPEND | (create ? O_CREAT : 0), 0644);
+        if (fd_ >= 0 && flock(fd_, LOCK_EX) != 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+#else
+        (void)path;
+        (void)create;
+#endif
+    }
+
+    ~FileLock() {
+#ifndef _WIN32
+        if (fd_ >= 0) close(fd_);   // 关闭即释放flock
+#endif
+    }
+
+    // 以O_APPEND一次写入整条记录，其他进程不会看到头与内容分开
+    bool append(const std::string& data) {
+#ifndef _WIN32
+        if (fd_ < 0) return false;
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd_, data.data() + done, data.size() - done);
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+#else
+        (void)data;
+        return false;
+#endif
+    }
+
+    bool locked() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+
+private:
+    FileLock(const FileLock&);
+    FileLock& operator=(const FileLock&);
+
+    int fd_;
+};
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t feature(const char* tag, const void* data, size_t size) {
+    return Utils::fnv1a64(data, size, Utils::fnv1a64(tag, strlen(tag)));
+}
+
+// 算子类型与数据流转类型合成一个符号
+int op_symbol(const PlanNode& n) {
+    return static_cast<int>(n.kind) * 16 + static_cast<int>(n.stream);
+}
+
+uint64_t band_key(size_t band, const uint32_t* values) {
+    uint64_t h = Utils::fnv1a64(&band, sizeof(band));
+    return Utils::fnv1a64(values, kBandRows * sizeof(uint32_t), h);
+}
+
+std::string join_lines(const std::vector<std::string>& items) {
+    std::string out;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) out += '\n';
+        out += items[i];
+    }
+    return out;
+}
+
+std::vector<std::string> split_lines(const std::string& text) {
+    std::vector<std::string> out;
+    if (text.empty()) return out;
+    size_t pos = 0;
+    while (true) {
+        size_t nl = text.find('\n', pos);
+        out.push_back(text.substr(pos, nl == std::string::npos ? std::string::npos : nl - pos));
+        if (nl == std::string::npos) break;
+        pos = nl + 1;
+    }
+    return out;
+}
+
+// 截断到不超过max字节，不切断UTF-8多字节字符
+std::string utf8_prefix(const std::string& s, size_t max) {
+    if (s.size() <= max) return s;
+    size_t end = max;
+    while (end > 0 && (static_cast<unsigned char>(s[end]) & 0xC0) == 0x80) --end;
+    return s.substr(0, end);
+}
+
+void put_field(std::string& out, const std::string& value) {
+    std::string v = utf8_prefix(value, kMaxFieldBytes);
+    uint32_t n = static_cast<uint32_t>(v.size());
+    out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    out += v;
+}
+
+bool get_field(const char*& p, const char* end, std::string& value) {
+    uint32_t n;
+    if (static_cast<size_t>(end - p) < sizeof(n)) return false;
+    memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    if (static_cast<size_t>(end - p) < n) return false;
+    value.assign(p, n);
+    p += n;
+    return true;
+}
+
+void make_dir(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+std::string format_speedup(double speedup) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << speedup << "x";
+    return oss.str();
+}
+
+} // namespace
+
+CaseFeatures::CaseFeatures() : sql_fingerprint(0), plan_signature(0) {
+    for (size_t i = 0; i < kMinHashSize; ++i) minhash[i] = 0xFFFFFFFFu;
+}
+
+CaseFeatures make_case_features(const PlanTree& plan, const Utils::SqlShape& shape) {
+    CaseFeatures f;
+    f.sql_fingerprint = shape.fingerprint;
+    f.plan_signature = plan_fingerprint(plan);
+    std::vector<uint64_t> features;
+    const std::vector<PlanNode>& nodes = plan.nodes;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const PlanNode& n = nodes[i];
+        int gram[3] = { op_symbol(n), -1, -1 };
+        features.push_back(feature("op1", gram, sizeof(int)));
+        if (n.parent >= 0) {
+            gram[1] = op_symbol(nodes[n.parent]);
+            features.push_back(feature("op2", gram, 2 * sizeof(int)));
+            if (nodes[n.parent].parent >= 0) {
+                gram[2] = op_symbol(nodes[nodes[n.parent].parent]);
+                features.push_back(feature("op3", gram, 3 * sizeof(int)));
+            }
+        }
+        if (n.relation.size > 0) {
+            std::string rel = Utils::to_lower(std::string(n.relation.data, n.relation.size));
+            features.push_back(Utils::fnv1a64(rel.data(), rel.size(), feature("scan", gram, sizeof(int))));
+        }
+    }
+    for (size_t i = 0; i < shape.tables.size(); ++i) {
+        features.push_back(feature("table", shape.tables[i].data(), shape.tables[i].size()));
+    }
+    // 第k个哈希函数取 splitmix64(特征 ^ 种子k) 的高32位
+    for (size_t k = 0; k < kMinHashSize; ++k) {
+        uint64_t seed = splitmix64(k + 1);
+        uint32_t best = 0xFFFFFFFFu;
+        for (size_t i = 0; i < features.size(); ++i) {
+            best = std::min(best, static_cast<uint32_t>(splitmix64(features[i] ^ seed) >> 32));
+        }
+        f.minhash[k] = best;
+    }
+    return f;
+}
+
+double estimate_similarity(const CaseFeatures& a, const CaseFeatures& b) {
+    size_t same = 0;
+    for (size_t i = 0; i < kMinHashSize; ++i) {
+        if (a.minhash[i] == b.minhash[i]) ++same;
+    }
+    return static_cast<double>(same) / kMinHashSize;
+}
+
+KnowledgeCase make_knowledge_case(const CaseFeatures& features, const Utils::SqlShape& shape,
+                                  const DiagnosticReport& diag, const std::string& strategy,
+                                  const std::string& optimized_sql, double speedup) {
+    KnowledgeCase c;
+    c.features = features;
+    c.speedup = speedup;
+    c.created = static_cast<int64_t>(std::time(nullptr));
+    c.tables = shape.tables;
+    c.issues = diag.issues;
+    c.strategy = strategy;
+    c.optimized_sql = optimized_sql;
+    c.sql = shape.normalized;
+    return c;
+}
+
+struct KnowledgeBase::Impl {
+    std::string path;
+    bool ok;
+    mutable std::mutex mutex;
+    const char* base;                   // 数据文件的映射
+    size_t mapped;
+    std::string fallback;               // 无mmap的平台整体读入
+    size_t scanned;                     // 已建立索引的数据末尾，之后追加的记录从这里继续
+    size_t skipped;                     // 跳过的损坏数据段数
+    std::vector<uint64_t> offsets;      // 各记录头的偏移
+    std::unordered_map<uint64_t, std::vector<uint32_t> > bands;       // LSH分段 -> 记录下标
+    std::unordered_map<uint64_t, std::vector<uint32_t> > by_query;    // SQL指纹 -> 记录下标
+
+    explicit Impl(const std::string& p) : path(p), ok(true), base(nullptr), mapped(0), scanned(0), skipped(0) {
+        // 持排他锁打开：此时没有进程在追加，残缺的尾部只可能来自中途崩溃的写入，截掉后继续追加
+        FileLock lock(path, false);
+        remap();
+        if (!ok) return;
+        scan();
+#ifndef _WIN32
+        if (lock.locked() && scanned < mapped && ftruncate(lock.fd(), static_cast<off_t>(scanned)) == 0) remap();
+#endif
+    }
+
+    ~Impl() {
+        unmap();
+    }
+
+    void unmap() {
+#ifndef _WIN32
+        if (base) munmap(const_cast<char*>(base), mapped);
+#endif
+        base = nullptr;
+        mapped = 0;
+    }
+
+    // 重新映射整个文件（追加后基址可能变化，记录以偏移引用），返回文件大小
+    size_t remap() {
+        unmap();
+#ifdef _WIN32
+        std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+        if (!fin.is_open()) return 0;
+        std::ostringstream oss;
+        oss << fin.rdbuf();
+        fallback = oss.str();
+        base = fallback.data();
+        mapped = fallback.size();
+        return mapped;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            ok = false;
+            return 0;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                ok = false;
+            } else {
+                base = static_cast<const char*>(p);
+                mapped = size;
+            }
+        }
+        close(fd);
+        return mapped;
+#endif
+    }
+
+    CaseHeader header(size_t index) const {
+        CaseHeader h;
+        memcpy(&h, base + offsets[index], sizeof(h));
+        return h;
+    }
+
+    void index(const CaseHeader& h, uint64_t offset) {
+        uint32_t idx = static_cast<uint32_t>(offsets.size());
+        offsets.push_back(offset);
+        for (size_t b = 0; b < kLshBands; ++b) bands[band_key(b, h.minhash + b * kBandRows)].push_back(idx);
+        by_query[h.sql_fingerprint].push_back(idx);
+    }
+
+    // 从上次的末尾起顺序建立索引。中间的损坏数据按8字节对齐向后找下一个可信记录头跳过；
+    // 末尾不完整的记录（可能是其他进程正在写入）留待下次再读
+    void scan() {
+        size_t offset = scanned;
+        while (offset + sizeof(CaseHeader) <= mapped) {
+            CaseHeader h;
+            memcpy(&h, base + offset, sizeof(h));
+            if (!plausible(h)) {
+                size_t next = offset + 8;
+                while (next + sizeof(CaseHeader) <= mapped) {
+                    memcpy(&h, base + next, sizeof(h));
+                    if (plausible(h)) break;
+                    next += 8;
+                }
+                if (next + sizeof(CaseHeader) > mapped) break;
+                ++skipped;
+                offset = next;
+                continue;
+            }
+            if (offset + sizeof(h) + h.length > mapped) break;
+            index(h, offset);
+            offset += sizeof(h) + padded(h.length);
+        }
+        scanned = std::min(offset, mapped);
+    }
+
+    KnowledgeCase decode(size_t index) const {
+        KnowledgeCase c;
+        CaseHeader h = header(index);
+        c.features.sql_fingerprint = h.sql_fingerprint;
+        c.features.plan_signature = h.plan_signature;
+        memcpy(c.features.minhash, h.minhash, sizeof(h.minhash));
+        c.speedup = h.speedup;
+        c.created = h.created;
+        const char* p = base + offsets[index] + sizeof(h);
+        const char* end = p + h.length;
+        std::string tables, issues;
+        if (get_field(p, end, tables) && get_field(p, end, issues) && get_field(p, end, c.strategy) &&
+            get_field(p, end, c.optimized_sql)) {
+            get_field(p, end, c.sql);
+        }
+        c.tables = split_lines(tables);
+        c.issues = split_lines(issues);
+        return c;
+    }
+};
+
+KnowledgeBase::KnowledgeBase(const std::string& path) : impl_(new Impl(path)) {}
+
+KnowledgeBase::~KnowledgeBase() {
+    delete impl_;
+}
+
+bool KnowledgeBase::ok() const {
+    return impl_->ok;
+}
+
+const std::string& KnowledgeBase::path() const {
+    return impl_->path;
+}
+
+bool KnowledgeBase::add(const KnowledgeCase& record) {
+    std::string body;
+    put_field(body, join_lines(record.tables));
+    put_field(body, join_lines(record.issues));
+    put_field(body, record.strategy);
+    put_field(body, record.optimized_sql);
+    put_field(body, record.sql);
+    CaseHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = kCaseMagic;
+    h.length = static_cast<uint32_t>(body.size());
+    h.sql_fingerprint = record.features.sql_fingerprint;
+    h.plan_signature = record.features.plan_signature;
+    h.speedup = record.speedup;
+    h.created = record.created;
+    memcpy(h.minhash, record.features.minhash, sizeof(h.minhash));
+    body.resize(padded(body.size()), '\0');
+    std::string data(reinterpret_cast<const char*>(&h), sizeof(h));
+    data += body;
+
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    if (!impl_->ok) return false;
+    size_t slash = impl_->path.find_last_of("/\\");
+    if (slash != std::string::npos && slash > 0) make_dir(impl_->path.substr(0, slash));
+#ifdef _WIN32
+    {
+        std::ofstream out(impl_->path.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+        if (!out.is_open()) return false;
+        out.write(data.data(), data.size());
+        if (!out) return false;
+    }
+#else
+    {
+        FileLock file(impl_->path, true);
+        if (!file.append(data)) return false;
+    }
+#endif
+    // 重新映射后把自己与其他进程新追加的记录一并建立索引
+    impl_->remap();
+    impl_->scan();
+    return impl_->ok;
+}
+
+std::vector<SimilarCase> KnowledgeBase::find_similar(const CaseFeatures& features, size_t k,
+                                                     double min_similarity) const {
+    std::vector<SimilarCase> result;
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    if (k == 0 || impl_->offsets.empty()) return result;
+
+    // 候选：任一LSH分段相同，或SQL形态相同
+    std::vector<uint32_t> candidates;
+    for (size_t b = 0; b < kLshBands; ++b) {
+        std::unordered_map<uint64_t, std::vector<uint32_t> >::const_iterator it =
+            impl_->bands.find(band_key(b, features.minhash + b * kBandRows));
+        if (it != impl_->bands.end()) candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+    std::unordered_map<uint64_t, std::vector<uint32_t> >::const_iterator q = impl_->by_query.find(features.sql_fingerprint);
+    if (q != impl_->by_query.end()) candidates.insert(candidates.end(), q->second.begin(), q->second.end());
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // 打分；同一查询+计划形状只保留加速比最高的记录
+    struct Scored {
+        uint32_t index;
+        double similarity;
+        bool same_query;
+        double speedup;
+    };
+    std::unordered_map<uint64_t, Scored> best;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        CaseHeader h = impl_->header(candidates[i]);
+        CaseFeatures f;
+        memcpy(f.minhash, h.minhash, sizeof(h.minhash));
+        Scored s = { candidates[i], estimate_similarity(features, f), h.sql_fingerprint == features.sql_fingerprint,
+                     h.speedup };
+        if (h.sql_fingerprint == features.sql_fingerprint && h.plan_signature == features.plan_signature) {
+            s.similarity = 1.0;
+        }
+        if (s.similarity < min_similarity && !s.same_query) continue;
+        uint64_t group = Utils::fnv1a64(&h.plan_signature, sizeof(h.plan_signature), h.sql_fingerprint);
+        std::unordered_map<uint64_t, Scored>::iterator it = best.find(group);
+        if (it == best.end() || s.speedup > it->second.speedup) best[group] = s;
+    }
+    std::vector<Scored> ranked;
+    for (std::unordered_map<uint64_t, Scored>::iterator it = best.begin(); it != best.end(); ++it) {
+        ranked.push_back(it->second);
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Scored& a, const Scored& b) {
+        if (a.similarity != b.similarity) return a.similarity > b.similarity;
+        if (a.same_query != b.same_query) return a.same_query;
+        return a.speedup > b.speedup;
+    });
+    if (ranked.size() > k) ranked.resize(k);
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        SimilarCase c;
+        c.record = impl_->decode(ranked[i].index);
+        c.similarity = ranked[i].similarity;
+        c.same_query = ranked[i].same_query;
+        result.push_back(c);
+    }
+    return result;
+}
+
+size_t KnowledgeBase::size() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return impl_->offsets.size();
+}
+
+std::string KnowledgeBase::stats_line() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    std::ostringstream oss;
+    oss << impl_->offsets.size() << " 条案例，" << impl_->by_query.size() << " 种查询形态，"
+        << impl_->bands.size() << " 个LSH分桶";
+    if (impl_->skipped > 0) oss << "，跳过损坏数据 " << impl_->skipped << " 处";
+    oss << "（" << impl_->path << "）";
+    return oss.str();
+}
+
+bool can_answer_locally(const SimilarCase& c) {
+    return c.same_query && c.similarity >= kLocalAnswerSimilarity && c.record.speedup >= kMinCaseSpeedup &&
+           !c.record.strategy.empty();
+}
+
+std::string format_case_brief(const SimilarCase& c, size_t max_chars) {
+    std::ostringstream oss;
+    oss << (c.same_query ? "同一查询形态" : "相似查询") << "（计划相似度" << static_cast<int>(c.similarity * 100)
+        << "%，实测加速" << format_speedup(c.record.speedup) << "）";
+    if (!c.record.tables.empty()) {
+        oss << " 表：";
+        for (size_t i = 0; i < c.record.tables.size(); ++i) oss << (i > 0 ? "," : "") << c.record.tables[i];
+    }
+    if (!c.record.issues.empty()) {
+        oss << "；问题：";
+        for (size_t i = 0; i < c.record.issues.size() && i < 3; ++i) oss << (i > 0 ? "；" : "") << c.record.issues[i];
+    }
+    std::string strategy = c.record.strategy;
+    for (size_t i = 0; i < strategy.size(); ++i) {
+        if (strategy[i] == '\n' || strategy[i] == '\r') strategy[i] = ' ';
+    }
+    std::string brief = utf8_prefix(strategy, max_chars);
+    oss << "；方案：" << brief << (brief.size() < strategy.size() ? "……" : "");
+    return oss.str();
+}
+
+std::string format_case_answer(const SimilarCase& c) {
+    std::ostringstream oss;
+    oss << "【历史案例】该查询与知识库中已验证的优化案例形态相同（计划相似度" << static_cast<int>(c.similarity * 100)
+        << "%，当时实测加速" << format_speedup(c.record.speedup) << "），沿用当时的方案：\n\n" << c.record.strategy;
+    if (!c.record.optimized_sql.empty()) oss << "\n\n" << c.record.optimized_sql;
+    oss << "\n\n如数据量或参数已有变化，可继续提问让AI重新分析。";
+    return oss.str();
+}
@@ -0,0 +1,359 @@
+#include "mock_server.h"
+#include "ai_recorder.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <json.hpp>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#define close_socket closesocket
+static const socket_t kInvalidSocket = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define close_socket close
+static const socket_t kInvalidSocket = -1;
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+bool send_all(socket_t fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+#ifdef _WIN32
+        int n = send(fd, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+#else
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#endif
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string chunk(const std::string& data) {
+    char size[32];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return size + data + "\r\n";
+}
+
+std::string status_line(int status) {
+    switch (status) {
+    case 200: return "HTTP/1.1 200 OK\r\n";
+    case 400: return "HTTP/1.1 400 Bad Request\r\n";
+    case 404: return "HTTP/1.1 404 Not Found\r\n";
+    case 429: return "HTTP/1.1 429 Too Many Requests\r\n";
+    case 503: return "HTTP/1.1 503 Service Unavailable\r\n";
+    default: return "HTTP/1.1 " + std::to_string(status) + " Error\r\n";
+    }
+}
+
+// 单个请求的应答方式：由注入的故障、回放的录制或固定回复决定
+struct Plan {
+    int status;                 // 0表示直接断开连接（复现录制中的网络错误）
+    long retry_after_s;
+    std::string reply;          // 成功时为回复内容，失败时为错误信息
+    double first_ms;            // 首字节（流式首字）延迟
+    double interval_ms;         // 流式相邻分片间隔
+    size_t chunks;
+
+    Plan() : status(200), retry_after_s(0), first_ms(0), interval_ms(0), chunks(1) {}
+};
+
+// 一个连接的处理线程，done在线程结束前置位，供accept线程回收
+struct Worker {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool> > done;
+};
+
+} // namespace
+
+struct MockServer::Impl {
+    MockServerOptions options;
+    socket_t listen_fd;
+    int port;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> requests;
+    std::atomic<size_t> injected_errors;
+    std::atomic<size_t> throttled;
+    std::unique_ptr<AIRecorder> recorder;
+    std::thread acceptor;
+    std::mutex mutex;
+    std::list<Worker> workers;
+    std::vector<socket_t> connections;
+
+    explicit Impl(const MockServerOptions& o) : options(o), listen_fd(kInvalidSocket), port(0), stopping(false),
+                                                requests(0), injected_errors(0), throttled(0) {
+        if (!options.replay_path.empty()) {
+            recorder.reset(new AIRecorder(options.replay_path, RecordMode::Replay, options.replay_timing));
+        }
+    }
+
+    // 可被stop打断的等待
+    bool wait_ms(int ms) {
+        std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        while (!stopping.load()) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now >= until) return true;
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - now,
+                                                                                    std::chrono::milliseconds(10)));
+        }
+        return false;
+    }
+
+    // 读取一个完整请求（请求头 + Content-Length指定的请求体），连接关闭返回false
+    bool read_request(socket_t fd, std::string& buffer, std::string& body) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            char tmp[4096];
+            int n = static_cast<int>(recv(fd, tmp, sizeof(tmp), 0));
+            if (n <= 0) return false;
+            buffer.append(tmp, n);
+        }
+        size_t length = 0;
+        std::string headers = buffer.substr(0, header_end);
+        for (size_t i = 0; i < headers.size(); ++i) headers[i] = static_cast<char>(tolower(headers[i]));
+        size_t cl = headers.find("content-length:");
+        if (cl != std::string::npos) length = static_cast<size_t>(atol(headers.c_str() + cl + 15));
+        size_t total = header_end + 4 + length;
+        while (buffer.size() < total) {
+            char tmp[4096];
+            int n = static_cast<int>(recv(fd, tmp, sizeof(tmp), 0));
+            if (n <= 0) return false;
+            buffer.append(tmp, n);
+        }
+        body = buffer.substr(header_end + 4, length);
+        buffer.erase(0, total);
+        return true;
+    }
+
+    // 按请求序号与seed决定是否注入故障，同一seed下第n个请求的结果固定
+    Plan plan(size_t n, const json& request) {
+        Plan p;
+        std::minstd_rand rng(static_cast<unsigned>(options.seed * 1000003u + n) | 1u);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        double roll = uniform(rng);
+        p.first_ms = options.latency_ms;
+        if (options.latency_jitter_ms > 0) p.first_ms += uniform(rng) * options.latency_jitter_ms;
+        p.interval_ms = options.chunk_interval_ms;
+        p.chunks = options.chunks;
+        p.reply = options.reply;
+        if (roll < options.rate_limit_rate) {
+            ++throttled;
+            p.status = 429;
+            p.retry_after_s = options.retry_after_s;
+            p.reply = "Rate limit reached, please retry later";
+            return p;
+        }
+        if (roll < options.rate_limit_rate + options.error_rate) {
+            ++injected_errors;
+            p.status = 500;
+            p.reply = "Injected internal error";
+            return p;
+        }
+        if (!recorder) return p;
+
+        // 回放：按模型与消息取录制的回复，并复现录制时的首字与总耗时
+        std::vector<ChatMessage> messages;
+        if (request.is_object() && request.contains("messages") && request["messages"].is_array()) {
+            for (const auto& m : request["messages"]) {
+                messages.push_back(ChatMessage(m.value("role", ""), m.value("content", "")));
+            }
+        }
+        std::string model = request.is_object() ? request.value("model", "") : "";
+        RecordedReply rec;
+        if (!recorder->replay(make_record_key(model, messages), rec)) {
+            p.status = 404;
+            p.reply = "No recorded reply for this request";
+            return p;
+        }
+        p.reply = rec.reply;
+        p.retry_after_s = rec.retry_after_s;
+        p.chunks = std::max<size_t>(1, rec.chunks);
+        p.first_ms = p.interval_ms = 0;
+        if (recorder->replay_timing()) {
+            p.first_ms = rec.first_token_ms >= 0 ? rec.first_token_ms : rec.total_ms;
+            if (p.chunks > 1) p.interval_ms = (rec.total_ms - p.first_ms) / (p.chunks - 1);
+        }
+        if (rec.http_status >= 400) p.status = static_cast<int>(rec.http_status);
+        else if (rec.http_status == 0) p.status = 0;
+        else if (ai_reply_failed(rec.reply)) p.status = 502;
+        return p;
+    }
+
+    bool respond(socket_t fd, const std::string& body) {
+        size_t n = ++requests;
+        json request = json::parse(body, nullptr, false);
+        if (!request.is_object()) {
+            std::string payload = "{\"error\":{\"message\":\"request body must be a JSON object\",\"code\":400}}";
+            return send_all(fd, status_line(400) + "Content-Type: application/json\r\nContent-Length: " +
+                                    std::to_string(payload.size()) + "\r\n\r\n" + payload);
+        }
+        bool stream = request.value("stream", false);
+        Plan p = plan(n, request);
+        if (!wait_ms(static_cast<int>(p.first_ms))) return false;
+        if (p.status == 0) return false;
+        if (p.status != 200) {
+            json error = { {"error", { {"message", p.reply}, {"code", p.status} }} };
+            std::string payload = error.dump();
+            std::string head = status_line(p.status) + "Content-Type: application/json\r\n";
+            if (p.retry_after_s > 0) head += "Retry-After: " + std::to_string(p.retry_after_s) + "\r\n";
+            return send_all(fd, head + "Content-Length: " + std::to_string(payload.size()) + "\r\n\r\n" + payload);
+        }
+        if (!stream) {
+            json reply = { {"choices", { { {"message", { {"role", "assistant"}, {"content", p.reply} }} } }} };
+            std::string payload = reply.dump();
+            return send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                                    std::to_string(payload.size()) + "\r\n\r\n" + payload);
+        }
+        if (!send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n")) {
+            return false;
+        }
+        std::vector<std::string> parts = split_reply_chunks(p.reply, p.chunks);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (i > 0 && !wait_ms(static_cast<int>(p.interval_ms))) return false;
+            json delta = { {"choices", { { {"delta", { {"content", parts[i]} }} } }} };
+            if (!send_all(fd, chunk("data: " + delta.dump() + "\n\n"))) return false;
+        }
+        return send_all(fd, chunk("data: [DONE]\n\n")) && send_all(fd, chunk(""));
+    }
+
+    void serve(socket_t fd, std::shared_ptr<std::atomic<bool> > done) {
+        std::string buffer, body;
+        while (!stopping.load() && read_request(fd, buffer, body)) {
+            if (!respond(fd, body)) break;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < connections.size(); ++i) {
+            if (connections[i] == fd) {
+                connections.erase(connections.begin() + i);
+                close_socket(fd);
+                break;
+            }
+        }
+        *done = true;
+    }
+
+    void accept_loop() {
+        while (!stopping.load()) {
+            socket_t fd = accept(listen_fd, nullptr, nullptr);
+            if (fd == kInvalidSocket) continue;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping.load()) {
+                close_socket(fd);
+                break;
+            }
+            // 回收已结束的连接线程，--serve常驻压测时线程对象不累积
+            for (std::list<Worker>::iterator it = workers.begin(); it != workers.end();) {
+                if (it->done->load()) {
+                    it->thread.join();
+                    it = workers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            connections.push_back(fd);
+            Worker w;
+            w.done = std::make_shared<std::atomic<bool> >(false);
+            w.thread = std::thread(&Impl::serve, this, fd, w.done);
+            workers.push_back(std::move(w));
+        }
+    }
+};
+
+MockServer::MockServer(const MockServerOptions& options) : impl_(new Impl(options)) {}
+
+MockServer::~MockServer() {
+    stop();
+    delete impl_;
+}
+
+bool MockServer::start() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == kInvalidSocket) return false;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<unsigned short>(impl_->options.port));
+    socklen_t len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        close_socket(fd);
+        return false;
+    }
+    impl_->listen_fd = fd;
+    impl_->port = ntohs(addr.sin_port);
+    impl_->acceptor = std::thread(&Impl::accept_loop, impl_);
+    return true;
+}
+
+void MockServer::stop() {
+    if (impl_->listen_fd == kInvalidSocket) return;
+    impl_->stopping = true;
+    {
+        // shutdown使阻塞在accept/recv中的线程返回
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+#ifdef _WIN32
+        shutdown(impl_->listen_fd, SD_BOTH);
+        for (size_t i = 0; i < impl_->connections.size(); ++i) shutdown(impl_->connections[i], SD_BOTH);
+#else
+        shutdown(impl_->listen_fd, SHUT_RDWR);
+        for (size_t i = 0; i < impl_->connections.size(); ++i) shutdown(impl_->connections[i], SHUT_RDWR);
+#endif
+    }
+    close_socket(impl_->listen_fd);
+    if (impl_->acceptor.joinable()) impl_->acceptor.join();
+    // accept线程已退出，workers不再增长
+    for (std::list<Worker>::iterator it = impl_->workers.begin(); it != impl_->workers.end(); ++it) it->thread.join();
+    impl_->workers.clear();
+    impl_->listen_fd = kInvalidSocket;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+int MockServer::port() const {
+    return impl_->port;
+}
+
+std::string MockServer::url() const {
+    return "http://127.0.0.1:" + std::to_string(impl_->port) + "/v1/chat/completions";
+}
+
+size_t MockServer::requests() const {
+    return impl_->requests.load();
+}
+
+size_t MockServer::injected_errors() const {
+    return impl_->injected_errors.load();
+}
+
+size_t MockServer::throttled() const {
+    return impl_->throttled.load();
+}
+
+bool MockServer::replay_ok() const {
+    return !impl_->recorder || impl_->recorder->ok();
+}
@@ -0,0 +1,626 @@
+#include "analysis_server.h"
+#include "batch_runner.h"
+#include "bounded_queue.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <json.hpp>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#define close_socket closesocket
+static const socket_t kInvalidSocket = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define close_socket close
+static const socket_t kInvalidSocket = -1;
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+const size_t kMaxLineBytes = 16 * 1024 * 1024;   // 单个任务（含执行计划）的最大字节数
+const int kAcceptBackoffMs = 100;                 // accept持续出错（如文件描述符耗尽）时的等待间隔
+const int kSendTimeoutMs = 10000;                 // 客户端停止读取时单次发送最多阻塞的时间，超时视为断开
+const int kStopDrainMs = 30000;                   // 停止时等待已入队任务完成的最长时间，超时后断开全部连接
+
+// 序列化为单行JSON：客户端发来的非法UTF-8字节替换为U+FFFD，不在工作线程中抛异常
+std::string dump_line(const json& j) {
+    return j.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+// accept失败是否可以立即重试（被信号中断、连接在accept前已被对端重置）
+bool accept_retryable() {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    return err == WSAEINTR || err == WSAECONNRESET;
+#else
+    return errno == EINTR || errno == ECONNABORTED;
+#endif
+}
+
+bool send_all(socket_t fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+#ifdef _WIN32
+        int n = send(fd, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+#else
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#endif
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// 发送超时：不读取结果的客户端不会让持有连接锁的工作线程无限阻塞
+void set_send_timeout(socket_t fd) {
+#ifdef _WIN32
+    DWORD ms = kSendTimeoutMs;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&ms), sizeof(ms));
+#else
+    timeval tv;
+    tv.tv_sec = kSendTimeoutMs / 1000;
+    tv.tv_usec = (kSendTimeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+void shutdown_socket(socket_t fd, bool read_only) {
+#ifdef _WIN32
+    shutdown(fd, read_only ? SD_RECEIVE : SD_BOTH);
+#else
+    shutdown(fd, read_only ? SHUT_RD : SHUT_RDWR);
+#endif
+}
+
+std::string chunk(const std::string& data) {
+    char size[32];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return size + data + "\r\n";
+}
+
+// 按行读取的连接缓冲
+struct LineReader {
+    socket_t fd;
+    std::string buffer;
+
+    explicit LineReader(socket_t f) : fd(f) {}
+
+    bool fill() {
+        char tmp[8192];
+        int n = static_cast<int>(recv(fd, tmp, sizeof(tmp), 0));
+        if (n <= 0) return false;
+        buffer.append(tmp, n);
+        return true;
+    }
+
+    // 读取一行（不含换行），连接关闭或行过长返回false；关闭前最后一行没有换行也返回
+    bool line(std::string& out) {
+        size_t pos;
+        while ((pos = buffer.find('\n')) == std::string::npos) {
+            if (buffer.size() > kMaxLineBytes || !fill()) {
+                if (buffer.empty() || buffer.size() > kMaxLineBytes) return false;
+                out.swap(buffer);
+                buffer.clear();
+                return true;
+            }
+        }
+        out = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        if (!out.empty() && out[out.size() - 1] == '\r') out.erase(out.size() - 1);
+        return true;
+    }
+
+    bool bytes(size_t n, std::string& out) {
+        while (buffer.size() < n) {
+            if (n > kMaxLineBytes || !fill()) return false;
+        }
+        out = buffer.substr(0, n);
+        buffer.erase(0, n);
+        return true;
+    }
+};
+
+// 一个客户端连接：工作线程与连接线程共用，发送加锁；pending为该连接尚未完成的任务数
+struct Channel {
+    socket_t fd;
+    bool http;
+    std::mutex mutex;
+    std::condition_variable idle;
+    bool broken;           // 发送失败（客户端断开或超时未读取），不再发送
+    bool closed;           // 套接字已关闭
+    size_t pending;
+
+    explicit Channel(socket_t f) : fd(f), http(false), broken(false), closed(false), pending(0) {}
+
+    // 调用方已持有mutex
+    bool write_locked(const std::string& line) {
+        if (broken) return false;
+        if (!send_all(fd, http ? chunk(line + "\n") : line + "\n")) broken = true;
+        return !broken;
+    }
+
+    bool send_line(const std::string& line) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return write_locked(line);
+    }
+
+    bool alive() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !broken;
+    }
+
+    void begin() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        --pending;
+        idle.notify_all();
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return pending == 0; });
+    }
+};
+
+struct Task {
+    BatchJob job;
+    bool stream;           // 是否逐段推送AI回复
+    std::shared_ptr<Channel> channel;
+};
+
+std::string event(const char* name, const std::string& id) {
+    json e;
+    e["event"] = name;
+    e["id"] = id;
+    return dump_line(e);
+}
+
+struct Connection {
+    std::thread thread;
+    std::shared_ptr<Channel> channel;
+    std::shared_ptr<std::atomic<bool> > done;
+};
+
+} // namespace
+
+struct AnalysisServer::Impl {
+    AnalysisEngine& engine;
+    ServerOptions options;
+    BoundedQueue<std::shared_ptr<Task> > queue;
+    std::vector<socket_t> listeners;
+    std::vector<std::thread> acceptors;
+    std::vector<std::thread> workers;
+    std::mutex mutex;                  // 保护connections
+    std::list<Connection> connections;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> next_index, accepted, completed, failed, rejected, dropped, running;
+    std::atomic<size_t> live_workers;  // 尚未退出的工作线程数
+    int port;
+    bool unix_bound;
+
+    Impl(AnalysisEngine& e, const ServerOptions& o)
+        : engine(e), options(o), queue(o.queue_capacity), stopping(false), next_index(0), accepted(0), completed(0),
+          failed(0), rejected(0), dropped(0), running(0), live_workers(0), port(-1), unix_bound(false) {}
+
+    ServerStats stats() {
+        ServerStats s;
+        s.accepted = accepted;
+        s.completed = completed;
+        s.failed = failed;
+        s.rejected = rejected;
+        s.dropped = dropped;
+        s.queued = queue.size();
+        s.running = running;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::list<Connection>::iterator it = connections.begin(); it != connections.end(); ++it) {
+            if (!it->done->load()) ++s.connections;
+        }
+        return s;
+    }
+
+    std::string stats_json() {
+        ServerStats s = stats();
+        json j;
+        j["accepted"] = s.accepted;
+        j["completed"] = s.completed;
+        j["failed"] = s.failed;
+        j["rejected"] = s.rejected;
+        j["dropped"] = s.dropped;
+        j["queued"] = s.queued;
+        j["running"] = s.running;
+        j["connections"] = s.connections;
+        j["workers"] = options.workers;
+        j["queue_capacity"] = queue.capacity();
+        return dump_line(j);
+    }
+
+    void work() {
+        std::shared_ptr<Task> task;
+        while (queue.pop(task)) {
+            Channel& ch = *task->channel;
+            const std::string& id = task->job.id;
+            // 客户端已断开：不再消耗AI调用
+            if (!ch.alive()) {
+                ++dropped;
+                ch.finish();
+                continue;
+            }
+            ++running;
+            JobOutcome outcome;
+            std::string result;
+            try {
+                result = run_task(*task, outcome);
+            } catch (const std::exception& e) {
+                // 单个任务出错只回一条失败结果，不让异常终止服务进程
+                outcome.failed = true;
+                result = failure(id, std::string("分析失败: ") + e.what());
+            } catch (...) {
+                outcome.failed = true;
+                result = failure(id, "分析失败: 未知错误");
+            }
+            ch.send_line("{\"event\":\"result\",\"id\":" + dump_line(json(id)) + ",\"result\":" + result + "}");
+            --running;
+            ++completed;
+            if (outcome.failed) ++failed;
+            ch.finish();
+        }
+        --live_workers;
+    }
+
+    static std::string failure(const std::string& id, const std::string& error) {
+        json r;
+        r["id"] = id;
+        r["ok"] = false;
+        r["error"] = error;
+        return dump_line(r);
+    }
+
+    // 执行一个任务：推送开始/阶段/增量事件，返回结果JSON
+    std::string run_task(const Task& task, JobOutcome& outcome) {
+        Channel& ch = *task.channel;
+        const std::string& id = task.job.id;
+        ch.send_line(event("started", id));
+        JobProgress progress;
+        progress.stage = [&ch, &id](const std::string& stage) {
+            json e;
+            e["event"] = "stage";
+            e["id"] = id;
+            e["stage"] = stage;
+            ch.send_line(dump_line(e));
+        };
+        if (task.stream) {
+            progress.tokens = [&ch, &id](const std::string& delta) {
+                json e;
+                e["event"] = "token";
+                e["id"] = id;
+                e["delta"] = delta;
+                ch.send_line(dump_line(e));
+            };
+        }
+        return engine.analyze(task.job, outcome, &progress);
+    }
+
+    std::shared_ptr<Task> make_task(const std::string& text, const std::shared_ptr<Channel>& channel) {
+        std::shared_ptr<Task> task = std::make_shared<Task>();
+        task->job = parse_batch_job(text, next_index++);
+        json j = json::parse(text, nullptr, false);
+        task->stream = j.is_object() && j.contains("options") && j["options"].is_object() &&
+                       j["options"].value("stream", false);
+        task->channel = channel;
+        return task;
+    }
+
+    // NDJSON：每行一个任务，队列满时阻塞读取，背压经TCP传回客户端
+    void serve_lines(LineReader& reader, const std::shared_ptr<Channel>& channel, std::string line) {
+        do {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            json j = json::parse(line, nullptr, false);
+            if (j.is_object() && j.contains("cmd")) {
+                if (j.value("cmd", "") == "stats") channel->send_line("{\"event\":\"stats\",\"stats\":" + stats_json() + "}");
+                else channel->send_line("{\"event\":\"error\",\"message\":\"unknown cmd\"}");
+                continue;
+            }
+            std::shared_ptr<Task> task = make_task(line, channel);
+            channel->begin();
+            json e;
+            e["event"] = "queued";
+            e["id"] = task->job.id;
+            e["position"] = queue.size() + 1;
+            channel->send_line(dump_line(e));
+            if (!queue.push(task)) {
+                channel->send_line(event("rejected", task->job.id));
+                channel->finish();
+                continue;
+            }
+            ++accepted;
+        } while (channel->alive() && reader.line(line));
+        channel->wait_idle();
+    }
+
+    // HTTP：POST /analyze 一个任务一个请求，事件以分块传输逐行返回；队列满返回503
+    void serve_http(LineReader& reader, const std::shared_ptr<Channel>& channel, const std::string& request_line) {
+        size_t length = 0;
+        std::string header;
+        while (reader.line(header) && !header.empty()) {
+            std::string lower = header;
+            for (size_t i = 0; i < lower.size(); ++i) lower[i] = static_cast<char>(tolower(lower[i]));
+            if (lower.compare(0, 15, "content-length:") == 0) length = static_cast<size_t>(atol(lower.c_str() + 15));
+        }
+        std::string body;
+        if (length > 0 && !reader.bytes(length, body)) return;
+        std::istringstream iss(request_line);
+        std::string method, path;
+        iss >> method >> path;
+        std::string plain = "Content-Type: application/json\r\nConnection: close\r\n";
+        if (method == "GET" && (path == "/health" || path == "/stats")) {
+            std::string payload = stats_json();
+            send_all(channel->fd, "HTTP/1.1 200 OK\r\n" + plain + "Content-Length: " + std::to_string(payload.size()) +
+                                      "\r\n\r\n" + payload);
+            return;
+        }
+        if (method != "POST" || (path != "/analyze" && path != "/v1/analyze")) {
+            std::string payload = "{\"error\":\"not found\"}";
+            send_all(channel->fd, "HTTP/1.1 404 Not Found\r\n" + plain + "Content-Length: " +
+                                      std::to_string(payload.size()) + "\r\n\r\n" + payload);
+            return;
+        }
+        std::shared_ptr<Task> task = make_task(body, channel);
+        channel->begin();
+        bool queued;
+        {
+            // 持锁入队并写出响应头，保证工作线程的事件在响应头之后
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            size_t position = queue.size() + 1;
+            queued = queue.try_push(task);
+            if (queued) {
+                send_all(channel->fd, "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\n"
+                                      "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+                channel->http = true;
+                json e;
+                e["event"] = "queued";
+                e["id"] = task->job.id;
+                e["position"] = position;
+                channel->write_locked(dump_line(e));
+            }
+        }
+        if (!queued) {
+            ++rejected;
+            channel->finish();
+            std::string payload = "{\"error\":\"queue full\"}";
+            send_all(channel->fd, "HTTP/1.1 503 Service Unavailable\r\n" + plain + "Retry-After: 1\r\nContent-Length: " +
+                                      std::to_string(payload.size()) + "\r\n\r\n" + payload);
+            return;
+        }
+        ++accepted;
+        channel->wait_idle();
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        if (!channel->broken) send_all(channel->fd, chunk(""));
+    }
+
+    void serve(std::shared_ptr<Channel> channel, std::shared_ptr<std::atomic<bool> > done) {
+        LineReader reader(channel->fd);
+        std::string first;
+        if (reader.line(first)) {
+            if (first.compare(0, 5, "POST ") == 0 || first.compare(0, 4, "GET ") == 0) serve_http(reader, channel, first);
+            else serve_lines(reader, channel, first);
+        }
+        {
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            channel->broken = true;
+            channel->closed = true;
+            close_socket(channel->fd);
+        }
+        *done = true;
+    }
+
+    void accept_loop(socket_t listen_fd) {
+        while (!stopping.load()) {
+            socket_t fd = accept(listen_fd, nullptr, nullptr);
+            if (fd == kInvalidSocket) {
+                if (stopping.load()) break;
+                // 文件描述符耗尽等持续性错误：稍等再试，避免空转占满CPU
+                if (!accept_retryable()) std::this_thread::sleep_for(std::chrono::milliseconds(kAcceptBackoffMs));
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping.load()) {
+                close_socket(fd);
+                break;
+            }
+            // 回收已结束的连接线程，常驻运行时线程对象不累积
+            for (std::list<Connection>::iterator it = connections.begin(); it != connections.end();) {
+                if (it->done->load()) {
+                    it->thread.join();
+                    it = connections.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            set_send_timeout(fd);
+            Connection c;
+            c.channel = std::make_shared<Channel>(fd);
+            c.done = std::make_shared<std::atomic<bool> >(false);
+            c.thread = std::thread(&Impl::serve, this, c.channel, c.done);
+            connections.push_back(std::move(c));
+        }
+    }
+
+    bool listen_tcp(std::string* error) {
+        socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == kInvalidSocket) {
+            if (error) *error = "无法创建TCP套接字";
+            return false;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<unsigned short>(options.port));
+        socklen_t len = sizeof(addr);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            close_socket(fd);
+            if (error) *error = "无法监听 127.0.0.1:" + std::to_string(options.port);
+            return false;
+        }
+        port = ntohs(addr.sin_port);
+        listeners.push_back(fd);
+        return true;
+    }
+
+    bool listen_unix(std::string* error) {
+#ifdef _WIN32
+        if (error) *error = "Windows不支持Unix套接字，请使用--port";
+        return false;
+#else
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (options.socket_path.size() >= sizeof(addr.sun_path)) {
+            if (error) *error = "套接字路径过长：" + options.socket_path;
+            return false;
+        }
+        strncpy(addr.sun_path, options.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        socket_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == kInvalidSocket) {
+            if (error) *error = "无法创建Unix套接字";
+            return false;
+        }
+        // 上次异常退出残留的套接字文件
+        unlink(options.socket_path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+            close_socket(fd);
+            if (error) *error = "无法监听 " + options.socket_path;
+            return false;
+        }
+        unix_bound = true;
+        listeners.push_back(fd);
+        return true;
+#endif
+    }
+};
+
+AnalysisServer::AnalysisServer(AnalysisEngine& engine, const ServerOptions& options)
+    : impl_(new Impl(engine, options)) {}
+
+AnalysisServer::~AnalysisServer() {
+    stop();
+    delete impl_;
+}
+
+bool AnalysisServer::start(std::string* error) {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    if (impl_->options.socket_path.empty() && impl_->options.port < 0) {
+        if (error) *error = "未指定 --socket 或 --port";
+        return false;
+    }
+    if ((!impl_->options.socket_path.empty() && !impl_->listen_unix(error)) ||
+        (impl_->options.port >= 0 && !impl_->listen_tcp(error))) {
+        for (size_t i = 0; i < impl_->listeners.size(); ++i) close_socket(impl_->listeners[i]);
+        impl_->listeners.clear();
+        return false;
+    }
+    size_t workers = impl_->options.workers ? impl_->options.workers : 1;
+    impl_->live_workers = workers;
+    for (size_t i = 0; i < workers; ++i) impl_->workers.push_back(std::thread(&Impl::work, impl_));
+    for (size_t i = 0; i < impl_->listeners.size(); ++i) {
+        impl_->acceptors.push_back(std::thread(&Impl::accept_loop, impl_, impl_->listeners[i]));
+    }
+    return true;
+}
+
+void AnalysisServer::stop() {
+    if (impl_->listeners.empty()) return;
+    impl_->stopping = true;
+    // shutdown使阻塞在accept中的线程返回
+    for (size_t i = 0; i < impl_->listeners.size(); ++i) {
+        shutdown_socket(impl_->listeners[i], false);
+        close_socket(impl_->listeners[i]);
+    }
+    for (size_t i = 0; i < impl_->acceptors.size(); ++i) impl_->acceptors[i].join();
+    impl_->acceptors.clear();
+    impl_->listeners.clear();
+#ifndef _WIN32
+    if (impl_->unix_bound) unlink(impl_->options.socket_path.c_str());
+#endif
+    {
+        // 不再读取新任务；已入队的任务照常完成并把结果发回
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        for (std::list<Connection>::iterator it = impl_->connections.begin(); it != impl_->connections.end(); ++it) {
+            std::lock_guard<std::mutex> ch_lock(it->channel->mutex);
+            if (!it->channel->closed) shutdown_socket(it->channel->fd, true);
+        }
+    }
+    impl_->queue.close();
+    // 限时等待队列排空，之后双向断开仍在发送的连接，唤醒阻塞在send中的工作线程
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(kStopDrainMs);
+    while (impl_->live_workers.load() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        for (std::list<Connection>::iterator it = impl_->connections.begin(); it != impl_->connections.end(); ++it) {
+            std::lock_guard<std::mutex> ch_lock(it->channel->mutex);
+            if (!it->channel->closed) shutdown_socket(it->channel->fd, false);
+        }
+    }
+    for (size_t i = 0; i < impl_->workers.size(); ++i) impl_->workers[i].join();
+    impl_->workers.clear();
+    // 连接线程可能仍在查询统计（需要mutex），取出列表后在锁外等待
+    std::list<Connection> connections;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        connections.swap(impl_->connections);
+    }
+    for (std::list<Connection>::iterator it = connections.begin(); it != connections.end(); ++it) it->thread.join();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+int AnalysisServer::port() const {
+    return impl_->port;
+}
+
+ServerStats AnalysisServer::stats() const {
+    return impl_->stats();
+}
+
+std::string AnalysisServer::stats_line() const {
+    ServerStats s = impl_->stats();
+    std::ostringstream oss;
+    oss << "接收 " << s.accepted << " 个任务，完成 " << s.completed << "（失败 " << s.failed << "），排队 " << s.queued
+        << "，执行中 " << s.running << "，拒绝 " << s.rejected << "，客户端断开跳过 " << s.dropped;
+    return oss.str();
+}
@@ -0,0 +1,561 @@
+#include <sql_normalize.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Utils {
+
+namespace {
+
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v'; }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_word_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+}
+bool is_word_char(char c) { return is_word_start(c) || is_digit(c) || c == '$'; }
+bool is_op_char(char c) { return c != '\0' && std::strchr("+-*/<>=~!@#%^&|`?:", c) != nullptr; }
+char lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; }
+
+// 跳过字符串字面量：i指向开引号，返回闭引号之后的位置；backslash为true时支持 \' 转义（E''字符串）
+size_t skip_quoted(const std::string& s, size_t i, char quote, bool backslash) {
+    size_t n = s.size();
+    ++i;
+    while (i < n) {
+        if (backslash && s[i] == '\\') {
+            i += 2;
+        } else if (s[i] == quote) {
+            if (i + 1 < n && s[i + 1] == quote) i += 2;
+            else return i + 1;
+        } else {
+            ++i;
+        }
+    }
+    return n;
+}
+
+// 美元引用字符串 $tag$...$tag$：i指向首个$，不是美元引用时返回i
+size_t skip_dollar_quoted(const std::string& s, size_t i) {
+    size_t n = s.size(), j = i + 1;
+    if (j < n && is_word_start(s[j])) {
+        while (j < n && (is_word_start(s[j]) || is_digit(s[j]))) ++j;
+    }
+    if (j >= n || s[j] != '$') return i;
+    size_t tag_len = j - i + 1;
+    size_t end = s.find(s.c_str() + i, j + 1, tag_len);
+    return end == std::string::npos ? n : end + tag_len;
+}
+
+// 关键字表（升序，二分查找）：用于区分标识符与关键字
+const char* const kKeywords[] = {
+    "all", "and", "any", "array", "as", "asc", "between", "bigint", "boolean", "both", "by", "case", "cast", "char",
+    "character", "collate", "cross", "current_date", "current_time", "current_timestamp", "date", "decimal",
+    "default", "delete", "desc", "distinct", "else", "end", "except", "exists", "false", "fetch", "filter", "first",
+    "following", "for", "from", "full", "group", "having", "ilike", "in", "inner", "insert", "int", "integer",
+    "intersect", "interval", "into", "is", "join", "last", "lateral", "left", "like", "limit", "minus", "natural",
+    "next", "not", "null", "nulls", "numeric", "offset", "on", "only", "or", "order", "outer", "over", "partition",
+    "preceding", "range", "recursive", "returning", "right", "row", "rows", "select", "set", "similar", "some",
+    "table", "text", "then", "time", "timestamp", "to", "true", "unbounded", "union", "update", "using", "values",
+    "varchar", "when", "where", "window", "with", "within"
+};
+
+bool is_keyword(const std::string& lower_word) {
+    const char* const* end = kKeywords + sizeof(kKeywords) / sizeof(kKeywords[0]);
+    const char* const* it = std::lower_bound(kKeywords, end, lower_word.c_str(),
+                                             [](const char* a, const char* b) { return std::strcmp(a, b) < 0; });
+    return it != end && lower_word == *it;
+}
+
+// 规范化后的单词文本：未加引号的转小写，带引号的保持原样
+std::string word_text(const SqlToken& t) {
+    if (t.kind == SqlTokenKind::QuotedIdent) return t.text.str();
+    std::string out(t.text.data, t.text.size);
+    for (size_t i = 0; i < out.size(); ++i) out[i] = lower(out[i]);
+    return out;
+}
+
+bool is_literal(const SqlToken& t) {
+    return t.kind == SqlTokenKind::String || t.kind == SqlTokenKind::Number || t.kind == SqlTokenKind::Param;
+}
+
+bool is_punct(const SqlToken& t, char c) {
+    return t.kind == SqlTokenKind::Punct && t.text.size == 1 && t.text[0] == c;
+}
+
+bool is_op(const SqlToken& t, const char* op) {
+    return t.kind == SqlTokenKind::Operator && t.text.size == std::strlen(op) &&
+           std::memcmp(t.text.data, op, t.text.size) == 0;
+}
+
+// ---------- 规范化文本 ----------
+
+// 两个相邻单元之间是否需要空格
+bool need_space(const SqlToken& prev, const SqlToken& cur) {
+    if (is_punct(prev, '(') || is_punct(prev, '.') || is_punct(prev, '[') || is_op(prev, "::")) return false;
+    if (is_punct(cur, ')') || is_punct(cur, ',') || is_punct(cur, '.') || is_punct(cur, ';') ||
+        is_punct(cur, '[') || is_punct(cur, ']') || is_op(cur, "::")) {
+        return false;
+    }
+    if (is_punct(cur, '(')) {
+        // 函数调用 f(x) 紧贴，关键字后的括号留空格
+        return !(prev.kind == SqlTokenKind::Word && !is_keyword(word_text(prev))) && prev.kind != SqlTokenKind::QuotedIdent;
+    }
+    return true;
+}
+
+// 一元正负号：紧跟数字，且前面是运算符、"("、","或关键字（x = -1 与 x = 1 形态相同）
+bool is_sign(const std::vector<SqlToken>& tokens, size_t i) {
+    if (!(is_op(tokens[i], "-") || is_op(tokens[i], "+"))) return false;
+    if (i + 1 >= tokens.size() || tokens[i + 1].kind != SqlTokenKind::Number) return false;
+    if (i == 0) return true;
+    const SqlToken& p = tokens[i - 1];
+    return p.kind == SqlTokenKind::Operator || is_punct(p, '(') || is_punct(p, ',') ||
+           (p.kind == SqlTokenKind::Word && is_keyword(word_text(p)));
+}
+
+// tokens[i]为 in 后的"("：若括号内只有常量与逗号，返回")"的下标，否则返回0
+size_t literal_list_end(const std::vector<SqlToken>& tokens, size_t i) {
+    size_t j = i + 1;
+    bool any = false;
+    while (j < tokens.size()) {
+        const SqlToken& t = tokens[j];
+        if (is_punct(t, ')')) return any ? j : 0;
+        if (is_literal(t)) any = true;
+        else if (!is_punct(t, ',') && !is_op(t, "-") && !is_op(t, "+")) return 0;
+        ++j;
+    }
+    return 0;
+}
+
+std::string normalize_tokens(const std::vector<SqlToken>& tokens) {
+    std::string out;
+    size_t end = tokens.size();
+    while (end > 0 && is_punct(tokens[end - 1], ';')) --end;
+    const SqlToken* prev = nullptr;
+    for (size_t i = 0; i < end; ++i) {
+        const SqlToken& t = tokens[i];
+        if (prev && need_space(*prev, t)) out += ' ';
+        if (is_sign(tokens, i)) {
+            ++i;   // 符号并入其后的数字
+            out += '?';
+        } else if (is_literal(t)) {
+            out += '?';
+        } else if (t.kind == SqlTokenKind::Word) {
+            for (size_t k = 0; k < t.text.size; ++k) out += lower(t.text[k]);
+        } else {
+            out.append(t.text.data, t.text.size);
+        }
+        prev = &t;
+        // IN (常量列表) 折叠为 in (?)，列表长度不同的同一查询得到相同形态
+        if (t.kind == SqlTokenKind::Word && t.text.size == 2 && lower(t.text[0]) == 'i' && lower(t.text[1]) == 'n' &&
+            i + 1 < end && is_punct(tokens[i + 1], '(')) {
+            size_t close = literal_list_end(tokens, i + 1);
+            if (close > 0 && close < end) {
+                out += " (?)";
+                i = close;
+                prev = &tokens[close];
+            }
+        }
+    }
+    return out;
+}
+
+// ---------- 表、列与谓词 ----------
+
+enum class Clause { None, Select, From, Where, Expr, Set, Into };
+
+struct Extractor {
+    const std::vector<SqlToken>& tokens;
+    SqlShape& shape;
+    std::unordered_map<std::string, std::string> aliases;   // 别名 -> 表名
+    std::unordered_set<std::string> ctes;
+    std::unordered_set<std::string> output_aliases;         // SELECT列表中的输出别名
+    std::unordered_set<std::string> seen_tables, seen_columns;
+    std::vector<std::pair<std::string, std::string> > raw_columns;   // (限定名, 列名)
+    struct RawPredicate {
+        std::pair<std::string, std::string> column;
+        std::string op;
+        std::string value;
+        std::pair<std::string, std::string> other;
+        bool join;
+    };
+    std::vector<RawPredicate> raw_predicates;
+
+    Extractor(const std::vector<SqlToken>& t, SqlShape& s) : tokens(t), shape(s) {}
+
+    bool word_at(size_t i) const {
+        return i < tokens.size() &&
+               (tokens[i].kind == SqlTokenKind::QuotedIdent ||
+                (tokens[i].kind == SqlTokenKind::Word && !is_keyword(word_text(tokens[i]))));
+    }
+    bool keyword_at(size_t i, const char* kw) const {
+        return i < tokens.size() && tokens[i].kind == SqlTokenKind::Word && word_text(tokens[i]) == kw;
+    }
+
+    // 读取限定名 a.b.c，返回各段，i移到名字之后
+    std::vector<std::string> read_name(size_t& i) const {
+        std::vector<std::string> parts;
+        parts.push_back(word_text(tokens[i++]));
+        while (i + 1 < tokens.size() && is_punct(tokens[i], '.') && word_at(i + 1)) {
+            parts.push_back(word_text(tokens[i + 1]));
+            i += 2;
+        }
+        return parts;
+    }
+
+    void add_table(const std::string& table) {
+        if (ctes.count(table)) return;
+        if (seen_tables.insert(table).second) shape.tables.push_back(table);
+    }
+
+    // 表引用：名字 [AS] [别名]；名字后跟"("为表函数，不计入
+    void read_table(size_t& i) {
+        while (keyword_at(i, "only") || keyword_at(i, "lateral")) ++i;
+        if (!word_at(i)) return;
+        std::vector<std::string> parts = read_name(i);
+        if (i < tokens.size() && is_punct(tokens[i], '(')) return;
+        std::string table = parts.back();
+        if (parts.size() > 1) table = parts[parts.size() - 2] + "." + parts.back();
+        add_table(table);
+        aliases[parts.back()] = table;
+        if (keyword_at(i, "as")) ++i;
+        if (word_at(i)) aliases[word_text(tokens[i++])] = table;
+    }
+
+    // 列引用：[表.]列，可带 ::类型 转换；返回false表示不是列
+    bool read_column(size_t& i, std::pair<std::string, std::string>& col) {
+        if (!word_at(i)) return false;
+        size_t j = i;
+        std::vector<std::string> parts = read_name(j);
+        if (j < tokens.size() && is_punct(tokens[j], '(')) return false;   // 函数调用
+        col.first = parts.size() > 1 ? parts[parts.size() - 2] : "";
+        col.second = parts.back();
+        while (j + 1 < tokens.size() && is_op(tokens[j], "::") && tokens[j + 1].kind == SqlTokenKind::Word) {
+            j += 2;
+            if (j < tokens.size() && is_punct(tokens[j], '(')) return false;   // varchar(10) 等带参数类型，整体跳过
+        }
+        raw_columns.push_back(col);
+        i = j;
+        return true;
+    }
+
+    // 谓词的比较运算符，返回运算符文本并移动i，不是时返回空
+    std::string read_comparison(size_t& i) const {
+        if (i >= tokens.size()) return "";
+        const SqlToken& t = tokens[i];
+        static const char* const kOps[] = { "=", "<>", "!=", "<", "<=", ">", ">=" };
+        for (size_t k = 0; k < sizeof(kOps) / sizeof(kOps[0]); ++k) {
+            if (is_op(t, kOps[k])) {
+                ++i;
+                return kOps[k];
+            }
+        }
+        if (t.kind != SqlTokenKind::Word) return "";
+        std::string w = word_text(t);
+        if (w == "like" || w == "ilike" || w == "in" || w == "between") {
+            ++i;
+            return w;
+        }
+        if (w == "not" && i + 1 < tokens.size()) {
+            std::string next = word_text(tokens[i + 1]);
+            if (next == "like" || next == "ilike" || next == "in" || next == "between") {
+                i += 2;
+                return "not " + next;
+            }
+        }
+        if (w == "is") {
+            if (keyword_at(i + 1, "null")) {
+                i += 2;
+                return "is null";
+            }
+            if (keyword_at(i + 1, "not") && keyword_at(i + 2, "null")) {
+                i += 3;
+                return "is not null";
+            }
+        }
+        return "";
+    }
+
+    // 谓词右侧：常量、IN列表、子查询或另一列
+    void read_operand(size_t& i, RawPredicate& p) {
+        p.join = false;
+        if (p.op == "is null" || p.op == "is not null") return;
+        while (i < tokens.size() && (is_op(tokens[i], "-") || is_op(tokens[i], "+"))) ++i;
+        if (i >= tokens.size()) return;
+        if (is_literal(tokens[i]) || keyword_at(i, "true") || keyword_at(i, "false")) {
+            p.value = "?";
+            ++i;
+            // 类型化常量后的转换 ?::date
+            while (i + 1 < tokens.size() && is_op(tokens[i], "::") && tokens[i + 1].kind == SqlTokenKind::Word) i += 2;
+            return;
+        }
+        if (tokens[i].kind == SqlTokenKind::Word && i + 1 < tokens.size() && tokens[i + 1].kind == SqlTokenKind::String) {
+            p.value = "?";   // date '2024-01-01'、interval '1 day'
+            i += 2;
+            return;
+        }
+        if (is_punct(tokens[i], '(')) {
+            p.value = keyword_at(i + 1, "select") || keyword_at(i + 1, "with") ? "(subquery)" : "(?)";
+            return;   // 括号交给主循环处理（维护子句栈）
+        }
+        if (read_column(i, p.other)) p.join = true;
+    }
+
+    void run() {
+        std::vector<Clause> stack;
+        Clause clause = Clause::None;
+        bool expect_table = false;
+        bool in_with = false;
+        for (size_t i = 0; i < tokens.size();) {
+            const SqlToken& t = tokens[i];
+            if (is_punct(t, '(')) {
+                stack.push_back(clause);
+                expect_table = false;
+                ++i;
+                continue;
+            }
+            if (is_punct(t, ')')) {
+                if (!stack.empty()) {
+                    clause = stack.back();
+                    stack.pop_back();
+                }
+                ++i;
+                continue;
+            }
+            if (is_punct(t, ',')) {
+                if (clause == Clause::From) expect_table = true;
+                if (in_with && stack.empty()) clause = Clause::None;
+                ++i;
+                continue;
+            }
+            if (t.kind == SqlTokenKind::Word) {
+                std::string w = word_text(t);
+                if (is_keyword(w)) {
+                    ++i;
+                    if (w == "with") {
+                        in_with = true;
+                    } else if (w == "select") {
+                        clause = Clause::Select;
+                        if (stack.empty()) in_with = false;
+                    } else if (w == "from" || w == "join") {
+                        clause = Clause::From;
+                        expect_table = true;
+                    } else if (w == "update") {
+                        clause = Clause::From;
+                        expect_table = true;
+                    } else if (w == "into") {
+                        clause = Clause::Into;
+                        expect_table = true;
+                    } else if (w == "where" || w == "on" || w == "having") {
+                        clause = Clause::Where;
+                    } else if (w == "set" && clause != Clause::None) {
+                        clause = Clause::Set;
+                    } else if (w == "group" || w == "order" || w == "returning" || w == "using" ||
+                               w == "partition") {
+                        clause = Clause::Expr;
+                    } else if (w == "values" || w == "limit" || w == "offset" || w == "fetch") {
+                        clause = Clause::None;
+                    } else if (w == "as" && clause == Clause::Select && word_at(i)) {
+                        output_aliases.insert(word_text(tokens[i]));
+                        ++i;
+                    }
+                    continue;
+                }
+            }
+            if (expect_table && (clause == Clause::From || clause == Clause::Into)) {
+                expect_table = false;
+                size_t before = i;
+                read_table(i);
+                if (i != before) continue;
+            }
+            if (in_with && clause == Clause::None && word_at(i)) {
+                // CTE名：name [(列)] AS (
+                ctes.insert(word_text(tokens[i]));
+                ++i;
+                continue;
+            }
+            if (clause == Clause::Select || clause == Clause::Where || clause == Clause::Expr || clause == Clause::Set ||
+                clause == Clause::Into) {
+                // 紧跟在表达式之后的单词是省略AS的输出别名
+                if (clause == Clause::Select && i > 0 && word_at(i) &&
+                    (is_punct(tokens[i - 1], ')') || is_literal(tokens[i - 1]) || word_at(i - 1) ||
+                     keyword_at(i - 1, "end"))) {
+                    output_aliases.insert(word_text(tokens[i]));
+                    ++i;
+                    continue;
+                }
+                RawPredicate p;
+                if (read_column(i, p.column)) {
+                    if (clause == Clause::Where) {
+                        size_t j = i;
+                        p.op = read_comparison(j);
+                        if (!p.op.empty()) {
+                            read_operand(j, p);
+                            raw_predicates.push_back(p);
+                            i = j;
+                        }
+                    }
+                    continue;
+                }
+            }
+            ++i;
+        }
+    }
+
+    // 列名：能解析别名时为 表.列；只引用一张表时，未限定的列归属该表
+    std::string resolve(const std::pair<std::string, std::string>& col) const {
+        if (col.first.empty()) {
+            if (shape.tables.size() == 1 && !output_aliases.count(col.second)) return shape.tables[0] + "." + col.second;
+            return col.second;
+        }
+        std::unordered_map<std::string, std::string>::const_iterator it = aliases.find(col.first);
+        return (it != aliases.end() ? it->second : col.first) + "." + col.second;
+    }
+
+    void finish() {
+        for (size_t i = 0; i < raw_columns.size(); ++i) {
+            const std::pair<std::string, std::string>& c = raw_columns[i];
+            if (c.first.empty() && output_aliases.count(c.second)) continue;
+            std::string name = resolve(c);
+            if (seen_columns.insert(name).second) shape.columns.push_back(name);
+        }
+        for (size_t i = 0; i < raw_predicates.size(); ++i) {
+            const RawPredicate& r = raw_predicates[i];
+            SqlPredicate p;
+            p.column = resolve(r.column);
+            p.op = r.op;
+            p.value = r.join ? resolve(r.other) : r.value;
+            p.join = r.join;
+            shape.predicates.push_back(p);
+        }
+    }
+};
+
+} // namespace
+
+std::vector<SqlToken> tokenize_sql(const std::string& sql) {
+    std::vector<SqlToken> tokens;
+    size_t i = 0, n = sql.size();
+    while (i < n) {
+        char c = sql[i];
+        if (is_space(c)) {
+            ++i;
+            continue;
+        }
+        if (c == '-' && i + 1 < n && sql[i + 1] == '-') {
+            while (i < n && sql[i] != '\n') ++i;
+            continue;
+        }
+        if (c == '/' && i + 1 < n && sql[i + 1] == '*') {
+            // 块注释可嵌套
+            int depth = 1;
+            i += 2;
+            while (i < n && depth > 0) {
+                if (sql[i] == '/' && i + 1 < n && sql[i + 1] == '*') {
+                    ++depth;
+                    i += 2;
+                } else if (sql[i] == '*' && i + 1 < n && sql[i + 1] == '/') {
+                    --depth;
+                    i += 2;
+                } else {
+                    ++i;
+                }
+            }
+            continue;
+        }
+        SqlToken t;
+        size_t start = i;
+        if (c == '\'') {
+            t.kind = SqlTokenKind::String;
+            i = skip_quoted(sql, i, '\'', false);
+        } else if ((c == 'E' || c == 'e' || c == 'B' || c == 'b' || c == 'X' || c == 'x' || c == 'N' || c == 'n') &&
+                   i + 1 < n && sql[i + 1] == '\'') {
+            t.kind = SqlTokenKind::String;
+            i = skip_quoted(sql, i + 1, '\'', c == 'E' || c == 'e');
+        } else if (c == '"') {
+            t.kind = SqlTokenKind::QuotedIdent;
+            i = skip_quoted(sql, i, '"', false);
+        } else if (c == '$') {
+            size_t end = skip_dollar_quoted(sql, i);
+            if (end != i) {
+                t.kind = SqlTokenKind::String;
+                i = end;
+            } else {
+                t.kind = SqlTokenKind::Param;
+                ++i;
+                while (i < n && is_digit(sql[i])) ++i;
+            }
+        } else if (is_digit(c) || (c == '.' && i + 1 < n && is_digit(sql[i + 1]))) {
+            t.kind = SqlTokenKind::Number;
+            while (i < n && (is_digit(sql[i]) || sql[i] == '.')) ++i;
+            if (i < n && (sql[i] == 'e' || sql[i] == 'E')) {
+                size_t j = i + 1;
+                if (j < n && (sql[j] == '+' || sql[j] == '-')) ++j;
+                if (j < n && is_digit(sql[j])) {
+                    i = j;
+                    while (i < n && is_digit(sql[i])) ++i;
+                }
+            }
+        } else if (is_word_start(c)) {
+            t.kind = SqlTokenKind::Word;
+            while (i < n && is_word_char(sql[i])) ++i;
+        } else if (c == '?' && !(i + 1 < n && is_op_char(sql[i + 1]))) {
+            t.kind = SqlTokenKind::Param;
+            ++i;
+        } else if (c == ':' && i + 1 < n && is_word_start(sql[i + 1]) && !(i > 0 && sql[i - 1] == ':')) {
+            t.kind = SqlTokenKind::Param;
+            ++i;
+            while (i < n && is_word_char(sql[i])) ++i;
+        } else if (is_op_char(c)) {
+            t.kind = SqlTokenKind::Operator;
+            ++i;
+            // 运算符按最长匹配，遇到注释起始符时截断
+            while (i < n && is_op_char(sql[i]) && !(sql[i] == '-' && i + 1 < n && sql[i + 1] == '-') &&
+                   !(sql[i] == '/' && i + 1 < n && sql[i + 1] == '*')) {
+                ++i;
+            }
+            // 同PG：多字符运算符不以+/-结尾（除非含~!@#%^&|`?），使 a=-1 拆成 = 和 -
+            while (i - start > 1 && (sql[i - 1] == '+' || sql[i - 1] == '-')) {
+                bool special = false;
+                for (size_t k = start; k < i; ++k) special = special || std::strchr("~!@#%^&|`?", sql[k]) != nullptr;
+                if (special) break;
+                --i;
+            }
+        } else {
+            t.kind = SqlTokenKind::Punct;
+            ++i;
+        }
+        t.text = StrRef(sql.data() + start, i - start);
+        tokens.push_back(t);
+    }
+    return tokens;
+}
+
+std::string normalize_sql(const std::string& sql) {
+    return normalize_tokens(tokenize_sql(sql));
+}
+
+uint64_t sql_fingerprint(const std::string& sql) {
+    std::string normalized = normalize_sql(sql);
+    return fnv1a64(normalized.data(), normalized.size());
+}
+
+SqlShape analyze_sql(const std::string& sql) {
+    SqlShape shape;
+    std::vector<SqlToken> tokens = tokenize_sql(sql);
+    shape.normalized = normalize_tokens(tokens);
+    shape.fingerprint = fnv1a64(shape.normalized.data(), shape.normalized.size());
+    Extractor extractor(tokens, shape);
+    extractor.run();
+    extractor.finish();
+    return shape;
+}
+
+std::string fingerprint_hex(uint64_t fingerprint) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(fingerprint));
+    return buf;
+}
+
+}
@@ -0,0 +1,190 @@
+#include <trace.h>
+#include <ai_engine.h>
+#include <utils.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+std::atomic<unsigned> g_next_tid(1);
+
+// 线程序号：Chrome trace按tid分行显示
+unsigned current_tid() {
+    static thread_local unsigned tid = g_next_tid++;
+    return tid;
+}
+
+// 已排序样本的分位数（最近秩）
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > sorted.size()) rank = sorted.size();
+    return sorted[rank - 1];
+}
+
+bool write_file(const std::string& path, const std::string& content) {
+    std::ofstream fout(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) return false;
+    fout << content;
+    return static_cast<bool>(fout);
+}
+
+} // namespace
+
+Trace::Trace() : session_id_(Utils::generate_uuid()), start_(Clock::now()) {}
+
+double Trace::now_us() const {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start_).count();
+}
+
+void Trace::record(const std::string& name, const std::string& category, double start_us, double dur_us,
+                   const std::string& detail) {
+    TraceEvent e;
+    e.name = name;
+    e.category = category;
+    e.start_us = start_us;
+    e.dur_us = dur_us < 0 ? 0 : dur_us;
+    e.tid = current_tid();
+    e.detail = detail;
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(e);
+}
+
+std::vector<TraceEvent> Trace::events() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+}
+
+std::vector<StageStats> Trace::stage_stats() const {
+    std::vector<TraceEvent> all = events();
+    std::vector<std::string> names;
+    std::vector<std::vector<double> > samples;
+    for (size_t i = 0; i < all.size(); ++i) {
+        size_t k = std::find(names.begin(), names.end(), all[i].name) - names.begin();
+        if (k == names.size()) {
+            names.push_back(all[i].name);
+            samples.push_back(std::vector<double>());
+        }
+        samples[k].push_back(all[i].dur_us / 1000.0);
+    }
+    std::vector<StageStats> out;
+    for (size_t k = 0; k < names.size(); ++k) {
+        std::vector<double>& v = samples[k];
+        std::sort(v.begin(), v.end());
+        StageStats s;
+        s.name = names[k];
+        s.count = v.size();
+        s.total_ms = 0;
+        for (size_t i = 0; i < v.size(); ++i) s.total_ms += v[i];
+        s.p50_ms = percentile(v, 50);
+        s.p95_ms = percentile(v, 95);
+        s.p99_ms = percentile(v, 99);
+        s.max_ms = v.back();
+        out.push_back(s);
+    }
+    return out;
+}
+
+std::string Trace::to_json() const {
+    json j;
+    j["session_id"] = session_id_;
+    json& stages = j["stages"] = json::array();
+    std::vector<StageStats> stats = stage_stats();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const StageStats& s = stats[i];
+        stages.push_back({ {"name", s.name}, {"count", s.count}, {"total_ms", s.total_ms}, {"p50_ms", s.p50_ms},
+                           {"p95_ms", s.p95_ms}, {"p99_ms", s.p99_ms}, {"max_ms", s.max_ms} });
+    }
+    json& evs = j["events"] = json::array();
+    std::vector<TraceEvent> all = events();
+    for (size_t i = 0; i < all.size(); ++i) {
+        const TraceEvent& e = all[i];
+        json ev = { {"name", e.name}, {"cat", e.category}, {"start_ms", e.start_us / 1000.0},
+                    {"dur_ms", e.dur_us / 1000.0}, {"tid", e.tid} };
+        if (!e.detail.empty()) ev["detail"] = e.detail;
+        evs.push_back(ev);
+    }
+    return j.dump(2);
+}
+
+std::string Trace::to_chrome_json() const {
+    json j;
+    json& evs = j["traceEvents"] = json::array();
+    evs.push_back({ {"name", "process_name"}, {"ph", "M"}, {"pid", 1},
+                    {"args", { {"name", "AIAgent " + session_id_} }} });
+    std::vector<TraceEvent> all = events();
+    for (size_t i = 0; i < all.size(); ++i) {
+        const TraceEvent& e = all[i];
+        json ev = { {"name", e.name}, {"cat", e.category}, {"ph", "X"}, {"ts", e.start_us},
+                    {"dur", e.dur_us}, {"pid", 1}, {"tid", e.tid} };
+        if (!e.detail.empty()) ev["args"] = { {"detail", e.detail} };
+        evs.push_back(ev);
+    }
+    j["displayTimeUnit"] = "ms";
+    return j.dump();
+}
+
+bool Trace::write_json(const std::string& path) const {
+    return write_file(path, to_json());
+}
+
+bool Trace::write_chrome_json(const std::string& path) const {
+    return write_file(path, to_chrome_json());
+}
+
+std::string Trace::summary() const {
+    std::vector<StageStats> stats = stage_stats();
+    std::ostringstream oss;
+    oss << std::left << std::setw(14) << "阶段" << std::right << std::setw(10) << "次数" << std::setw(12) << "p50"
+        << std::setw(12) << "p95" << std::setw(12) << "p99" << std::setw(14) << "最大" << "\n";
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const StageStats& s = stats[i];
+        oss << std::left << std::setw(12) << s.name << std::right << std::setw(8) << s.count
+            << std::setw(12) << Utils::format_time(s.p50_ms / 1000) << std::setw(12) << Utils::format_time(s.p95_ms / 1000)
+            << std::setw(12) << Utils::format_time(s.p99_ms / 1000) << std::setw(12) << Utils::format_time(s.max_ms / 1000)
+            << "\n";
+    }
+    return oss.str();
+}
+
+TraceSpan::TraceSpan(Trace* trace, const char* name, const char* category, const std::string& detail)
+    : trace_(trace), name_(name), category_(category), start_us_(0) {
+    if (!trace_) return;
+    detail_ = detail;
+    start_us_ = trace_->now_us();
+}
+
+TraceSpan::~TraceSpan() {
+    end();
+}
+
+void TraceSpan::end() {
+    if (!trace_) return;
+    trace_->record(name_, category_, start_us_, trace_->now_us() - start_us_, detail_);
+    trace_ = nullptr;
+}
+
+void trace_ai_call(Trace* trace, double start_us, const AICallStats& stats, const std::string& detail) {
+    if (!trace) return;
+    if (stats.cache_hit) {
+        trace->record("ai.cache_hit", "ai", start_us, stats.total_ms * 1000, detail);
+        return;
+    }
+    double t = start_us;
+    if (stats.connect_ms > 0) {
+        trace->record("ai.connect", "ai", t, stats.connect_ms * 1000, detail);
+        t += stats.connect_ms * 1000;
+    }
+    if (stats.tls_ms > 0) trace->record("ai.tls", "ai", t, stats.tls_ms * 1000, detail);
+    if (stats.first_token_ms >= 0) trace->record("ai.ttft", "ai", start_us, stats.first_token_ms * 1000, detail);
+    trace->record("ai.total", "ai", start_us, stats.total_ms * 1000, detail);
+}
@@ -1,2 +1,115 @@
-#include "utils.h"
-// 预留工具函数实现
+#include <utils.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace Utils {
+
+size_t estimate_tokens(const std::string& text) {
+    size_t ascii = 0, wide = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x80) ++ascii;
+        else if ((c & 0xC0) != 0x80) ++wide;   // 只统计多字节字符的首字节
+    }
+    return (ascii * 2 + 6) / 7 + (wide * 3 + 1) / 2;
+}
+
+std::vector<std::string> split(const std::string& str, char delimiter) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t pos = str.find(delimiter, start);
+        if (pos == std::string::npos) {
+            parts.push_back(str.substr(start));
+            return parts;
+        }
+        parts.push_back(str.substr(start, pos - start));
+        start = pos + 1;
+    }
+}
+
+std::string trim(const std::string& str) {
+    static const char* const kSpaces = " \t\r\n\f\v";
+    size_t b = str.find_first_not_of(kSpaces);
+    if (b == std::string::npos) return "";
+    size_t e = str.find_last_not_of(kSpaces);
+    return str.substr(b, e - b + 1);
+}
+
+std::string to_lower(const std::string& str) {
+    // 只转换ASCII字母，多字节字符原样保留
+    std::string out(str);
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i] >= 'A' && out[i] <= 'Z') out[i] = static_cast<char>(out[i] - 'A' + 'a');
+    }
+    return out;
+}
+
+std::string sanitize_utf8(const std::string& str) {
+    std::string out;
+    out.reserve(str.size());
+    size_t i = 0;
+    while (i < str.size()) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        size_t len = 0;
+        unsigned char lo = 0x80, hi = 0xBF;   // 第二个字节的合法范围（排除过长编码与代理区）
+        if (c < 0x80) len = 1;
+        else if (c >= 0xC2 && c <= 0xDF) len = 2;
+        else if (c >= 0xE0 && c <= 0xEF) { len = 3; if (c == 0xE0) lo = 0xA0; if (c == 0xED) hi = 0x9F; }
+        else if (c >= 0xF0 && c <= 0xF4) { len = 4; if (c == 0xF0) lo = 0x90; if (c == 0xF4) hi = 0x8F; }
+        bool valid = len > 0 && i + len <= str.size();
+        for (size_t k = 1; valid && k < len; ++k) {
+            unsigned char b = static_cast<unsigned char>(str[i + k]);
+            valid = k == 1 ? (b >= lo && b <= hi) : (b & 0xC0) == 0x80;
+        }
+        if (valid) {
+            out.append(str, i, len);
+            i += len;
+        } else {
+            out += "\xEF\xBF\xBD";
+            ++i;
+        }
+    }
+    return out;
+}
+
+bool contains(const std::string& str, const std::string& substr) {
+    return str.find(substr) != std::string::npos;
+}
+
+std::string format_time(double seconds) {
+    char buf[32];
+    if (seconds < 0) seconds = 0;
+    if (seconds < 1e-3) {
+        std::snprintf(buf, sizeof(buf), "%.0f us", seconds * 1e6);
+    } else if (seconds < 1) {
+        std::snprintf(buf, sizeof(buf), "%.1f ms", seconds * 1e3);
+    } else if (seconds < 60) {
+        std::snprintf(buf, sizeof(buf), "%.2f s", seconds);
+    } else {
+        long total = static_cast<long>(seconds + 0.5);
+        std::snprintf(buf, sizeof(buf), "%ldm%02lds", total / 60, total % 60);
+    }
+    return buf;
+}
+
+std::string generate_uuid() {
+    // 每个线程独立的随机源，以时钟与线程ID混合播种
+    static thread_local std::mt19937_64 rng(
+        static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count()) ^
+        (static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) << 1) ^
+        static_cast<uint64_t>(std::random_device()()));
+    uint64_t hi = rng(), lo = rng();
+    hi = (hi & 0xFFFFFFFFFFFF0FFFULL) | 0x0000000000004000ULL;   // 版本4
+    lo = (lo & 0x3FFFFFFFFFFFFFFFULL) | 0x8000000000000000ULL;   // RFC 4122变体
+    char buf[37];
+    std::snprintf(buf, sizeof(buf), "%08x-%04x-%04x-%04x-%012llx",
+                  static_cast<unsigned>(hi >> 32), static_cast<unsigned>((hi >> 16) & 0xFFFF),
+                  static_cast<unsigned>(hi & 0xFFFF), static_cast<unsigned>(lo >> 48),
+                  static_cast<unsigned long long>(lo & 0xFFFFFFFFFFFFULL));
+    return buf;
+}
+
+} // namespace Utils
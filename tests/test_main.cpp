@@ -0,0 +1,179 @@
+// 纯函数模块的回归测试：SQL规范化/指纹/表列提取、执行计划解析
+// 不依赖测试框架，失败时打印位置并以非0退出（ctest 据此判定）
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "agent2_diagnose.h"
+#include "sql_normalize.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond)                                                                      \
+    do {                                                                                 \
+        if (!(cond)) {                                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #cond << std::endl; \
+            ++g_failures;                                                                \
+        }                                                                                \
+    } while (0)
+
+bool near(double a, double b) { return std::fabs(a - b) < 1e-6 * std::max(1.0, std::fabs(b)); }
+
+bool contains(const std::vector<std::string>& v, const std::string& s) {
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (v[i] == s) return true;
+    }
+    return false;
+}
+
+// 只是字面量、注释、空白、大小写或IN列表长度不同的SQL属于同一形态
+void test_fingerprint() {
+    uint64_t base = Utils::sql_fingerprint("SELECT * FROM orders WHERE o_id = 1 AND o_status = 'F'");
+    CHECK(base == Utils::sql_fingerprint("select *\n  from ORDERS where o_id=42 and o_status = 'O'"));
+    CHECK(base == Utils::sql_fingerprint("SELECT * /* 注释 */ FROM orders -- 行注释\nWHERE o_id = 7 AND o_status = E'x'"));
+    CHECK(base != Utils::sql_fingerprint("SELECT * FROM lineitem WHERE o_id = 1 AND o_status = 'F'"));
+    CHECK(base != Utils::sql_fingerprint("SELECT * FROM orders WHERE o_id > 1 AND o_status = 'F'"));
+
+    uint64_t in_list = Utils::sql_fingerprint("SELECT * FROM t WHERE a IN (1, 2, 3)");
+    CHECK(in_list == Utils::sql_fingerprint("SELECT * FROM t WHERE a IN (9)"));
+    CHECK(in_list == Utils::sql_fingerprint("SELECT * FROM t WHERE a IN ($1, $2)"));
+
+    CHECK(Utils::normalize_sql("SELECT a FROM t /* x /* 嵌套 */ y */ WHERE b = 'q''s'") ==
+          "select a from t where b = ?");
+}
+
+void test_tables_and_columns() {
+    Utils::SqlShape s = Utils::analyze_sql(
+        "SELECT o.o_id, c.name FROM orders o JOIN customer c ON o.cid = c.id "
+        "WHERE o.amount > 10 AND c.region IN ('a', 'b')");
+    CHECK(s.tables.size() == 2);
+    CHECK(contains(s.tables, "orders"));
+    CHECK(contains(s.tables, "customer"));
+    CHECK(contains(s.columns, "orders.o_id"));
+    CHECK(contains(s.columns, "customer.name"));
+    CHECK(contains(s.columns, "orders.amount"));
+    CHECK(contains(s.columns, "customer.region"));
+    CHECK(s.predicates.size() == 3);
+    if (s.predicates.size() == 3) {
+        CHECK(s.predicates[0].join);
+        CHECK(s.predicates[0].column == "orders.cid" && s.predicates[0].value == "customer.id");
+        CHECK(!s.predicates[1].join && s.predicates[1].op == ">" && s.predicates[1].value == "?");
+        CHECK(s.predicates[2].op == "in" && s.predicates[2].value == "(?)");
+    }
+    CHECK(s.fingerprint == Utils::sql_fingerprint(s.normalized));
+
+    // CTE名不算表
+    Utils::SqlShape w = Utils::analyze_sql("WITH r AS (SELECT id FROM orders) SELECT * FROM r JOIN items i ON i.oid = r.id");
+    CHECK(w.tables.size() == 2);
+    CHECK(contains(w.tables, "orders"));
+    CHECK(contains(w.tables, "items"));
+    CHECK(!contains(w.tables, "r"));
+}
+
+// GaussDB EXPLAIN PERFORMANCE 表格格式：多DN耗时区间、Streaming类型、按计划id归属的明细
+void test_gauss_plan() {
+    const std::string explain =
+        " id |                  operation                   |       A-time       |  A-rows  |  E-rows  |  Peak Memory  | E-width\n"
+        "----+----------------------------------------------+--------------------+----------+----------+---------------+--------\n"
+        "  1 | ->  Row Adapter                              | 5234.120           |       10 |       10 | 86KB          |      60\n"
+        "  2 |    ->  Vector Streaming (type: GATHER)       | 5230.010           |       30 |       30 | 200KB         |      60\n"
+        "  3 |       ->  Vector Hash Join (4,5)             | [3000.0, 4900.0]   |  6000000 |    50000 | [80MB, 120MB] |      40\n"
+        "  4 |          ->  Vector Seq Scan on lineitem     | [900.0, 1100.0]    | 59986052 | 60000000 | [1MB, 1MB]    |      24\n"
+        "  5 |          ->  Vector Streaming(type: BROADCAST dop: 1/4) | [200.0, 300.0] | 1500000 | 1500 | [3MB, 3MB] |  16\n"
+        "  6 |             ->  Vector Seq Scan on orders    | [100.0, 150.0]     |   150000 |      150 | [1MB, 1MB]    |      16\n"
+        "(6 rows)\n"
+        "\n"
+        " Predicate Information (identified by plan id)\n"
+        " ----------------------------------------------\n"
+        "   3 --Vector Hash Join (4,5)\n"
+        "         Hash Cond: (lineitem.l_orderkey = orders.o_orderkey)\n"
+        "   6 --Vector Seq Scan on orders\n"
+        "         Filter: (o_comment ~~ '%spill%external%'::text)\n"
+        "         Rows Removed by Filter: 1350000\n"
+        " Memory Information (identified by plan id)\n"
+        " --------------------------------------------------\n"
+        "   3 --Vector Hash Join (4,5)\n"
+        "         datanode1 Memory Used : 120MB, spill file number: 32\n"
+        " Total runtime: 5240.5 ms\n";
+    PlanTree plan = parse_plan(explain);
+    CHECK(plan.analyzed);
+    CHECK(near(plan.total_runtime_ms, 5240.5));
+    CHECK(plan.nodes.size() == 6);
+    if (plan.nodes.size() != 6) return;
+    CHECK(plan.nodes[0].parent == -1);
+    CHECK(plan.nodes[1].stream == StreamKind::Gather);
+    CHECK(plan.nodes[2].kind == OperatorKind::HashJoin);
+    CHECK(plan.nodes[2].parent == 1);
+    CHECK(near(plan.nodes[2].a_time_ms, 4900) && near(plan.nodes[2].a_time_min_ms, 3000));
+    CHECK(near(plan.nodes[2].peak_memory_kb, 120 * 1024));
+    CHECK(plan.nodes[2].spilled);
+    CHECK(plan.nodes[3].relation.str() == "lineitem" && plan.nodes[3].parent == 2);
+    CHECK(plan.nodes[4].stream == StreamKind::Broadcast && plan.nodes[4].parent == 2);
+    CHECK(plan.nodes[5].relation.str() == "orders" && plan.nodes[5].parent == 4);
+    CHECK(plan.nodes[5].has_filter && near(plan.nodes[5].rows_removed, 1350000));
+    CHECK(!plan.nodes[5].spilled);  // 谓词中的 spill/external 字面量不是下盘
+    CHECK(plan.find(6) == 5 && plan.find(7) == -1);
+}
+
+// PG 缩进格式：loops 折算、排序下盘、never executed 节点
+void test_pg_plan() {
+    const std::string explain =
+        " Sort  (cost=1000.00..1001.00 rows=100 width=32) (actual time=520.1..530.2 rows=150000 loops=1)\n"
+        "   Sort Key: a\n"
+        "   Sort Method: external merge  Disk: 4096kB\n"
+        "   ->  Nested Loop  (cost=0.00..900.00 rows=100 width=32) (actual time=0.1..400.0 rows=150000 loops=1)\n"
+        "         ->  Seq Scan on t1  (cost=0.00..10.00 rows=10 width=16) (actual time=0.01..5.0 rows=1000 loops=1)\n"
+        "               Filter: (x > 5)\n"
+        "               Rows Removed by Filter: 99000\n"
+        "         ->  Index Scan using idx_t2 on t2  (cost=0.00..8.00 rows=10 width=16) (actual time=0.01..0.3 rows=150 loops=1000)\n"
+        " Execution Time: 531.0 ms\n";
+    PlanTree plan = parse_plan(explain);
+    CHECK(near(plan.total_runtime_ms, 531.0));
+    CHECK(plan.nodes.size() == 4);
+    if (plan.nodes.size() != 4) return;
+    CHECK(plan.nodes[0].kind == OperatorKind::Sort && plan.nodes[0].spilled);
+    CHECK(plan.nodes[1].kind == OperatorKind::NestLoop && plan.nodes[1].parent == 0);
+    CHECK(plan.nodes[2].relation.str() == "t1" && plan.nodes[2].parent == 1);
+    CHECK(near(plan.nodes[2].rows_removed, 99000) && !plan.nodes[2].spilled);
+    // 内层每次0.3ms，执行1000次
+    CHECK(plan.nodes[3].relation.str() == "t2" && plan.nodes[3].parent == 1);
+    CHECK(near(plan.nodes[3].a_time_ms, 300));
+    CHECK(near(plan.nodes[3].e_rows, 10) && plan.nodes[3].width == 16);
+
+    const std::string never =
+        " Hash Join  (cost=10.00..200.00 rows=100 width=16) (actual time=1.000..9.000 rows=0 loops=1)\n"
+        "   Hash Cond: (o.cid = c.id)\n"
+        "   ->  Seq Scan on orders o  (cost=0.00..100.00 rows=10 width=8) (actual time=0.010..5.000 rows=10 loops=1)\n"
+        "         Filter: (channel = 'external'::text)\n"
+        "         Rows Removed by Filter: 990\n"
+        "   ->  Hash  (cost=5.00..5.00 rows=1 width=8) (never executed)\n"
+        "         ->  Seq Scan on customer c  (cost=0.00..5.00 rows=1 width=8) (never executed)\n"
+        " Execution Time: 9.5 ms\n";
+    PlanTree tree = parse_plan(never);
+    CHECK(tree.nodes.size() == 4);
+    if (tree.nodes.size() != 4) return;
+    CHECK(tree.nodes[1].relation.str() == "orders" && tree.nodes[1].has_filter);
+    CHECK(!tree.nodes[1].spilled);  // Filter 中的 'external' 曾被误判为下盘
+    CHECK(!tree.nodes[0].spilled);
+    CHECK(tree.nodes[2].parent == 0 && tree.nodes[3].parent == 2);
+    CHECK(near(tree.nodes[3].a_time_ms, 0) && near(tree.nodes[3].a_rows, 0));
+    CHECK(near(tree.nodes[0].self_time_ms, 4));
+}
+
+}
+
+int main() {
+    test_fingerprint();
+    test_tables_and_columns();
+    test_gauss_plan();
+    test_pg_plan();
+    if (g_failures > 0) {
+        std::cerr << g_failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "全部通过" << std::endl;
+    return 0;
+}